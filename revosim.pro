@@ -1,3 +1,7 @@
 TEMPLATE = subdirs
 SUBDIRS = revosim \
+          revosimcli \
           utility/envirogen \
+
+revosimcli.file = revosim/revosimcli.pro
+revosimcli.makefile = Makefile.cli
@@ -16,14 +16,16 @@
  */
 
 #include "analyser.h"
-#include "mainwindow.h"
 #include "simmanager.h"
 #include "globals.h"
 
+#ifndef REVOSIM_CLI
+#include "mainwindow.h"
+#endif
+
 #include <QDebug>
 #include <QHash>
 #include <QHashIterator>
-#include <QMessageBox>
 #include <QSet>
 #include <QTextStream>
 #include <QTime>
@@ -35,7 +37,7 @@
  */
 Species::Species()
 {
-    type = 0;
+    type = Genome();
     ID = 0; //default, not assigned
     internalID = -1;
     parent = 0;
@@ -56,7 +58,7 @@ Analyser::Analyser()
  * \brief Analyser::addGenomeFast
  * \param genome
  */
-void Analyser::addGenomeFast(quint64 genome)
+void Analyser::addGenomeFast(const Genome &genome)
 {
     //adds genome to sorted list. Use halving algorithm to find insertion point
 
@@ -177,14 +179,14 @@ void Analyser::groupsGenealogicalTracker()
     QTime t;
     t.start(); //for debug/user warning timing purposes
 
-    QHash<quint64, QSet<quint64> *>
+    QHash<quint64, QSet<Genome> *>
     genomedata; //key is speciesID, set is all unique genomes within that species
 
     //Horrible container structure to store all locations of particular genomes, for rapid write-back of new species
     //first key is speciesID
     //second key is gemome
-    //qlist is of quint32s which are packed x,y,z as x*65536+y*256+z
-    QHash<quint64, QHash<quint64, QList<quint32> *> *> slotswithgenome;
+    //qlist is of quint64s which are packed x,y,z as x*2^32+y*256+z
+    QHash<quint64, QHash<Genome, QList<quint64> *> *> slotswithgenome;
 
     QHash<quint64, qint32>
     speciesSizes; //number of occurrences of particular species - key is speciesID
@@ -198,17 +200,17 @@ void Analyser::groupsGenealogicalTracker()
             {
                 if (critters[n][m][c].age > 0)   //if critter is alive
                 {
-                    QHash<quint64, QList<quint32>*>
+                    QHash<Genome, QList<quint64>*>
                     *genomeposlist; //will be pointer to the position list by genome for this species
-                    QSet<quint64> *speciesset; //will be pointer to the genome set for this species
-                    speciesset = genomedata.value(critters[n][m][c].speciesID, static_cast<QSet<quint64> *>(nullptr)); //get the latter from hash table if it's there
+                    QSet<Genome> *speciesset; //will be pointer to the genome set for this species
+                    speciesset = genomedata.value(critters[n][m][c].speciesID, static_cast<QSet<Genome> *>(nullptr)); //get the latter from hash table if it's there
                     if (!speciesset)   //it wasn't there - so first time we've seen this species this iteration
                     {
-                        speciesset = new QSet<quint64>; //new set for the genomes for the species
+                        speciesset = new QSet<Genome>; //new set for the genomes for the species
                         genomedata.insert(critters[n][m][c].speciesID, speciesset); //add it to the hash
 
                         genomeposlist = new
-                        QHash<quint64, QList<quint32>*>; //new genome/position list hash table for the species
+                        QHash<Genome, QList<quint64>*>; //new genome/position list hash table for the species
                         slotswithgenome.insert(critters[n][m][c].speciesID, genomeposlist); //add this to its hash as well
                     }
                     else     //species already encountered - objects exist
@@ -218,21 +220,21 @@ void Analyser::groupsGenealogicalTracker()
                         //speciesset already retrieved
                     }
 
-                    QList<quint32> *poslist; //this will be used or particular position list for this genome
+                    QList<quint64> *poslist; //this will be used or particular position list for this genome
                     int before =
                         speciesset->count(); //to check - will insert actually add genome? If not it's a duplicate
                     speciesset->insert(critters[n][m][c].genome); //add genome to the set
                     if (before != speciesset->count())   // count changed, so genome is novel for the species
                     {
                         //needs a new position list object
-                        poslist = new QList<quint32>; //create
+                        poslist = new QList<quint64>; //create
                         genomeposlist->insert(critters[n][m][c].genome, poslist); //and add to the hash for the species
                     }
                     else     //genome not novel, so list already exists - retrieve it from the hash list
                     {
                         poslist = genomeposlist->value(critters[n][m][c].genome);
                     }
-                    poslist->append(static_cast<quint32>(n * 65536 + m * 256 + c)); //package up x,y,z and add them to the list
+                    poslist->append((static_cast<quint64>(n) << 32) | static_cast<quint64>(m * 256 + c)); //package up x,y,z and add them to the list
 
                     //add 1 to count of occurrences for this speciesID - by end it will be correct - pre-splitting
                     //later if species are split off, their counts will be removed from this
@@ -245,13 +247,14 @@ void Analyser::groupsGenealogicalTracker()
     //MDS - Next. Go through each species and do all the pairwise comparisons. This is 2 above.
     //RJG - this is the really time consuming bit of the process especially when many species. Add progress bar if it's slow.
 
-    QHashIterator<quint64, QSet<quint64> *> ii(
+    QHashIterator<quint64, QSet<Genome> *> ii(
         genomedata); //iterator to loop over all species and their genome sets
 
     QList<Species> newSpeciesList; // will eventually replace the global oldSpeciesList
     // convenient to build into  a new list, then copy at the end
 
     //RJG - Add a progress bar
+#ifndef REVOSIM_CLI
     QProgressBar prBar;
     //Work out limits
     int count = 0;
@@ -268,19 +271,22 @@ void Analyser::groupsGenealogicalTracker()
         count = 0;
         ii.toFront();
     }
+#endif
 
     while (ii.hasNext())   //for each entry in genomedata hash
     {
         ii.next();
 
+#ifndef REVOSIM_CLI
         if (simulationManager->warningCount > 0)
         {
             count++;
             prBar.setValue(count);
             mainWindow->processAppEvents();
         }
+#endif
 
-        QSet<quint64> *speciesset = ii.value(); // Get the set of genomes
+        QSet<Genome> *speciesset = ii.value(); // Get the set of genomes
         quint64 speciesID = ii.key(); //get the speciesID
         LogSpecies *thislogspecies = nullptr;
 
@@ -289,7 +295,7 @@ void Analyser::groupsGenealogicalTracker()
             thislogspecies = logSpeciesByID.value(speciesID, static_cast<LogSpecies *>(nullptr));
             if (!thislogspecies)
             {
-                QMessageBox::warning(mainWindow, "Oops", "Internal error - species not found in log hash. Please email " + QString(EMAIL) + " with this message or go to " + QString(GITURL) + QString(
+                simulationManager->showWarning("Oops", "Internal error - species not found in log hash. Please email " + QString(EMAIL) + " with this message or go to " + QString(GITURL) + QString(
                                          GITREPOSITORY) + QString(GITISSUE));
                 exit(0);
             }
@@ -297,7 +303,7 @@ void Analyser::groupsGenealogicalTracker()
 
         //for speed when working, we convert the set into a static array of genomes
         //static array of group codes
-        quint64 genomes[MAX_GENOME_COUNT];
+        QVector<Genome> genomes(speciesset->count()); //on the heap - wide genomes would be too big for the stack
         qint32 groupcodes[MAX_GENOME_COUNT];
 
         qint32 grouplookup[MAX_GENOME_COUNT]; //which group is this merged with? We no longer actually change group values - far too slow
@@ -307,8 +313,7 @@ void Analyser::groupsGenealogicalTracker()
 
         if (speciesset->count() >= MAX_GENOME_COUNT)   //check it actually fits in the static array
         {
-            QMessageBox::warning(
-                mainWindow,
+            simulationManager->showWarning(
                 "Oops",
                 "Species static array too small - you have more species than " + QString(PRODUCTNAME) + " was designed to handle.  Please email " + QString(EMAIL) + " with this message or go to " + QString(
                     GITURL) + QString(GITREPOSITORY) + QString(GITISSUE) + "." +
@@ -318,7 +323,7 @@ void Analyser::groupsGenealogicalTracker()
             exit(0);
         }
 
-        foreach (quint64 g, *speciesset)   //copy genomes into static array and set groupcodes to 'not assigned' (-1)
+        foreach (const Genome &g, *speciesset)   //copy genomes into static array and set groupcodes to 'not assigned' (-1)
         {
             genomes[arrayMax] = g;
             groupcodes[arrayMax] = -1; //code for not assigned
@@ -335,7 +340,7 @@ void Analyser::groupsGenealogicalTracker()
             if (groupcodes[first] == -1)
                 groupcodes[first] = nextGroup++; //so first genome will be in group 0
 
-            quint64 firstgenome = genomes[first]; //get genome of first for speed - many comparisons to come
+            Genome firstgenome = genomes[first]; //get genome of first for speed - many comparisons to come
             qint32 firstgroupcode = groupcodes[first];
             while (grouplookup[firstgroupcode] != firstgroupcode)
                 firstgroupcode = grouplookup[firstgroupcode];
@@ -356,26 +361,19 @@ void Analyser::groupsGenealogicalTracker()
                 }
                 //do comparison using standard (for REvoSim) xor/bitcount code. By nd, t1 is bit-distance.
                 //maxDifference is set by user in the settings dialog
-                quint64 g1x = firstgenome ^ genomes[second]; //XOR the two to compare
-                auto g1xl = static_cast<quint32>(g1x & (static_cast<quint64>(65536) * static_cast<quint64>(65536) - static_cast<quint64>(1))); //lower 32 bits
-                int t1 = static_cast<int>(bitCounts[g1xl / static_cast<quint32>(65536)] +  bitCounts[g1xl & static_cast<quint32>(65535)]);
+                int t1 = FitnessKernel::genomeDifference(firstgenome, genomes[second]); //XOR the two to compare, count all words
                 if (t1 <= maxDifference)
                 {
-                    auto g1xu = static_cast<quint32>(g1x / (static_cast<quint64>(65536) * static_cast<quint64>(65536))); //upper 32 bits
-                    t1 += bitCounts[g1xu / static_cast<quint32>(65536)] +  bitCounts[g1xu & static_cast<quint32>(65535)];
-                    if (t1 <= maxDifference)
+                    //Pair IS within tolerances - so second should be in the same group as first
+                    //if second not in a group - place it in group of first
+                    if (gcs == -1)
+                        groupcodes[second] = firstgroupcode;
+                    else
                     {
-                        //Pair IS within tolerances - so second should be in the same group as first
-                        //if second not in a group - place it in group of first
-                        if (gcs == -1)
-                            groupcodes[second] = firstgroupcode;
-                        else
-                        {
-                            //It was in a group - but not same group as first or
-                            //would have been caught by first line of loop
-                            //so merge this group into group of first
-                            grouplookup[gcs] = firstgroupcode;
-                        }
+                        //It was in a group - but not same group as first or
+                        //would have been caught by first line of loop
+                        //so merge this group into group of first
+                        grouplookup[gcs] = firstgroupcode;
                     }
                 }
             }
@@ -433,20 +431,20 @@ void Analyser::groupsGenealogicalTracker()
             {
                 qint32 groupcode = jj.key(); //get its code
                 quint64 speciesSize = 0; //zero its size
-                quint64 samplegenome = 0;  //will have to pick a genome for 'type' - it goes here
+                Genome samplegenome{};  //will have to pick a genome for 'type' - it goes here
 
                 for (int iii = 0; iii < arrayMax; iii++) //go through static arrays -
                     //find all genome entries for this group
                     //and fix data in critters for them
                     if (groupcodes[iii] == groupcode)
                     {
-                        QList<quint32> *updatelist = slotswithgenome.value(speciesID)->value(genomes[iii]);
+                        QList<quint64> *updatelist = slotswithgenome.value(speciesID)->value(genomes[iii]);
                         //retrieve the list of positions for this genome
                         speciesSize += static_cast<quint64>(updatelist->count()); //add its count to size
-                        foreach (quint32 v, *updatelist)   //go through list and set critters data to new species
+                        foreach (quint64 v, *updatelist)   //go through list and set critters data to new species
                         {
-                            int x = v / 65536;
-                            int ls = v % 65536;
+                            int x = static_cast<int>(v >> 32);
+                            int ls = static_cast<int>(v & 0xffffffff);
                             int y = ls / 256;
                             int z = ls % 256;
                             critters[x][y][z].speciesID = nextSpeciesID;
@@ -535,8 +533,8 @@ void Analyser::groupsGenealogicalTracker()
 
                 quint64 speciesSize = 0; //zero its size
 
-                quint64 samplegenome = 0;
-                QSet<quint16> cellsoc;
+                Genome samplegenome{};
+                QSet<quint64> cellsoc;
                 thisdataitem->genomicDiversity = 0;
                 quint64 sumfit = 0;
 
@@ -556,10 +554,10 @@ void Analyser::groupsGenealogicalTracker()
                 sumcol[2] = 0;
 
                 quint64 sumxpos = 0, sumypos = 0;
-                int minx = 256;
+                int minx = gridX;
                 int maxx = -1;
                 int maxy = -1;
-                int miny = 256;
+                int miny = gridY;
 
                 for (int iii = 0; iii < arrayMax; iii++) //go through static arrays -
                     //find all genome entries for this group
@@ -568,14 +566,14 @@ void Analyser::groupsGenealogicalTracker()
                     if (groupcodes[iii] == groupcode)
                     {
                         thisdataitem->genomicDiversity++;
-                        QList<quint32> *updatelist = slotswithgenome.value(speciesID)->value(genomes[iii]);
+                        QList<quint64> *updatelist = slotswithgenome.value(speciesID)->value(genomes[iii]);
                         //retrieve the list of positions for this genome
                         speciesSize += static_cast<quint64>(updatelist->count()); //add its count to size
 
-                        foreach (quint32 v, *updatelist)   //go through list and set critters data to new species
+                        foreach (quint64 v, *updatelist)   //go through list and set critters data to new species
                         {
-                            int x = v / 65536;
-                            int ls = v % 65536;
+                            int x = static_cast<int>(v >> 32);
+                            int ls = static_cast<int>(v & 0xffffffff);
                             int y = ls / 256;
                             int z = ls % 256;
 
@@ -584,10 +582,10 @@ void Analyser::groupsGenealogicalTracker()
                             if (x < minx) minx = static_cast<int>(x);
                             if (y < miny) miny = static_cast<int>(y);
                             if (x > maxx) maxx = static_cast<int>(x);
-                            if (y < maxy) maxy = static_cast<int>(y);
+                            if (y > maxy) maxy = static_cast<int>(y);
 
                             sumfit += static_cast<quint64>(critters[x][y][z].fitness);
-                            cellsoc.insert(static_cast<quint16>(x) * static_cast<quint16>(256) + static_cast<quint16>(y));
+                            cellsoc.insert((static_cast<quint64>(x) << 32) | static_cast<quint64>(y));
 
                             quint8 r = environment[x][y][0];
                             quint8 g = environment[x][y][1];
@@ -611,7 +609,7 @@ void Analyser::groupsGenealogicalTracker()
                 thisdataitem->meanFitness = static_cast<quint16>((sumfit * 1000) / speciesSize);
                 thisdataitem->sampleGenome = samplegenome;
                 thisdataitem->size = static_cast<quint32>(speciesSize);
-                thisdataitem->cellsOccupied = static_cast<quint16>(cellsoc.count());
+                thisdataitem->cellsOccupied = static_cast<quint32>(cellsoc.count());
                 thisdataitem->maxEnvironment[0] = static_cast<quint8>(maxcol[0]);
                 thisdataitem->maxEnvironment[1] = static_cast<quint8>(maxcol[1]);
                 thisdataitem->maxEnvironment[2] = static_cast<quint8>(maxcol[2]);
@@ -621,16 +619,18 @@ void Analyser::groupsGenealogicalTracker()
                 thisdataitem->meanEnvironment[0] = static_cast<quint8>(sumcol[0] / speciesSize);
                 thisdataitem->meanEnvironment[1] = static_cast<quint8>(sumcol[1] / speciesSize);
                 thisdataitem->meanEnvironment[2] = static_cast<quint8>(sumcol[2] / speciesSize);
-                thisdataitem->centroidRangeX = static_cast<quint8>(sumxpos / speciesSize);
-                thisdataitem->centroidRangeY = static_cast<quint8>(sumypos / speciesSize);
-                thisdataitem->geographicalRange = static_cast<quint8>(qMax(maxx - minx, maxy - miny));
+                thisdataitem->centroidRangeX = static_cast<quint32>(sumxpos / speciesSize);
+                thisdataitem->centroidRangeY = static_cast<quint32>(sumypos / speciesSize);
+                thisdataitem->geographicalRange = static_cast<quint32>(qMax(maxx - minx, maxy - miny));
             }
         }
 
     }
 
+#ifndef REVOSIM_CLI
     if (simulationManager->warningCount > 0)
         mainWindow->statusProgressBar(&prBar, false);
+#endif
 
     //Nearly there! Just need to put size data into correct species
     for (int f = 0; f < newSpeciesList.count(); f++)   //go through new species list
@@ -653,7 +653,7 @@ void Analyser::groupsGenealogicalTracker()
 
     //delete all data - not simple for the slotswithgenome hash of hashes, but this works!
     qDeleteAll(genomedata);
-    QHashIterator<quint64, QHash<quint64, QList<quint32>* > *> iter(slotswithgenome);
+    QHashIterator<quint64, QHash<Genome, QList<quint64>* > *> iter(slotswithgenome);
     while (iter.hasNext())
     {
         iter.next();
@@ -703,7 +703,7 @@ void Analyser::groupsWithHistoryModal()
     //t.start();
 
     //We start with two QLlists
-    // genomeList - list of quint64 genomes
+    // genomeList - list of genomes
     // genomeCount - list of ints, the number of occurences of each
     // genomesTotalCount is the sum of values in genomeCount
 
@@ -748,31 +748,24 @@ void Analyser::groupsWithHistoryModal()
         //If they are close enough, mark them down as species N (will include self),
         //or if they are already assigned to a species, note somewhere that those two species are equivalent
         int thisSpeciesSize = 0;
-        quint64 mygenome = genomeList[largestIndex];
+        Genome mygenome = genomeList[largestIndex];
         for (int i = 0; i < genome_list_count; i++)
         {
-            quint64 g1x = mygenome ^ genomeList[i]; //XOR the two to compare
-            auto g1xl = static_cast<quint32>(g1x & (static_cast<quint64>(65536) * static_cast<quint64>(65536) - static_cast<quint64>(1))); //lower 32 bits
-            int t1 = static_cast<int>(bitCounts[g1xl / static_cast<quint32>(65536)] +  bitCounts[g1xl & static_cast<quint32>(65535)]);
+            int t1 = FitnessKernel::genomeDifference(mygenome, genomeList[i]); //XOR the two to compare, count all words
             if (t1 <= maxDifference)
             {
-                auto g1xu = quint32(g1x / (static_cast<quint64>(65536) * static_cast<quint64>(65536))); //upper 32 bits
-                t1 += bitCounts[g1xu / static_cast<quint32>(65536)] +  bitCounts[g1xu & static_cast<quint32>(65535)];
-                if (t1 <= maxDifference)
+                if (speciesID[i] > 0)   //already in a species, mark to merge- summing the number of genome occurences creating the link
                 {
-                    if (speciesID[i] > 0)   //already in a species, mark to merge- summing the number of genome occurences creating the link
-                    {
-                        int key = speciesID[i];
-                        int sum = genomeCount[i];
-                        if (merge_species.contains(key))
-                            sum += merge_species[key];
-                        merge_species.insert(speciesID[i], sum);
-                    }
-                    else
-                    {
-                        thisSpeciesSize += genomeCount[i]; // keep track of occurences
-                        speciesID[i] = nextID;
-                    }
+                    int key = speciesID[i];
+                    int sum = genomeCount[i];
+                    if (merge_species.contains(key))
+                        sum += merge_species[key];
+                    merge_species.insert(speciesID[i], sum);
+                }
+                else
+                {
+                    thisSpeciesSize += genomeCount[i]; // keep track of occurences
+                    speciesID[i] = nextID;
                 }
             }
         }
@@ -876,11 +869,7 @@ void Analyser::groupsWithHistoryModal()
             //look at each old species, find closest
             for (int j = 0; j < oldSpeciesListCombined.count(); j++)
             {
-                quint64 g1x = oldSpeciesListCombined[j].type ^ newSpeciesList[i].type; //XOR the two to compare
-                auto g1xl = static_cast<quint32>(g1x & (static_cast<quint64>(65536) * static_cast<quint64>(65536) - static_cast<quint64>(1))); //lower 32 bits
-                int t1 = static_cast<int>(bitCounts[g1xl / static_cast<quint32>(65536)] +  bitCounts[g1xl & static_cast<quint32>(65535)]);
-                auto g1xu = quint32(g1x / (static_cast<quint64>(65536) * static_cast<quint64>(65536))); //upper 32 bits
-                t1 += bitCounts[g1xu / static_cast<quint32>(65536)] +  bitCounts[g1xu & static_cast<quint32>(65535)];
+                int t1 = FitnessKernel::genomeDifference(oldSpeciesListCombined[j].type, newSpeciesList[i].type); //XOR the two to compare
 
                 if (t1 == bestDistance)
                 {
@@ -1002,9 +991,9 @@ void Analyser::groupsWithHistoryModal()
  * \param genome
  * \return lookupPersistentSpeciesID or -1
  */
-int Analyser::speciesIndex(quint64 genome)
+int Analyser::speciesIndex(const Genome &genome)
 {
-    QList<quint64>::iterator i = qBinaryFind(genomeList.begin(), genomeList.end(), genome);
+    QList<Genome>::iterator i = qBinaryFind(genomeList.begin(), genomeList.end(), genome);
 
     if (i == genomeList.end())
         return -1;
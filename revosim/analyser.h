@@ -18,6 +18,7 @@
 #ifndef ANALYSER_H
 #define ANALYSER_H
 
+#include "genome.h"
 #include "sortablegenome.h"
 #include "logspecies.h"
 
@@ -38,7 +39,7 @@ public:
     int size;
     int originTime;
     LogSpecies *logSpeciesStructure;
-    quint64 type;
+    Genome type;
     quint64 ID;
     quint64 parent;
 };
@@ -51,12 +52,12 @@ class Analyser
 public:
     Analyser();
 
-    void addGenomeFast(quint64 genome);
+    void addGenomeFast(const Genome &genome);
     void groupsWithHistoryModal();
     void groupsGenealogicalTracker();
-    int speciesIndex(quint64 genome);
+    int speciesIndex(const Genome &genome);
 
-    QList<quint64> genomeList;
+    QList<Genome> genomeList;
     QList<int> genomeCount;
     QList<int> speciesID;
     QList<int> lookupPersistentSpeciesID;
@@ -17,15 +17,17 @@
 
 #include "analysistools.h"
 #include "simmanager.h"
-#include "mainwindow.h"
 
+#ifndef REVOSIM_CLI
+#include "mainwindow.h"
 #include <QApplication>
+#endif
+
 #include <QDataStream>
 #include <QDebug>
 #include <QFile>
 #include <QList>
 #include <QMap>
-#include <QMessageBox>
 #include <QStringList>
 #include <QTextStream>
 #include <QTime>
@@ -49,6 +51,23 @@ StasisSpecies::StasisSpecies()
     end = -1;
 }
 
+/**
+ * @brief statusUpdate
+ *
+ * Show progress of the long-running tools in the status bar and keep the GUI responsive. Silent in the command line build.
+ *
+ * @param text
+ */
+static void statusUpdate(const QString &text)
+{
+#ifndef REVOSIM_CLI
+    mainWindow->setStatusBarText(text);
+    qApp->processEvents();
+#else
+    Q_UNUSED(text);
+#endif
+}
+
 /**
  * @brief AnalysisTools::AnalysisTools
  *
@@ -156,8 +175,7 @@ QString AnalysisTools::speciesRatesOfChange(const QString &filename)
                 QString outstring;
                 QTextStream out(&outstring);
                 out << "Read to iteration " << thisTime << " (" << ((thisTime * 100) / lastTime) << "%)";
-                mainWindow->setStatusBarText(outstring);
-                qApp->processEvents();
+                statusUpdate(outstring);
             }
             s = in.readLine(); //next line
         }
@@ -217,8 +235,7 @@ QString AnalysisTools::speciesRatesOfChange(const QString &filename)
                 QString outstring;
                 QTextStream out(&outstring);
                 out << "Doing cull: done " << count << " species of " << speccount;
-                mainWindow->setStatusBarText(outstring);
-                qApp->processEvents();
+                statusUpdate(outstring);
             }
         }
 
@@ -387,8 +404,7 @@ QString AnalysisTools::speciesRatesOfChange(const QString &filename)
 
         }
 
-        mainWindow->setStatusBarText("Done");
-        qApp->processEvents();
+        statusUpdate("Done");
 
         return OutputString;
     }
@@ -521,8 +537,7 @@ QString AnalysisTools::stasis(const QString &filename, int slotCount, float perc
                 QString outstring;
                 QTextStream out(&outstring);
                 out << "Read to iteration " << thisTime << " (" << ((thisTime * 100) / lastTime) << "%)";
-                mainWindow->setStatusBarText(outstring);
-                qApp->processEvents();
+                statusUpdate(outstring);
             }
             s = in.readLine(); //next line
         }
@@ -574,8 +589,7 @@ QString AnalysisTools::stasis(const QString &filename, int slotCount, float perc
                 QString outstring;
                 QTextStream out(&outstring);
                 out << "Doing cull: done " << count << " species of " << speccount;
-                mainWindow->setStatusBarText(outstring);
-                qApp->processEvents();
+                statusUpdate(outstring);
             }
         }
 
@@ -670,8 +684,7 @@ QString AnalysisTools::stasis(const QString &filename, int slotCount, float perc
                 QString outstring;
                 QTextStream out(&outstring);
                 out << "Second pass " << ii << " (out of " << stasis_species_list.count() << ")";
-                mainWindow->setStatusBarText(outstring);
-                qApp->processEvents();
+                statusUpdate(outstring);
             }
 
             StasisSpecies *this_species = stasis_species_list[ii];
@@ -754,8 +767,7 @@ QString AnalysisTools::stasis(const QString &filename, int slotCount, float perc
         out << endl << endl;
         out << "Of " << countall << " post-cull species, showing " << countshown << ", removed " << (countall - countshown) << " of which " << nan_cull << " were divide by zero errors - data too gappy";
 
-        mainWindow->setStatusBarText("Done");
-        qApp->processEvents();
+        statusUpdate("Done");
 
         qDeleteAll(stasis_species_list);
         return OutputString;
@@ -862,8 +874,7 @@ QString AnalysisTools::extinctOrigin(const QString &filename)
                 QString outstring;
                 QTextStream out(&outstring);
                 out << "Read to iteration " << thisTime << " (" << ((thisTime * 100) / static_cast<quint64>(lastTime)) << "%)";
-                mainWindow->setStatusBarText(outstring);
-                qApp->processEvents();
+                statusUpdate(outstring);
             }
             s = in.readLine(); //next line
         }
@@ -1027,8 +1038,7 @@ QString AnalysisTools::generateTree(const QString &filename)
                 QString outstring;
                 QTextStream out(&outstring);
                 out << "Read to iteration " << thisTime << " (" << ((thisTime * 100) / lastTimeFromFile) << "%)";
-                mainWindow->setStatusBarText(outstring);
-                qApp->processEvents();
+                statusUpdate(outstring);
             }
             s = in.readLine(); //next line
         }
@@ -1085,8 +1095,7 @@ QString AnalysisTools::generateTree(const QString &filename)
                 QString outstring;
                 QTextStream out(&outstring);
                 out << "Doing cull: done " << count << " species of " << speccount;
-                mainWindow->setStatusBarText(outstring);
-                qApp->processEvents();
+                statusUpdate(outstring);
             }
         }
 
@@ -1112,8 +1121,7 @@ QString AnalysisTools::generateTree(const QString &filename)
         //now do my reordering magic - magicList ends up as a list of species ids in culled list, but in a sensible order for tree output
         QList<quint64> magicList;
 
-        mainWindow->setStatusBarText("Starting list reordering");
-        qApp->processEvents();
+        statusUpdate("Starting list reordering");
 
         makeListRecursive(&magicList, &speciesList, 1, 0); //Recursively sorts culled speciesList into magicList. args are list pointer, id
 
@@ -1122,8 +1130,7 @@ QString AnalysisTools::generateTree(const QString &filename)
         out << endl << "Tree" << endl;
         out << endl << "=============================================================" << endl;
 
-        mainWindow->setStatusBarText("Calculating Tree");
-        qApp->processEvents();
+        statusUpdate("Calculating Tree");
 
         /*
            grid for output - holds output codes for each point in grid, which is SCALE wide and speciesList.count()*2 high (includes blank lines, one per species).
@@ -1201,8 +1208,7 @@ QString AnalysisTools::generateTree(const QString &filename)
             } else out << endl;
         }
 
-        mainWindow->setStatusBarText("Done tree");
-        qApp->processEvents();
+        statusUpdate("Done tree");
 
         //Finally output genomes of all extant taxa - for cladistic comparison originally
         out << endl << "=============================================================" << endl;
@@ -1313,17 +1319,14 @@ QString AnalysisTools::countPeaks(int r, int g, int b)
 
     //quint64 max = 1000000;
     for (quint64 genome = 0; genome < max; genome++) {
-        Critter c;
-        c.initialise(static_cast<quint32>(genome), environment, 0, 0, 0, 0);
-        fits[c.fitness]++;
+        fits[Critter::calculateFitness(genomeFromWord(static_cast<quint32>(genome)), environment)]++;
 
         if (!(genome % 6553600)) {
             QString s2;
             QTextStream out2(&s2);
             out2 << static_cast<double>(genome)*static_cast<double>(100) / static_cast<double>(max) << "% done...";
 
-            mainWindow->setStatusBarText(s2);
-            qApp->processEvents();
+            statusUpdate(s2);
             /*for (int i=0; i<=settleTolerance; i++)
             {
                 QString s2;
@@ -1390,10 +1393,10 @@ QString AnalysisTools::writeData(LogSpecies *root, quint64 minSpeciesSizeLocal,
     quint64 sampleGenome;
     quint32 size; //number of critters
     quint32 genomicDiversity; //number of genomes
-    quint16 cellsOccupied; //number of cells found in - 1 (as real range is 1-65536, to fit in 0-65535)
-    quint8 geographicalRange; //max distance between outliers
-    quint8 centroidRangeX; //mean of x positions
-    quint8 centroidRangeY; //mean of y positions
+    quint32 cellsOccupied; //number of cells found in
+    quint32 geographicalRange; //max distance between outliers
+    quint32 centroidRangeX; //mean of x positions
+    quint32 centroidRangeY; //mean of y positions
     quint16 meanFitness; //mean of all critter fitnesses, stored as x1000
     quint8 minEnvironment[3]; //min red, green, blue found in
     quint8 maxEnvironment[3]; //max red, green, blue found in
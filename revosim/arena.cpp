@@ -0,0 +1,187 @@
+/**
+ * @file
+ * Arena
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#include "arena.h"
+
+#include <QDebug>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Arena::Arena
+ */
+Arena::Arena()
+{
+    base = nullptr;
+    capacity = 0;
+    used = 0;
+}
+
+/**
+ * @brief Arena::~Arena
+ */
+Arena::~Arena()
+{
+    release();
+}
+
+/**
+ * @brief Arena::alignedSize
+ * @param bytes
+ * @return bytes rounded up to a whole number of cache lines
+ */
+size_t Arena::alignedSize(size_t bytes)
+{
+    return (bytes + ARENA_ALIGNMENT - 1) & ~static_cast<size_t>(ARENA_ALIGNMENT - 1);
+}
+
+/**
+ * @brief Arena::allocate
+ * @param bytes
+ * @param hugePages
+ * @return true on success
+ */
+bool Arena::allocate(size_t bytes, bool hugePages)
+{
+    release();
+    if (bytes == 0) return true;
+
+    bytes = alignedSize(bytes);
+
+#ifdef Q_OS_WIN
+    Q_UNUSED(hugePages)
+    //Large pages on Windows need a user privilege most accounts don't have, so stick with normal pages. Committed
+    //pages only get physical memory when touched, but are all charged to the commit limit now - committing tile by
+    //tile would mean catching access violations in the simulation loops.
+    void *block = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!block) {
+        qWarning() << "Unable to allocate" << bytes << "bytes for simulation";
+        return false;
+    }
+#else
+    void *block = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) {
+        qWarning() << "Unable to allocate" << bytes << "bytes for simulation";
+        return false;
+    }
+#ifdef MADV_HUGEPAGE
+    if (hugePages) madvise(block, bytes, MADV_HUGEPAGE);
+#else
+    Q_UNUSED(hugePages)
+#endif
+#endif
+
+    base = static_cast<char *>(block);
+    capacity = bytes;
+    used = 0;
+    return true;
+}
+
+/**
+ * @brief Arena::release
+ */
+void Arena::release()
+{
+    if (!base) return;
+
+#ifdef Q_OS_WIN
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    munmap(base, capacity);
+#endif
+
+    base = nullptr;
+    capacity = 0;
+    used = 0;
+}
+
+/**
+ * @brief Arena::takeBytes
+ *
+ * Hand out the next block - the caller works out the total in advance with alignedSize(), so running out is a bug
+ *
+ * @param bytes
+ * @return start of block, aligned to ARENA_ALIGNMENT
+ */
+void *Arena::takeBytes(size_t bytes)
+{
+    bytes = alignedSize(bytes);
+    if (used + bytes > capacity) {
+        qFatal("Simulation arena overflow");
+        return nullptr;
+    }
+
+    void *block = base + used;
+    used += bytes;
+    return block;
+}
+
+/**
+ * @brief Arena::size
+ * @return bytes reserved
+ */
+size_t Arena::size() const
+{
+    return capacity;
+}
+
+/**
+ * @brief Arena::touchPages
+ *
+ * Write to every page that starts in [begin, end), so the calling thread is the first to touch it. With the OS's
+ * usual first touch policy, that commits the page on the calling thread's NUMA node. Only for pages nothing has
+ * been written to yet - they're zero, and stay zero. A page starting before begin is left for whoever owns it.
+ */
+void Arena::touchPages(void *begin, void *end)
+{
+    quintptr first = (reinterpret_cast<quintptr>(begin) + ARENA_PAGE_SIZE - 1) & ~static_cast<quintptr>(ARENA_PAGE_SIZE - 1);
+    quintptr last = reinterpret_cast<quintptr>(end);
+    for (quintptr page = first; page < last; page += ARENA_PAGE_SIZE)
+        *reinterpret_cast<volatile char *>(page) = 0;
+}
+
+/**
+ * @brief Arena::pageNodes
+ *
+ * Which NUMA node each page is on - Linux only (move_pages without moving anything)
+ *
+ * @param pages addresses within the pages to look up
+ * @param count
+ * @param nodes set to each page's node, or negative if it isn't committed yet (or it couldn't be found out)
+ * @return false if the OS can't tell us
+ */
+bool Arena::pageNodes(void **pages, int count, int *nodes)
+{
+    for (int i = 0; i < count; i++)
+        nodes[i] = -1;
+
+#if defined(Q_OS_LINUX) && defined(SYS_move_pages)
+    return syscall(SYS_move_pages, 0, static_cast<unsigned long>(count), pages, nullptr, nodes, 0) == 0;
+#else
+    Q_UNUSED(pages)
+    return false;
+#endif
+}
@@ -0,0 +1,67 @@
+/**
+ * @file
+ * Header: Arena
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <QtGlobal>
+
+#include <cstddef>
+
+#define ARENA_ALIGNMENT 64
+#define ARENA_PAGE_SIZE 4096 //smallest page size we'll see - touching every one of these reaches every real page
+
+/**
+ * @brief The Arena class
+ *
+ * One block of memory that the big simulation arrays are carved out of. Blocks start on a cache line boundary.
+ * Memory comes straight from the OS, so pages are zeroed and only take physical memory when first touched. On
+ * Windows the whole block is committed up front, though - it counts in full against the commit limit (RAM plus
+ * page file), so a big grid needs that much to start even if most of it is never lived in. Huge page backing can be
+ * requested on Linux, where it's a hint the kernel may ignore.
+ */
+class Arena
+{
+public:
+    Arena();
+    ~Arena();
+
+    bool allocate(size_t bytes, bool hugePages);
+    void release();
+
+    template <typename T> T *take(size_t count)
+    {
+        return static_cast<T *>(takeBytes(count * sizeof(T)));
+    }
+
+    static size_t alignedSize(size_t bytes);
+    size_t size() const;
+
+    static void touchPages(void *begin, void *end);
+    static bool pageNodes(void **pages, int count, int *nodes);
+
+private:
+    Q_DISABLE_COPY(Arena)
+
+    void *takeBytes(size_t bytes);
+
+    char *base;
+    size_t capacity;
+    size_t used;
+};
+
+#endif // ARENA_H
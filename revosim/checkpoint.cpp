@@ -0,0 +1,891 @@
+/**
+ * @file
+ * Checkpoint
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#include "checkpoint.h"
+#include "analyser.h"
+#include "globals.h"
+#include "simmanager.h"
+
+#include <QDataStream>
+#include <QtEndian>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief The CrcTable struct
+ *
+ * Lookup table for the standard (zlib, PNG) CRC-32 polynomial
+ */
+struct CrcTable {
+    quint32 entries[256];
+
+    CrcTable()
+    {
+        for (quint32 n = 0; n < 256; n++) {
+            quint32 c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+/**
+ * @brief Checkpoint::save
+ *
+ * Write the whole simulation to a file. Compression is zlib (qCompress) at its fastest level, chunk by chunk.
+ *
+ * @param fileName
+ * @param guiState saved as it is in the GUI chunk
+ * @param compress
+ * @param error set if this fails
+ * @return
+ */
+bool Checkpoint::save(const QString &fileName, const QByteArray &guiState, bool compress, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *error = QString("Can't write %1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    uchar header[CHECKPOINT_HEADER_BYTES];
+    memcpy(header, CHECKPOINT_MAGIC, 8);
+    qToLittleEndian<quint32>(FILEVERSION, header + 8);
+    qToLittleEndian<quint32>(0, header + 12);
+
+    bool ok = file.write(reinterpret_cast<const char *>(header), CHECKPOINT_HEADER_BYTES) == CHECKPOINT_HEADER_BYTES
+              && writeChunk(file, "SETT", settingsChunk(), compress)
+              && writeCritterChunks(file, compress)
+              && writeChunk(file, "ENVI", environmentChunk(), compress)
+              && writeChunk(file, "CELL", cellChunk(), compress)
+              && writeChunk(file, "MASK", maskChunk(), compress)
+              && writeChunk(file, "RAND", QByteArray(reinterpret_cast<const char *>(randoms), sizeof(randoms)), compress)
+              && writeChunk(file, "SPEC", speciesChunk(), compress)
+              && writeChunk(file, "GUI ", guiState, compress)
+              && writeChunk(file, "END ", QByteArray(), false);
+
+    if (!ok) {
+        *error = QString("Can't write %1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    file.close();
+    return true;
+}
+
+/**
+ * @brief Checkpoint::load
+ *
+ * Read a file written by save(). Every chunk is read, its checksum tested, and its contents checked against the
+ * grid it describes before anything is changed, so a truncated, corrupted or inconsistent file leaves the simulation
+ * as it was.
+ *
+ * @param fileName
+ * @param guiState set to the GUI chunk - empty if there was none
+ * @param error set if this fails
+ * @return
+ */
+bool Checkpoint::load(const QString &fileName, QByteArray *guiState, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = QString("Can't open %1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    QByteArray header = file.read(CHECKPOINT_HEADER_BYTES);
+    if (header.size() != CHECKPOINT_HEADER_BYTES || !header.startsWith(CHECKPOINT_MAGIC)) {
+        *error = QString("%1 is not an REvoSim checkpoint").arg(fileName);
+        return false;
+    }
+
+    quint32 version = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(header.constData()) + 8);
+    if (version > FILEVERSION) {
+        *error = QString("%1 was saved by a newer version of REvoSim (file version %2)").arg(fileName).arg(version);
+        return false;
+    }
+
+    QHash<QByteArray, QList<QByteArray> > chunks;
+    if (!readChunks(file, &chunks, error)) return false;
+    file.close();
+
+    //every tag but CRIT comes once
+    auto chunk = [&chunks](const char *tag) {
+        return chunks.value(tag).value(0);
+    };
+
+    if (!chunks.contains("SETT") || !chunks.contains("CRIT") || !chunks.contains("ENVI")) {
+        *error = QString("%1 is incomplete").arg(fileName);
+        return false;
+    }
+
+    //MASK holds GENOME_MASKS masks per colour, so its size gives away a file saved with a different genome width
+    if (chunks.contains("MASK") && chunk("MASK").size() != static_cast<int>(sizeof(xorMasks))) {
+        *error = QString("%1 was saved by a build with a different genome width (GENOME_BITS)").arg(fileName);
+        return false;
+    }
+
+    //Check everything against the saved grid first - nothing is changed unless the whole file is good
+    int width = 0;
+    int height = 0;
+    int slots = 0;
+    bool ok = applySettings(chunk("SETT"), false, &width, &height, &slots)
+              && applyCritters(chunks.value("CRIT"), width, height, slots, false)
+              && applyEnvironment(chunk("ENVI"), width, height, false);
+    if (ok && chunks.contains("CELL")) ok = applyCells(chunk("CELL"), width, height, false);
+    if (ok && chunks.contains("MASK")) ok = applyMasks(chunk("MASK"), false);
+    if (ok && chunks.contains("RAND")) ok = chunk("RAND").size() == static_cast<int>(sizeof(randoms));
+    if (ok && chunks.contains("SPEC")) ok = applySpecies(chunk("SPEC"), false);
+
+    if (!ok) {
+        *error = QString("%1 is damaged").arg(fileName);
+        return false;
+    }
+
+    //then apply it all - these can't fail now
+    applySettings(chunk("SETT"), true, &width, &height, &slots);
+    simulationManager->allocateArrays();
+    applyCritters(chunks.value("CRIT"), gridX, gridY, slotsPerSquare, true);
+    applyEnvironment(chunk("ENVI"), gridX, gridY, true);
+    if (chunks.contains("CELL")) applyCells(chunk("CELL"), gridX, gridY, true);
+    if (chunks.contains("MASK")) applyMasks(chunk("MASK"), true);
+    if (chunks.contains("RAND")) memcpy(randoms, chunk("RAND").constData(), sizeof(randoms));
+    if (chunks.contains("SPEC")) applySpecies(chunk("SPEC"), true);
+
+    //environment and masks replaced - work out every square's fitness afresh
+    simulationManager->invalidateEnvironment();
+    simulationManager->rebuildOccupancy();
+
+    *guiState = chunk("GUI ");
+    return true;
+}
+
+/**
+ * @brief Checkpoint::isCheckpoint
+ * @param fileName
+ * @return true if the file starts with the checkpoint magic - false for FILEVERSION 1 files
+ */
+bool Checkpoint::isCheckpoint(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    return file.read(8) == CHECKPOINT_MAGIC;
+}
+
+/**
+ * @brief Checkpoint::crc32
+ * @param data
+ * @param length
+ * @param crc previous value, to carry on from
+ * @return CRC-32 as per zlib
+ */
+quint32 Checkpoint::crc32(const char *data, qint64 length, quint32 crc)
+{
+    static const CrcTable table;
+
+    crc = ~crc;
+    const auto *bytes = reinterpret_cast<const uchar *>(data);
+    for (qint64 i = 0; i < length; i++)
+        crc = table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/**
+ * @brief Checkpoint::writeChunk
+ * @param file
+ * @param tag four characters
+ * @param payload
+ * @param compress try qCompress - kept only if it makes the chunk smaller
+ * @return false on a write error
+ */
+bool Checkpoint::writeChunk(QFile &file, const char *tag, const QByteArray &payload, bool compress)
+{
+    quint32 flags = 0;
+    QByteArray stored = payload;
+    if (compress && !payload.isEmpty()) {
+        QByteArray compressed = qCompress(payload, 1);
+        if (compressed.size() < payload.size()) {
+            stored = compressed;
+            flags |= CHECKPOINT_CHUNK_ZLIB;
+        }
+    }
+
+    uchar header[CHECKPOINT_CHUNK_HEADER_BYTES];
+    memcpy(header, tag, 4);
+    qToLittleEndian<quint32>(flags, header + 4);
+    qToLittleEndian<quint64>(static_cast<quint64>(stored.size()), header + 8);
+    qToLittleEndian<quint64>(static_cast<quint64>(payload.size()), header + 16);
+    qToLittleEndian<quint32>(crc32(payload.constData(), payload.size()), header + 24);
+
+    return file.write(reinterpret_cast<const char *>(header), CHECKPOINT_CHUNK_HEADER_BYTES) == CHECKPOINT_CHUNK_HEADER_BYTES
+           && file.write(stored) == stored.size();
+}
+
+/**
+ * @brief Checkpoint::readChunks
+ *
+ * Read, unpack and check every chunk up to the END chunk
+ *
+ * @param file positioned after the file header
+ * @param chunks set to the payloads by tag, in file order
+ * @param error set if this fails
+ * @return
+ */
+bool Checkpoint::readChunks(QFile &file, QHash<QByteArray, QList<QByteArray> > *chunks, QString *error)
+{
+    while (true) {
+        QByteArray chunkHeader = file.read(CHECKPOINT_CHUNK_HEADER_BYTES);
+        if (chunkHeader.size() != CHECKPOINT_CHUNK_HEADER_BYTES) {
+            *error = QString("%1 is incomplete").arg(file.fileName());
+            return false;
+        }
+
+        const auto *header = reinterpret_cast<const uchar *>(chunkHeader.constData());
+        QByteArray tag = chunkHeader.left(4);
+        quint32 flags = qFromLittleEndian<quint32>(header + 4);
+        quint64 storedSize = qFromLittleEndian<quint64>(header + 8);
+        quint64 size = qFromLittleEndian<quint64>(header + 16);
+        quint32 crc = qFromLittleEndian<quint32>(header + 24);
+
+        if (tag == "END ") return true;
+
+        if (storedSize > static_cast<quint64>(file.size() - file.pos()) || size > 0x7FFFFFFFu) {
+            *error = QString("%1 is damaged").arg(file.fileName());
+            return false;
+        }
+
+        QByteArray payload = file.read(static_cast<qint64>(storedSize));
+        if (flags & CHECKPOINT_CHUNK_ZLIB)
+            payload = qUncompress(payload);
+
+        if (static_cast<quint64>(payload.size()) != size || crc32(payload.constData(), payload.size()) != crc) {
+            *error = QString("%1 is damaged (%2 chunk fails its checksum)").arg(file.fileName(), QString::fromLatin1(tag.constData(), tag.size()));
+            return false;
+        }
+
+        (*chunks)[tag].append(payload);
+    }
+}
+
+/**
+ * @brief Checkpoint::settingsChunk
+ * @return
+ */
+QByteArray Checkpoint::settingsChunk()
+{
+    QByteArray chunk;
+    QDataStream out(&chunk, QIODevice::WriteOnly);
+
+    out << gridX << gridY << slotsPerSquare << settleTolerance << startAge << dispersal << food << breedCost
+        << mutate << maxDifference << breedThreshold << target << environmentChangeRate << environmentMode
+        << speciesSamples << speciesSensitivity << timeSliceConnect << minSpeciesSize << speciesMode;
+
+    out << recalculateFitness << toroidal << nonspatial << breedDifference << breedSpecies
+        << allowExcludeWithDescendants << sexual << asexual << logging << gui << environmentInterpolate
+        << fitnessLoggingToFile << speciesLogging << speciesLoggingToFile << reseedKnown << reseedDual << reseedGenome;
+
+    //where the run is up to
+    out << iteration << lastReport << randomSeed << runSeed << nextRandom;
+    out << environmentFiles << currentEnvironmentFile << environmentChangeCounter << nextEnvironmentChange
+        << environmentChangeForward;
+
+    return chunk;
+}
+
+/**
+ * @brief readSettings
+ *
+ * Read each setting in turn into a value of its own type, and only set it if applying
+ */
+static void readSettings(QDataStream &, bool)
+{
+}
+
+template <typename T, typename... Rest> static void readSettings(QDataStream &in, bool apply, T &setting, Rest &... rest)
+{
+    T value{};
+    in >> value;
+    if (apply) setting = value;
+    readSettings(in, apply, rest...);
+}
+
+/**
+ * @brief Checkpoint::applySettings
+ * @param chunk
+ * @param apply false just checks the chunk, changing nothing
+ * @param width set to the saved grid size, for checking the other chunks against
+ * @param height
+ * @param slots
+ * @return false if the chunk is damaged, or the grid is too big for this build
+ */
+bool Checkpoint::applySettings(const QByteArray &chunk, bool apply, int *width, int *height, int *slots)
+{
+    QDataStream in(chunk);
+
+    in >> *width >> *height >> *slots;
+    if (*width < 1 || *width > GRID_X || *height < 1 || *height > GRID_Y || *slots < 1
+            || *slots > SLOTS_PER_GRID_SQUARE)
+        return false;
+    if (apply) {
+        gridX = *width;
+        gridY = *height;
+        slotsPerSquare = *slots;
+    }
+
+    readSettings(in, apply, settleTolerance, startAge, dispersal, food, breedCost, mutate, maxDifference,
+                 breedThreshold, target, environmentChangeRate, environmentMode, speciesSamples,
+                 speciesSensitivity, timeSliceConnect, minSpeciesSize, speciesMode);
+
+    readSettings(in, apply, recalculateFitness, toroidal, nonspatial, breedDifference, breedSpecies,
+                 allowExcludeWithDescendants, sexual, asexual, logging, gui, environmentInterpolate,
+                 fitnessLoggingToFile, speciesLogging, speciesLoggingToFile, reseedKnown, reseedDual, reseedGenome);
+
+    readSettings(in, apply, iteration, lastReport, randomSeed, runSeed, nextRandom);
+    readSettings(in, apply, environmentFiles, currentEnvironmentFile, environmentChangeCounter, nextEnvironmentChange,
+                 environmentChangeForward);
+
+    return in.status() == QDataStream::Ok;
+}
+
+/**
+ * @brief Checkpoint::writeCritterChunks
+ *
+ * For each square, a quint16 count of living critters, then for each one its slot (quint16), age (quint16),
+ * fitness (quint8), energy (qint32), genome (GENOME_WORDS quint64s) and species ID (quint64) - CHECKPOINT_CRITTER_BYTES.
+ * Written as a CRIT chunk every CHECKPOINT_PIECE_BYTES or so, so a big grid is never held in memory all at once.
+ *
+ * @param file
+ * @param compress
+ * @return false on a write error
+ */
+bool Checkpoint::writeCritterChunks(QFile &file, bool compress)
+{
+    //the most one square can add
+    const int squareBytes = 2 + slotsPerSquare * CHECKPOINT_CRITTER_BYTES;
+
+    QByteArray chunk;
+    const qint64 estimate = static_cast<qint64>(gridX) * gridY * 2
+                            + static_cast<qint64>(simulationManager->stats.alive) * CHECKPOINT_CRITTER_BYTES;
+    chunk.reserve(static_cast<int>(qMin<qint64>(estimate, CHECKPOINT_PIECE_BYTES)));
+
+    uchar record[CHECKPOINT_CRITTER_BYTES];
+    for (int n = 0; n < gridX; n++)
+        for (int m = 0; m < gridY; m++) {
+            if (chunk.size() > CHECKPOINT_PIECE_BYTES - squareBytes) {
+                if (!writeChunk(file, "CRIT", chunk, compress)) return false;
+                chunk.resize(0);
+            }
+
+            int countAt = chunk.size();
+            chunk.append("\0\0", 2);
+
+            quint16 count = 0;
+            for (int c = 0; c <= maxUsed[n][m]; c++) {
+                int index = critterIndex(n, m, c);
+                if (critterAge[index] == 0) continue;
+
+                qToLittleEndian<quint16>(static_cast<quint16>(c), record);
+                qToLittleEndian<quint16>(critterAge[index], record + 2);
+                record[4] = critterFitness[index];
+                qToLittleEndian<qint32>(critterEnergy[index], record + 5);
+                for (int w = 0; w < GENOME_WORDS; w++)
+                    qToLittleEndian<quint64>(genomeWord(critterGenome[index], w), record + 9 + w * 8);
+                qToLittleEndian<quint64>(critterSpeciesID[index], record + 9 + GENOME_WORDS * 8);
+                chunk.append(reinterpret_cast<const char *>(record), CHECKPOINT_CRITTER_BYTES);
+                count++;
+            }
+
+            qToLittleEndian<quint16>(count, reinterpret_cast<uchar *>(chunk.data()) + countAt);
+        }
+
+    return writeChunk(file, "CRIT", chunk, compress);
+}
+
+/**
+ * @brief Checkpoint::applyCritters
+ * @param chunks the CRIT chunks, in file order
+ * @param width grid the chunks should be for
+ * @param height
+ * @param slots
+ * @param apply false just checks the chunk, changing nothing
+ * @return false if the chunk doesn't match the grid
+ */
+bool Checkpoint::applyCritters(const QList<QByteArray> &chunks, int width, int height, int slots, bool apply)
+{
+    //only slots up to maxUsed can be alive - clearing just those leaves tiles nothing has lived in untouched
+    if (apply)
+        for (int n = 0; n < width; n++)
+            for (int m = 0; m < height; m++)
+                if (maxUsed[n][m] >= 0) {
+                    memset(critterAge + critterIndex(n, m, 0), 0, static_cast<size_t>(maxUsed[n][m] + 1) * sizeof(quint16));
+                    maxUsed[n][m] = -1;
+                }
+
+    int piece = 0;
+    const uchar *data = nullptr;
+    const uchar *end = nullptr;
+    for (int n = 0; n < width; n++)
+        for (int m = 0; m < height; m++) {
+            //squares aren't split between chunks, so move on to the next one only at the end of a square
+            while (data == end && piece < chunks.count()) {
+                data = reinterpret_cast<const uchar *>(chunks[piece].constData());
+                end = data + chunks[piece].size();
+                piece++;
+            }
+            if (end - data < 2) return false;
+            int count = qFromLittleEndian<quint16>(data);
+            data += 2;
+            if (end - data < static_cast<qint64>(count) * CHECKPOINT_CRITTER_BYTES) return false;
+
+            for (int i = 0; i < count; i++, data += CHECKPOINT_CRITTER_BYTES) {
+                int slot = qFromLittleEndian<quint16>(data);
+                if (slot >= slots) return false;
+                if (!apply) continue;
+
+                int index = critterIndex(n, m, slot);
+                if (slot > maxUsed[n][m]) maxUsed[n][m] = slot; //rebuildOccupancy() looks no further
+                critterAge[index] = qFromLittleEndian<quint16>(data + 2);
+                critterFitness[index] = data[4];
+                critterEnergy[index] = qFromLittleEndian<qint32>(data + 5);
+                for (int w = 0; w < GENOME_WORDS; w++)
+                    genomeWord(critterGenome[index], w) = qFromLittleEndian<quint64>(data + 9 + w * 8);
+                critterSpeciesID[index] = qFromLittleEndian<quint64>(data + 9 + GENOME_WORDS * 8);
+            }
+        }
+
+    return data == end && piece == chunks.count();
+}
+
+/**
+ * @brief Checkpoint::environmentChunk
+ * @return environment, environmentLast and environmentNext, one after the other
+ */
+QByteArray Checkpoint::environmentChunk()
+{
+    const int columnBytes = gridY * 3;
+    QByteArray chunk(3 * gridX * columnBytes, 0);
+    char *out = chunk.data();
+
+    for (const auto &planes : {environment, environmentLast, environmentNext})
+        for (int n = 0; n < gridX; n++, out += columnBytes)
+            memcpy(out, planes[n], static_cast<size_t>(columnBytes));
+
+    return chunk;
+}
+
+/**
+ * @brief Checkpoint::applyEnvironment
+ * @param chunk
+ * @param width grid the chunk should be for
+ * @param height
+ * @param apply false just checks the chunk, changing nothing
+ * @return false if the chunk doesn't match the grid
+ */
+bool Checkpoint::applyEnvironment(const QByteArray &chunk, int width, int height, bool apply)
+{
+    const int columnBytes = height * 3;
+    if (chunk.size() != 3 * width * columnBytes) return false;
+    if (!apply) return true;
+    const char *in = chunk.constData();
+
+    for (const auto &planes : {environment, environmentLast, environmentNext})
+        for (int n = 0; n < width; n++, in += columnBytes)
+            memcpy(planes[n], in, static_cast<size_t>(columnBytes));
+
+    return true;
+}
+
+/**
+ * @brief Checkpoint::cellChunk
+ * @return for each square, totalFitness, breedAttempts, breedFails, settles and settleFails as quint32s
+ */
+QByteArray Checkpoint::cellChunk()
+{
+    QByteArray chunk(gridX * gridY * 5 * 4, 0);
+    auto *out = reinterpret_cast<uchar *>(chunk.data());
+
+    for (int n = 0; n < gridX; n++)
+        for (int m = 0; m < gridY; m++, out += 5 * 4) {
+            qToLittleEndian<quint32>(totalFitness[n][m], out);
+            qToLittleEndian<qint32>(breedAttempts[n][m], out + 4);
+            qToLittleEndian<qint32>(breedFails[n][m], out + 8);
+            qToLittleEndian<qint32>(settles[n][m], out + 12);
+            qToLittleEndian<qint32>(settleFails[n][m], out + 16);
+        }
+
+    return chunk;
+}
+
+/**
+ * @brief Checkpoint::applyCells
+ * @param chunk
+ * @param width grid the chunk should be for
+ * @param height
+ * @param apply false just checks the chunk, changing nothing
+ * @return false if the chunk doesn't match the grid
+ */
+bool Checkpoint::applyCells(const QByteArray &chunk, int width, int height, bool apply)
+{
+    if (chunk.size() != width * height * 5 * 4) return false;
+    if (!apply) return true;
+    const auto *in = reinterpret_cast<const uchar *>(chunk.constData());
+
+    for (int n = 0; n < width; n++)
+        for (int m = 0; m < height; m++, in += 5 * 4) {
+            totalFitness[n][m] = qFromLittleEndian<quint32>(in);
+            breedAttempts[n][m] = qFromLittleEndian<qint32>(in + 4);
+            breedFails[n][m] = qFromLittleEndian<qint32>(in + 8);
+            settles[n][m] = qFromLittleEndian<qint32>(in + 12);
+            settleFails[n][m] = qFromLittleEndian<qint32>(in + 16);
+        }
+
+    return true;
+}
+
+/**
+ * @brief Checkpoint::maskChunk
+ * @return
+ */
+QByteArray Checkpoint::maskChunk()
+{
+    QByteArray chunk(static_cast<int>(sizeof(xorMasks)), 0);
+    auto *out = reinterpret_cast<uchar *>(chunk.data());
+
+    for (auto &xormask : xorMasks)
+        for (quint32 mask : xormask) {
+            qToLittleEndian<quint32>(mask, out);
+            out += 4;
+        }
+
+    return chunk;
+}
+
+/**
+ * @brief Checkpoint::applyMasks
+ * @param chunk
+ * @param apply false just checks the chunk, changing nothing
+ * @return
+ */
+bool Checkpoint::applyMasks(const QByteArray &chunk, bool apply)
+{
+    if (chunk.size() != static_cast<int>(sizeof(xorMasks))) return false;
+    if (!apply) return true;
+    const auto *in = reinterpret_cast<const uchar *>(chunk.constData());
+
+    for (auto &xormask : xorMasks)
+        for (quint32 &mask : xormask) {
+            mask = qFromLittleEndian<quint32>(in);
+            in += 4;
+        }
+
+    return true;
+}
+
+/**
+ * @brief writeSpecies
+ */
+static void writeSpecies(QDataStream &out, const QList<Species> &speciesList)
+{
+    out << speciesList.count();
+    for (const Species &species : speciesList)
+        out << species.ID << species.type << species.originTime << species.parent << species.size << species.internalID;
+}
+
+/**
+ * @brief readSpecies
+ */
+static void readSpecies(QDataStream &in, QList<Species> *speciesList)
+{
+    int count;
+    in >> count;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        Species species;
+        in >> species.ID >> species.type >> species.originTime >> species.parent >> species.size >> species.internalID;
+        speciesList->append(species);
+    }
+}
+
+/**
+ * @brief Checkpoint::speciesChunk
+ * @return
+ */
+QByteArray Checkpoint::speciesChunk()
+{
+    QByteArray chunk;
+    QDataStream out(&chunk, QIODevice::WriteOnly);
+
+    writeSpecies(out, oldSpeciesList);
+    out << archivedSpeciesLists.count();
+    for (const QList<Species> &speciesList : archivedSpeciesLists)
+        writeSpecies(out, speciesList);
+    out << nextSpeciesID << lastSpeciesCalculated;
+
+    return chunk;
+}
+
+/**
+ * @brief Checkpoint::applySpecies
+ * @param chunk
+ * @param apply false just checks the chunk, changing nothing
+ * @return
+ */
+bool Checkpoint::applySpecies(const QByteArray &chunk, bool apply)
+{
+    QDataStream in(chunk);
+
+    QList<Species> newOldSpeciesList;
+    QList<QList<Species>> newArchivedSpeciesLists;
+    readSpecies(in, &newOldSpeciesList);
+    int count;
+    in >> count;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QList<Species> speciesList;
+        readSpecies(in, &speciesList);
+        newArchivedSpeciesLists.append(speciesList);
+    }
+    readSettings(in, apply, nextSpeciesID, lastSpeciesCalculated);
+
+    if (in.status() != QDataStream::Ok) return false;
+    if (!apply) return true;
+
+    oldSpeciesList = newOldSpeciesList;
+    archivedSpeciesLists = newArchivedSpeciesLists;
+
+    //as per FILEVERSION 1 - the analyser's state isn't saved, so make the next species pass start afresh
+    lastSpeciesCalculated--;
+
+    return true;
+}
+
+/**
+ * @brief CheckpointWriter::CheckpointWriter
+ */
+CheckpointWriter::CheckpointWriter()
+{
+    child = 0;
+    resultPipe = -1;
+    resultReady = false;
+    resultOk = false;
+}
+
+/**
+ * @brief CheckpointWriter::~CheckpointWriter
+ *
+ * Waits for any save in progress, so it isn't left half written
+ */
+CheckpointWriter::~CheckpointWriter()
+{
+    wait();
+}
+
+/**
+ * @brief CheckpointWriter::start
+ *
+ * Start saving the simulation as it stands. Settings only - the GUI chunk is left empty.
+ *
+ * @param fileName
+ * @param compress
+ * @param error set if the save could not be started, or (without fork) failed
+ * @return false if a save is already in progress, or see error
+ */
+bool CheckpointWriter::start(const QString &fileName, bool compress, QString *error)
+{
+    if (busy()) {
+        *error = "A checkpoint is already being saved";
+        return false;
+    }
+
+    savingFile = fileName;
+    saveTimer.start();
+    resultReady = false;
+
+#ifdef Q_OS_UNIX
+    int fds[2];
+    if (pipe(fds) != 0) {
+        *error = "Can't start a background checkpoint (no pipe)";
+        return false;
+    }
+
+    fflush(nullptr); //or the child would write out anything the parent has buffered
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        *error = "Can't start a background checkpoint (fork failed)";
+        return false;
+    }
+
+    if (pid == 0) {
+        //child - save, report, and leave without running any of the parent's exit code
+        close(fds[0]);
+        QString childError;
+        bool ok = saveAndReplace(fileName, compress, &childError);
+        if (!ok) {
+            QByteArray message = childError.toUtf8();
+            ssize_t written = write(fds[1], message.constData(), static_cast<size_t>(message.size()));
+            Q_UNUSED(written)
+        }
+        _exit(ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+    resultPipe = fds[0];
+    child = pid;
+    return true;
+#else
+    bool ok = saveAndReplace(fileName, compress, error);
+    finish(ok, ok ? QString() : *error);
+    return ok;
+#endif
+}
+
+/**
+ * @brief CheckpointWriter::busy
+ * @return true while a background save is running
+ */
+bool CheckpointWriter::busy() const
+{
+    return child != 0;
+}
+
+/**
+ * @brief CheckpointWriter::poll
+ *
+ * Check on the save without waiting for it
+ *
+ * @param ok set to whether the save worked
+ * @param message set to a line to report - time taken, or why it failed
+ * @return true once for each save, when it has finished
+ */
+bool CheckpointWriter::poll(bool *ok, QString *message)
+{
+#ifdef Q_OS_UNIX
+    if (child) {
+        int status = 0;
+        pid_t done = waitpid(static_cast<pid_t>(child), &status, WNOHANG);
+        if (done == 0) return false;
+        reap(done > 0, status);
+    }
+#endif
+
+    if (!resultReady) return false;
+
+    resultReady = false;
+    *ok = resultOk;
+    *message = resultMessage;
+    return true;
+}
+
+/**
+ * @brief CheckpointWriter::wait
+ *
+ * Block until any save in progress has finished - poll() then gives its result
+ */
+void CheckpointWriter::wait()
+{
+#ifdef Q_OS_UNIX
+    if (!child) return;
+
+    int status = 0;
+    pid_t done;
+    do {
+        done = waitpid(static_cast<pid_t>(child), &status, 0);
+    } while (done < 0 && errno == EINTR);
+    reap(done > 0, status);
+#endif
+}
+
+/**
+ * @brief CheckpointWriter::reap
+ *
+ * Collect the result of a background save whose process has ended
+ *
+ * @param exited false if the process could not be waited for
+ * @param status from waitpid
+ */
+void CheckpointWriter::reap(bool exited, int status)
+{
+#ifdef Q_OS_UNIX
+    QByteArray childError;
+    char buffer[256];
+    ssize_t bytes;
+    while ((bytes = read(resultPipe, buffer, sizeof(buffer))) > 0)
+        childError.append(buffer, static_cast<int>(bytes));
+    close(resultPipe);
+    resultPipe = -1;
+    child = 0;
+
+    bool saved = exited && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!saved && childError.isEmpty())
+        childError = "the saving process did not finish";
+    finish(saved, QString::fromUtf8(childError));
+#else
+    Q_UNUSED(exited)
+    Q_UNUSED(status)
+#endif
+}
+
+/**
+ * @brief CheckpointWriter::saveAndReplace
+ * @param fileName
+ * @param compress
+ * @param error
+ * @return true once the new checkpoint has replaced the old
+ */
+bool CheckpointWriter::saveAndReplace(const QString &fileName, bool compress, QString *error)
+{
+    QString partName = fileName + CHECKPOINT_PART_SUFFIX;
+    if (!Checkpoint::save(partName, QByteArray(), compress, error)) {
+        QFile::remove(partName);
+        return false;
+    }
+
+#ifdef Q_OS_WIN
+    //rename won't replace a file here
+    QFile::remove(fileName);
+#endif
+    if (std::rename(QFile::encodeName(partName).constData(), QFile::encodeName(fileName).constData()) != 0) {
+        *error = QString("Can't replace %1 with the new checkpoint").arg(fileName);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief CheckpointWriter::finish
+ * @param ok
+ * @param error
+ */
+void CheckpointWriter::finish(bool ok, const QString &error)
+{
+    resultReady = true;
+    resultOk = ok;
+    if (ok)
+        resultMessage = QString("Checkpoint saved to %1 in %2 s").arg(savingFile).arg(saveTimer.elapsed() / 1000.0, 0, 'f', 1);
+    else
+        resultMessage = QString("Checkpoint to %1 failed: %2").arg(savingFile, error);
+}
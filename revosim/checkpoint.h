@@ -0,0 +1,130 @@
+/**
+ * @file
+ * Header: Checkpoint
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "genome.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#define CHECKPOINT_MAGIC "REVOSIMC"
+#define CHECKPOINT_HEADER_BYTES 16 //magic, FILEVERSION, flags
+#define CHECKPOINT_CHUNK_HEADER_BYTES 28
+#define CHECKPOINT_CHUNK_ZLIB 1 //chunk flag - payload is qCompress'd
+
+#define CHECKPOINT_PART_SUFFIX ".part" //a checkpoint being written, until it's complete
+#define CHECKPOINT_CRITTER_BYTES (17 + 8 * GENOME_WORDS) //slot, age, fitness, energy, genome, species - see writeCritterChunks()
+#define CHECKPOINT_PIECE_BYTES (256 * 1024 * 1024) //critters are split into CRIT chunks of about this size - well inside a QByteArray
+
+/**
+ * @brief The Checkpoint class
+ *
+ * Saves and loads the whole simulation - from FILEVERSION 2 on. All values little endian. After a 16 byte header
+ * (magic "REVOSIMC", FILEVERSION, flags) the file is a series of chunks, each with a 28 byte header: four character
+ * tag, flags, stored size (quint64), unpacked size (quint64) and the CRC-32 of the unpacked payload. Chunks that
+ * don't compress are stored as they are. A reader skips tags it doesn't know, so chunks can be added without a new
+ * version. Only CRIT is ever repeated.
+ *
+ * - SETT: settings and run state (iteration, seed, environment position) as a QDataStream
+ * - CRIT: for each square in grid order, the number of living critters then each one's slot and fields - empty
+ *   slots take no space. Big grids need more than a QByteArray holds, so this is split between as many CRIT chunks
+ *   as it takes, one after another, each ending at the end of a square
+ * - ENVI: environment, environmentLast and environmentNext, each gridX columns of gridY red, green, blue squares
+ * - CELL: per square fitness totals and breed/settle counts
+ * - MASK: xorMasks - its size also tells a file saved with a different GENOME_BITS apart, which can't be loaded
+ * - RAND: randoms
+ * - SPEC: species lists as a QDataStream
+ * - GUI : whatever the GUI wants to keep (window state etc.), opaque to this class
+ * - END : last chunk, no payload
+ *
+ * FILEVERSION 1 files, the old field by field QDataStream format, are still read by MainWindow.
+ */
+class Checkpoint
+{
+public:
+    static bool save(const QString &fileName, const QByteArray &guiState, bool compress, QString *error);
+    static bool load(const QString &fileName, QByteArray *guiState, QString *error);
+    static bool isCheckpoint(const QString &fileName);
+
+    static quint32 crc32(const char *data, qint64 length, quint32 crc = 0);
+
+private:
+    static bool writeChunk(QFile &file, const char *tag, const QByteArray &payload, bool compress);
+    static bool readChunks(QFile &file, QHash<QByteArray, QList<QByteArray> > *chunks, QString *error);
+    static bool writeCritterChunks(QFile &file, bool compress);
+
+    static QByteArray settingsChunk();
+    static QByteArray environmentChunk();
+    static QByteArray cellChunk();
+    static QByteArray maskChunk();
+    static QByteArray speciesChunk();
+
+    //apply = false just checks a chunk - load() checks them all before applying any
+    static bool applySettings(const QByteArray &chunk, bool apply, int *width, int *height, int *slots);
+    static bool applyCritters(const QList<QByteArray> &chunks, int width, int height, int slots, bool apply);
+    static bool applyEnvironment(const QByteArray &chunk, int width, int height, bool apply);
+    static bool applyCells(const QByteArray &chunk, int width, int height, bool apply);
+    static bool applyMasks(const QByteArray &chunk, bool apply);
+    static bool applySpecies(const QByteArray &chunk, bool apply);
+};
+
+/**
+ * @brief The CheckpointWriter class
+ *
+ * Saves checkpoints without stopping the run, in the manner of a Redis background save. On Unix-like systems start()
+ * forks: the child has a copy-on-write snapshot of the simulation as it stood, writes it out and exits, while the
+ * parent carries on iterating. Call start() between iterations, when the worker threads are idle - only the calling
+ * thread exists in the child. Elsewhere start() saves there and then.
+ *
+ * Each save is written to a CHECKPOINT_PART_SUFFIX file that replaces the checkpoint only once complete, so a crash
+ * part way through leaves the previous checkpoint intact.
+ */
+class CheckpointWriter
+{
+public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+
+    bool start(const QString &fileName, bool compress, QString *error);
+    bool busy() const;
+    bool poll(bool *ok, QString *message);
+    void wait();
+
+private:
+    Q_DISABLE_COPY(CheckpointWriter)
+
+    static bool saveAndReplace(const QString &fileName, bool compress, QString *error);
+    void reap(bool exited, int status);
+    void finish(bool ok, const QString &error);
+
+    qint64 child; //process ID of the save in progress, 0 if none
+    int resultPipe; //child writes its error here, if any
+    QString savingFile;
+    QElapsedTimer saveTimer;
+
+    bool resultReady;
+    bool resultOk;
+    QString resultMessage;
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,261 @@
+/**
+ * @file
+ * Main: command line (headless) build
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#include "headlessrunner.h"
+#include "simmanager.h"
+#include "sweep.h"
+#include "globals.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QThread>
+
+/*!
+ * \brief main
+ * \param argc
+ * \param argv
+ * \return 0 on success, 1 on bad arguments or a failed setup, 2 if the population died out
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    QCoreApplication::setApplicationName(QString(PRODUCTNAME) + "-cli");
+    QCoreApplication::setApplicationVersion(QString(SOFTWARE_VERSION));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QString(PRODUCTNAME) + " - " + QString(PRODUCTTAG) + " (headless)");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption settingsOption(QStringList() << "s" << "settings", "Settings file, as saved from the GUI.", "file");
+    QCommandLineOption environmentOption(QStringList() << "e" << "environment",
+                                         "Environment image or stack, or directory of these used in name order. May be repeated. Defaults to the built in environment.", "path");
+    QCommandLineOption iterationsOption(QStringList() << "n" << "iterations", "Number of iterations to run (default 1000).", "count", "1000");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "Directory for log files (default current directory).", "directory", QDir::currentPath());
+    QCommandLineOption randomsOption("randoms", "File of random bytes to use in place of the built in random numbers.", "file", ":/randoms.dat");
+    QCommandLineOption quietOption(QStringList() << "q" << "quiet", "Don't print progress.");
+    QCommandLineOption seedOption("seed", "Seed for the fitness landscape, founder and breeding and settling, so a run can be repeated exactly (default: a new one each run).", "number");
+    QCommandLineOption hugePagesOption("huge-pages", "Ask the OS to back the simulation arrays with huge pages where it can.");
+    QCommandLineOption threadsOption("threads", "Number of worker threads (default: one per CPU).", "count");
+    QCommandLineOption pinThreadsOption("pin-threads", "Tie each worker thread to its own CPU.");
+    QCommandLineOption firstCpuOption("first-cpu", "With --pin-threads, pin worker threads from this CPU on (default 0).", "cpu", "0");
+    QCommandLineOption numaOption("numa", "Pin worker threads, keep each on its own strip of the grid, and put each strip's memory on its thread's NUMA node. Placement is reported at the start and end of the run.");
+    QCommandLineOption replicatesOption("replicates", "Number of replicate runs, each with its own seed and output folder (default 1).", "count", "1");
+    QCommandLineOption jobsOption("jobs", "How many replicates to run at once (default: one per CPU, up to the number of replicates).", "count");
+    QCommandLineOption sweepOption("sweep", "Run a parameter sweep, keeping its jobs, queue, outputs and summary in this folder. Run again to carry on an interrupted sweep.", "folder");
+    QCommandLineOption sweepParameterOption("sweep-parameter", "Setting to sweep, and its values, e.g. mutate=5,10,20 or food=1000:3000:500. May be repeated - every combination is run.", "name=values");
+    QCommandLineOption checkpointOption("checkpoint", "Save the simulation to this file every few minutes, without pausing the run, and at the end.", "file");
+    QCommandLineOption checkpointIntervalOption("checkpoint-interval", "Minutes between checkpoints (default 10).", "minutes", "10");
+    QCommandLineOption resumeOption("resume", "Carry on from a saved simulation or checkpoint, rather than starting afresh.", "file");
+    QCommandLineOption makeStackOption("make-stack", "Pack the environment images into a stack file, then exit without running.", "file");
+    QCommandLineOption gridLayoutOption("grid-layout", "Order of the grid squares in memory: columns, tiles, morton or auto (default: the settings file's, or auto - tiles above 256 squares a side).", "layout");
+    QCommandLineOption benchmarkLayoutsOption("benchmark-layouts", "Run the simulation once with each grid layout, printing the settle stages' time and cache/TLB misses, then exit. No logs are written.");
+    QCommandLineOption stackCompressOption("stack-compress", "With --make-stack, compress frames where that makes them smaller.");
+    parser.addOption(settingsOption);
+    parser.addOption(environmentOption);
+    parser.addOption(iterationsOption);
+    parser.addOption(outputOption);
+    parser.addOption(randomsOption);
+    parser.addOption(quietOption);
+    parser.addOption(hugePagesOption);
+    parser.addOption(seedOption);
+    parser.addOption(threadsOption);
+    parser.addOption(pinThreadsOption);
+    parser.addOption(firstCpuOption);
+    parser.addOption(numaOption);
+    parser.addOption(replicatesOption);
+    parser.addOption(jobsOption);
+    parser.addOption(sweepOption);
+    parser.addOption(sweepParameterOption);
+    parser.addOption(checkpointOption);
+    parser.addOption(checkpointIntervalOption);
+    parser.addOption(resumeOption);
+    parser.addOption(makeStackOption);
+    parser.addOption(stackCompressOption);
+    parser.addOption(gridLayoutOption);
+    parser.addOption(benchmarkLayoutsOption);
+
+    parser.process(application);
+
+    if (parser.isSet(makeStackOption))
+    {
+        if (parser.values(environmentOption).isEmpty())
+        {
+            qCritical() << "Give the images to pack with --environment";
+            return 1;
+        }
+        return HeadlessRunner::makeStack(parser.values(environmentOption), parser.value(makeStackOption), parser.isSet(stackCompressOption)) ? 0 : 1;
+    }
+
+    bool ok = false;
+    quint64 iterations = parser.value(iterationsOption).toULongLong(&ok);
+    if (!ok || iterations == 0)
+    {
+        qCritical() << "Iterations must be a positive whole number";
+        return 1;
+    }
+
+    simulationManager = new SimManager;
+
+    HeadlessRunner runner;
+    runner.quiet = parser.isSet(quietOption);
+
+    if (parser.isSet(settingsOption) && !runner.loadSettings(parser.value(settingsOption)))
+        return 1;
+
+    //Command line overrides the settings file - arrays are rebuilt to match when the run is set up
+    if (parser.isSet(hugePagesOption))
+        hugePages = true;
+
+    if (parser.isSet(seedOption))
+    {
+        randomSeed = parser.value(seedOption).toULongLong(&ok);
+        if (!ok || randomSeed == 0)
+        {
+            qCritical() << "Seed must be a positive whole number";
+            return 1;
+        }
+    }
+
+    if (parser.isSet(threadsOption))
+    {
+        threadCount = parser.value(threadsOption).toInt(&ok);
+        if (!ok || threadCount < 1)
+        {
+            qCritical() << "Threads must be a positive whole number";
+            return 1;
+        }
+    }
+
+    if (parser.isSet(pinThreadsOption))
+        pinThreads = true;
+
+    if (parser.isSet(numaOption))
+        numaPlacement = true;
+
+    if (parser.isSet(gridLayoutOption))
+    {
+        QStringList layouts = QStringList() << "auto" << "columns" << "tiles" << "morton"; //GRID_LAYOUT_ order
+        gridLayout = layouts.indexOf(parser.value(gridLayoutOption).toLower());
+        if (gridLayout < 0)
+        {
+            qCritical() << "Grid layout must be columns, tiles, morton or auto";
+            return 1;
+        }
+    }
+
+    firstCpu = parser.value(firstCpuOption).toInt(&ok);
+    if (!ok || firstCpu < 0)
+    {
+        qCritical() << "First CPU must be a whole number";
+        return 1;
+    }
+
+    int replicates = parser.value(replicatesOption).toInt(&ok);
+    if (!ok || replicates < 1)
+    {
+        qCritical() << "Replicates must be a positive whole number";
+        return 1;
+    }
+
+    int jobs = parser.isSet(sweepOption) ? QThread::idealThreadCount() : qMin(replicates, QThread::idealThreadCount());
+    if (parser.isSet(jobsOption))
+    {
+        jobs = parser.value(jobsOption).toInt(&ok);
+        if (!ok || jobs < 1)
+        {
+            qCritical() << "Jobs must be a positive whole number";
+            return 1;
+        }
+    }
+
+    if (parser.isSet(sweepOption))
+    {
+        Sweep sweep(parser.value(sweepOption));
+        if (!sweep.setUp(parser.value(settingsOption), parser.values(sweepParameterOption)))
+            return 1;
+
+        //what every job shares - each gets its own settings, output folder and CPUs
+        QStringList arguments;
+        for (const QString &path : parser.values(environmentOption))
+            arguments << "--environment" << QFileInfo(path).absoluteFilePath();
+        arguments << "--iterations" << parser.value(iterationsOption) << "--replicates" << QString::number(replicates);
+        if (parser.isSet(randomsOption))
+            arguments << "--randoms" << QFileInfo(parser.value(randomsOption)).absoluteFilePath();
+        if (parser.isSet(seedOption))
+            arguments << "--seed" << parser.value(seedOption);
+        if (parser.isSet(hugePagesOption))
+            arguments << "--huge-pages";
+        if (pinThreads)
+            arguments << "--pin-threads";
+        if (numaPlacement)
+            arguments << "--numa";
+        if (parser.isSet(gridLayoutOption))
+            arguments << "--grid-layout" << parser.value(gridLayoutOption);
+
+        int exitCode = sweep.run(jobs, arguments);
+        delete simulationManager;
+        return exitCode;
+    }
+
+    if (replicates > 1)
+    {
+        int exitCode = HeadlessRunner::runReplicates(replicates, jobs, parser.value(outputOption), parser.value(checkpointOption));
+        delete simulationManager;
+        return exitCode;
+    }
+
+    runner.loadRandoms(parser.value(randomsOption));
+
+    QStringList environment = parser.values(environmentOption);
+    if (environment.isEmpty())
+        environment.append(":/REvoSim_default_env.png");
+    if (!runner.loadEnvironment(environment))
+        return 1;
+
+    if (parser.isSet(benchmarkLayoutsOption))
+    {
+        int exitCode = runner.benchmarkLayouts(iterations);
+        delete simulationManager;
+        return exitCode;
+    }
+
+    if (!runner.setOutputPath(parser.value(outputOption)))
+        return 1;
+
+    if (parser.isSet(resumeOption) && !runner.resume(parser.value(resumeOption), parser.isSet(seedOption) ? randomSeed : 0))
+        return 1;
+
+    if (parser.isSet(checkpointOption))
+    {
+        int minutes = parser.value(checkpointIntervalOption).toInt(&ok);
+        if (!ok || minutes < 1)
+        {
+            qCritical() << "Checkpoint interval must be a positive whole number of minutes";
+            return 1;
+        }
+        runner.setCheckpoint(parser.value(checkpointOption), minutes);
+    }
+
+    int exitCode = runner.run(iterations);
+
+    delete simulationManager;
+    return exitCode;
+}
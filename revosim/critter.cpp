@@ -16,45 +16,18 @@
  */
 
 #include "critter.h"
+#include "fitnesskernel.h"
 #include "simmanager.h"
 
-/**
- * @brief Critter::Critter
- */
-Critter::Critter()
-{
-    genome = 0;
-    age = 0; //this is the tested flag for dead
-    fitness = 0;
-    energy = 0;
-    speciesID = -1; //=not assigned
-    //speciesID = std::numeric_limits<quint64>::max(); //=not assigned
-}
-
 /**
  * @brief Critter::initialise
- * @param iteration
+ * @param newGenome
  * @param environment
- * @param x
- * @param y
- * @param z
  * @param species
  */
-void Critter::initialise(quint64 iteration, quint8 *environment, int x, int y, int z, quint64 species)
+void Critter::initialise(const Genome &newGenome, const quint8 *environment, quint64 species)
 {
-    //Restart a slot - set up properly
-    genome = iteration;
-
-    age = startAge;
-    //RJG - start with 0 energy
-    energy = 0;
-    //RJG - Work out fitness
-    recalculateFitness(environment);
-
-    xPosition = x;
-    yPosition = y;
-    zPosition = z;
-    speciesID = species;
+    initialiseSlot(critterIndex(xPosition, yPosition, zPosition), newGenome, environment, species);
 }
 
 /**
@@ -64,121 +37,161 @@ void Critter::initialise(quint64 iteration, quint8 *environment, int x, int y, i
  */
 int Critter::recalculateFitness(const quint8 *environment)
 {
-    auto lowergenome = static_cast<quint32>(genome & (static_cast<quint64>(65536) * static_cast<quint64>(65536) - static_cast<quint64>(1)));
-
-    quint32 answer = lowergenome ^ xorMasks[environment[0]][0]; //apply redmask
-    quint32 a2 = answer / 65536;
-    answer &= static_cast<quint32>(65535);
-
-    //RJG - add a counter for final bitcount
-    int finalanswer = static_cast<int>(bitCounts[answer]);
-    finalanswer += bitCounts[a2];
-
-    answer = lowergenome ^ xorMasks[environment[1]][1]; //apply greenmask
-    a2 = answer / 65536;
-    answer &= static_cast<quint32>(65535);
-    finalanswer += bitCounts[answer];
-    finalanswer += bitCounts[a2];
-
-    answer = lowergenome ^ xorMasks[environment[2]][2]; //apply bluemask
-    a2 = answer / 65536;
-    answer &= static_cast<quint32>(65535);
-    finalanswer += bitCounts[answer];
-    finalanswer += bitCounts[a2];
-
-    if (finalanswer >= target + settleTolerance) {
-        fitness = 0;    // no use
-        age = 0;
-        return 0;
-    }
-    if (finalanswer <= target - settleTolerance) {
-        fitness = 0;    // no use
-        age = 0;
-        return 0;
-    }
+    fitness = static_cast<quint8>(calculateFitness(genome, environment));
+    if (!fitness) age = 0;
+    return fitness;
+}
+
+/**
+ * @brief fitnessFromDistance
+ * @param distance set bits after applying the three environment masks
+ * @return fitness - 0 is dead
+ */
+static inline int fitnessFromDistance(int distance)
+{
+    if (distance >= target + settleTolerance) return 0; // no use
+    if (distance <= target - settleTolerance) return 0; // no use
 
-    //These next two SHOULD do reverse of the abs of finalanswer (i.e 0=20, 20=0)
+    //These next two SHOULD do reverse of the abs of distance (i.e 0=20, 20=0)
     // RJG - so if settle tolerance is, say, 15, peak fitness will be 15, min will be one, zero will be dead.
-    if (finalanswer < target) fitness = settleTolerance - (target - finalanswer);
-    else fitness = settleTolerance + target - finalanswer;
+    if (distance < target) return settleTolerance - (target - distance);
+    else return settleTolerance + target - distance;
+}
 
-    return fitness;
+/**
+ * @brief Critter::calculateFitness
+ * @param genome
+ * @param environment
+ * @return fitness of genome in this environment - 0 is dead
+ */
+int Critter::calculateFitness(const Genome &genome, const quint8 *environment)
+{
+    quint32 masks[GENOME_MASKS];
+    for (int w = 0; w < GENOME_WORDS; w++)
+        for (int c = 0; c < 3; c++)
+            masks[w * 3 + c] = xorMasks[environment[c]][w * 3 + c];
+    quint8 distance;
+    FitnessKernel::bitDistances(&genome, 1, masks, &distance);
+    return fitnessFromDistance(distance);
 }
 
 /**
- * @brief Critter::iterateParallel
- * @param killCountLocal
- * @param addFood
- * @return
+ * @brief Critter::calculateFitnessBatch
+ *
+ * Fitness of a run of genomes in the same environment - e.g. all the slots in one square. Dead slots are worked out
+ * too, which is cheaper than skipping them when the kernel does several genomes at once.
+ *
+ * @param genomes
+ * @param count
+ * @param masks the square's xorMasks (see environmentMasks)
+ * @param fitness output, one per genome
  */
-bool Critter::iterateParallel(int *killCountLocal, int addFood)
+void Critter::calculateFitnessBatch(const Genome *genomes, int count, const quint32 *masks, quint8 *fitness)
 {
-    if (age) {
-        //RJG - Here is where an individual dies.
-        if ((--age) == 0) {
-            (*killCountLocal)++;
-            totalFitness[xPosition][yPosition] -= static_cast<quint32>(fitness);
-            fitness = 0;
-            if (maxUsed[xPosition][yPosition] == zPosition) {
-                for (int n = zPosition - 1; n >= 0; n--)
-                    if (critters[xPosition][yPosition][n].age > 0) {
-                        maxUsed[xPosition][yPosition] = n;
-                        goto past;
-                    }
-                maxUsed[xPosition][yPosition] = -1;
-past:
-                ;
-            }
-            return false;
-        }
-        energy +=  fitness * addFood;
-        //energy+= (fitness * food) / totalFitness[xPosition][yPosition];]
+    FitnessKernel::bitDistances(genomes, count, masks, fitness);
+    for (int c = 0; c < count; c++)
+        fitness[c] = static_cast<quint8>(fitnessFromDistance(fitness[c]));
+}
 
-        //non-slot version - try breeding if our energy is high enough
-        if (energy > (breedThreshold + breedCost)) {
-            energy -= breedCost;
-            return true;
-        }
-        return false;
+/**
+ * @brief Critter::initialiseSlot
+ *
+ * Restart a slot - set up properly. The slot is left dead (age 0) if the genome can't survive here.
+ *
+ * @param index slot index in the critter arrays
+ * @param newGenome
+ * @param environment
+ * @param species
+ * @return fitness
+ */
+int Critter::initialiseSlot(int index, const Genome &newGenome, const quint8 *environment, quint64 species)
+{
+    critterGenome[index] = newGenome;
+    critterSpeciesID[index] = species;
+    //RJG - start with 0 energy
+    critterEnergy[index] = 0;
+
+    //RJG - Work out fitness
+    int f = calculateFitness(newGenome, environment);
+    critterFitness[index] = static_cast<quint8>(f);
+    critterAge[index] = f ? static_cast<quint16>(startAge) : 0;
+    return f;
+}
 
+/**
+ * @brief crossoverGenome
+ *
+ * Random bit comb - every bit has an even chance of coming from either parent. Word 0 is combed with this critter's
+ * breeding randoms, any further words with the RANDOM_STREAM_CROSSOVER streams for its slot.
+ *
+ * @return the crossed genome
+ */
+template <int Words>
+static inline typename GenomeType<Words>::Type crossoverGenome(const typename GenomeType<Words>::Type &genome,
+                                                               const typename GenomeType<Words>::Type &partnerGenome,
+                                                               const quint32 *randomBits, int square, int slot)
+{
+    quint64 comb[Words];
+    comb[0] = static_cast<quint64>(randomBits[0]) | (static_cast<quint64>(randomBits[1]) << 32);
+    if (Words > 1) {
+        quint32 extraBits[Words * 2];
+        for (int k = 0; k < Words / 2; k++)
+            runRandoms(square, slot, RANDOM_STREAM_CROSSOVER + k, extraBits + 4 * k);
+        for (int w = 1; w < Words; w++)
+            comb[w] = static_cast<quint64>(extraBits[2 * w - 2]) | (static_cast<quint64>(extraBits[2 * w - 1]) << 32);
     }
-    return false;
+
+    typename GenomeType<Words>::Type baby;
+    for (int w = 0; w < Words; w++)
+        genomeWord(baby, w) = (genomeWord(genome, w) & ~comb[w]) | (genomeWord(partnerGenome, w) & comb[w]);
+    return baby;
+}
+
+/**
+ * @brief mutateGenome
+ *
+ * Flip one bit, chosen from the whole genome by bits 8 and up of randomBit
+ */
+template <int Words>
+static inline void mutateGenome(typename GenomeType<Words>::Type &genome, quint32 randomBit)
+{
+    int w = static_cast<int>(randomBit >> 8);
+    w &= Words * 64 - 1;
+    genomeWord(genome, w / 64) ^= tweakers64[w % 64];
 }
 
 /**
  * @brief Critter::breedWithParallel
  *
- * newGenomeCountLocal is position in genome array - arranged so can never overlap
+ * Babies are appended to the calling thread's own offspring buffer
  * returns 1 if it fails (so I can count fails)
+ * Flags says which of KERNEL_BREED_SPECIES and KERNEL_BREED_DIFFERENCE apply - the four variants are instantiated below
  *
  * @param xPosition
  * @param yPosition
- * @param partner
- * @param newGenomeCountLocal
+ * @param index slot index of this critter in the critter arrays
+ * @param partnerIndex slot index of partner
+ * @param randomBits this critter's breeding randoms for the iteration (see runRandoms) - 0 and 1 for crossover, 3 for mutation
+ * @param offspring buffer for this thread's babies
  * @return
  */
-int Critter::breedWithParallel(int xPosition, int yPosition, Critter *partner, int *newGenomeCountLocal)
+template <int Flags>
+int Critter::breedWithParallel(int xPosition, int yPosition, int index, int partnerIndex, const quint32 *randomBits, QVector<Offspring> &offspring)
 {
     bool breedsuccess1 = true; //for species restricted breeding
     bool breedsuccess2 = true; //for difference breeding
 
-    if (breedSpecies) {
-        if (partner->speciesID != speciesID)
+    const Genome &genome = critterGenome[index];
+    const Genome &partnerGenome = critterGenome[partnerIndex];
+
+    if (Flags & KERNEL_BREED_SPECIES) {
+        if (critterSpeciesID[partnerIndex] != critterSpeciesID[index])
             breedsuccess1 = false;
     }
 
-    if (breedDifference) {
-        int t1 = 0;
-        // - determine success.. use genetic similarity
-        quint64 cg1x = genome ^ partner->genome; //XOR the two to compare
-
-        //Coding half
-        auto g1xl = static_cast<quint32>(cg1x & (static_cast<quint64>(65536) * static_cast<quint64>(65536) - static_cast<quint64>(1))); //lower 32 bits
-        t1 = static_cast<int>(bitCounts[g1xl / static_cast<quint32>(65536)] +  bitCounts[g1xl & static_cast<quint32>(65535)]);
-
-        //non-Coding half
-        auto g1xu = static_cast<quint32>(cg1x / (static_cast<quint64>(65536) * static_cast<quint64>(65536))); //upper 32 bits
-        t1 += bitCounts[g1xu / static_cast<quint32>(65536)] +  bitCounts[g1xu & static_cast<quint32>(65535)];
+    if (Flags & KERNEL_BREED_DIFFERENCE) {
+        // - determine success.. use genetic similarity - XOR the two to compare, count both coding and non-coding halves
+        int t1 = FitnessKernel::genomeDifference(genome, partnerGenome);
         if (t1 > maxDifference) {
             breedsuccess2 = false;
         }
@@ -186,38 +199,32 @@ int Critter::breedWithParallel(int xPosition, int yPosition, Critter *partner, i
 
     if (breedsuccess1 && breedsuccess2) {
         //work out new genome
+        int slot = index - critterIndex(xPosition, yPosition, 0);
+        Genome g2x = crossoverGenome<GENOME_WORDS>(genome, partnerGenome, randomBits, squareNumber(xPosition, yPosition), slot);
 
-        quint64 g1x = geneX[nextGeneX++];
-        if (nextGeneX >= 65536) nextGeneX = 0;
-        quint64 g2x = ~g1x; // inverse
-
-        g2x &= genome;
-        g1x &= partner->genome;  // cross bred genome
-        g2x |= g1x;
-
-        bool local_mutate = false;
-
-        //this is technically not threadsafe, but it doesn't matter - any value for nextrand is fine
-        if ((simulationManager->random8()) < mutate)
-            local_mutate = true;
-
-        if (local_mutate) {
-            int w = simulationManager->random8();
-            w &= 63;
-            g2x ^= tweakers64[w];
-        }
+        if (static_cast<int>(randomBits[3] & 255) < mutate)
+            mutateGenome<GENOME_WORDS>(g2x, randomBits[3]);
 
         //store it all
-        newGenomes[*newGenomeCountLocal] = g2x;
-        newGenomeX[*newGenomeCountLocal] = static_cast<quint32>(xPosition);
-        newGenomeY[*newGenomeCountLocal] = static_cast<quint32>(yPosition);
-        newGenomeSpecies[*newGenomeCountLocal] = speciesID;
-        newGenomeDispersal[(*newGenomeCountLocal)++] = dispersal; //how far to disperse - low is actually far (it's a divider - max is 240, <10% are >30
+        Offspring baby;
+        baby.genome = g2x;
+        baby.speciesID = critterSpeciesID[index];
+        baby.xPosition = static_cast<quint32>(xPosition);
+        baby.yPosition = static_cast<quint32>(yPosition);
+        baby.slot = static_cast<quint32>(slot);
+        baby.dispersal = dispersal; //max is 240, <10% are >30
+        offspring.append(baby);
         return 0;
     }
     //breeders get their energy back - this is an 'abort'
     //---- RJG: Note that this refund is different to and exclusive from that in Simmanager, which refunds if no partner found.
-    energy += breedCost;
+    critterEnergy[index] += breedCost;
 
     return 1;
 }
+
+template int Critter::breedWithParallel<0>(int, int, int, int, const quint32 *, QVector<Offspring> &);
+template int Critter::breedWithParallel<KERNEL_BREED_SPECIES>(int, int, int, int, const quint32 *, QVector<Offspring> &);
+template int Critter::breedWithParallel<KERNEL_BREED_DIFFERENCE>(int, int, int, int, const quint32 *, QVector<Offspring> &);
+template int Critter::breedWithParallel<KERNEL_BREED_SPECIES | KERNEL_BREED_DIFFERENCE>(int, int, int, int, const quint32 *,
+        QVector<Offspring> &);
@@ -18,29 +18,55 @@
 #ifndef CRITTER_H
 #define CRITTER_H
 
+#include "genome.h"
+
 #include <QtGlobal>
+#include <QVector>
+
+/**
+ * @brief The Offspring struct
+ *
+ * One baby waiting to settle - everything settling needs in one record, so each one is a single cache line read.
+ */
+struct Offspring {
+    Genome genome;
+    quint64 speciesID; //inherited from the parent
+    quint32 xPosition; //square the parent was in - dispersal is from here
+    quint32 yPosition;
+    quint32 slot; //parent's slot - with the square, picks this baby's random numbers for settling
+    int dispersal; //how far to disperse - low is actually far (it's a divider)
+};
 
 /**
  * @brief The Critter class
+ *
+ * Critter data is not stored in Critter objects - each field has its own array (see simmanager.h) so that the
+ * simulation loops only stream the fields they use. A Critter is a view of one slot in those arrays, kept so that
+ * critters[x][y][z].age and the like still work outside the loops. The static functions are the per-slot kernels
+ * the loops themselves call.
  */
 class Critter
 {
 public:
-    Critter();
+    Critter(int x, int y, int z);
 
-    void initialise(quint64 iteration, quint8 *environment, int x, int y, int z, quint64 species);
-    bool iterateParallel(int *killCountLocal, int addFood);
+    void initialise(const Genome &newGenome, const quint8 *environment, quint64 species);
     int recalculateFitness(const quint8 *environment);
-    int breedWithParallel(int xPosition, int yPosition, Critter *partner, int *newGenomeCountLocal);
-
-    int xPosition{};
-    int yPosition{};
-    int zPosition{};
-    int age; //start off positive - 0 is dead - reduces each time
-    int fitness;
-    int energy; //breeding energy
-    quint64 genome;
-    quint64 speciesID; //this is inherited from parents
+
+    static int calculateFitness(const Genome &genome, const quint8 *environment);
+    static void calculateFitnessBatch(const Genome *genomes, int count, const quint32 *masks, quint8 *fitness);
+    static int initialiseSlot(int index, const Genome &newGenome, const quint8 *environment, quint64 species);
+    template <int Flags> static int breedWithParallel(int xPosition, int yPosition, int index, int partnerIndex,
+                                                      const quint32 *randomBits, QVector<Offspring> &offspring);
+
+    int xPosition;
+    int yPosition;
+    int zPosition;
+    quint16 &age; //start off positive - 0 is dead - reduces each time
+    quint8 &fitness;
+    qint32 &energy; //breeding energy
+    Genome &genome;
+    quint64 &speciesID; //this is inherited from parents
 };
 
 #endif // CRITTER_H
@@ -0,0 +1,292 @@
+/**
+ * @file
+ * Environment Cache
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#include "environmentcache.h"
+#include "simmanager.h"
+
+#include <QMutexLocker>
+
+/**
+ * @brief EnvironmentLoader::EnvironmentLoader
+ * @param environmentCache
+ */
+EnvironmentLoader::EnvironmentLoader(EnvironmentCache *environmentCache)
+{
+    cache = environmentCache;
+}
+
+/**
+ * @brief EnvironmentLoader::run
+ */
+void EnvironmentLoader::run()
+{
+    cache->loaderLoop();
+}
+
+/**
+ * @brief EnvironmentCache::EnvironmentCache
+ */
+EnvironmentCache::EnvironmentCache()
+{
+    stopping = false;
+    loader = new EnvironmentLoader(this);
+    loader->start(QThread::LowPriority);
+}
+
+/**
+ * @brief EnvironmentCache::~EnvironmentCache
+ */
+EnvironmentCache::~EnvironmentCache()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        requests.clear();
+        requestCondition.wakeAll();
+    }
+
+    loader->wait();
+    delete loader;
+
+    qDeleteAll(stacks);
+}
+
+/**
+ * @brief EnvironmentCache::frame
+ *
+ * The decoded image - from the cache if it's there, waiting for the loader if it's busy with it, otherwise decoded
+ * here and now
+ *
+ * @param fileName
+ * @param width grid size to decode for
+ * @param height
+ * @return empty if the image could not be read
+ */
+QByteArray EnvironmentCache::frame(const QString &fileName, int width, int height)
+{
+    QString key = frameKey(fileName, width, height);
+
+    {
+        QMutexLocker locker(&mutex);
+        while (decoding == key)
+            decodedCondition.wait(&mutex);
+
+        if (frames.contains(key)) {
+            touch(key);
+            return frames.value(key);
+        }
+
+        //about to do it ourselves - don't let the loader do it again
+        for (int i = requests.count() - 1; i >= 0; i--)
+            if (frameKey(requests[i].fileName, requests[i].width, requests[i].height) == key)
+                requests.removeAt(i);
+    }
+
+    QByteArray decoded = decode(fileName, width, height);
+    if (decoded.isEmpty()) return decoded;
+
+    QMutexLocker locker(&mutex);
+    insert(key, decoded);
+    return decoded;
+}
+
+/**
+ * @brief EnvironmentCache::prefetch
+ *
+ * Queue images for the loader to decode, in the order given. Replaces anything still queued from before.
+ *
+ * @param fileNames
+ * @param width
+ * @param height
+ */
+void EnvironmentCache::prefetch(const QStringList &fileNames, int width, int height)
+{
+    QMutexLocker locker(&mutex);
+    requests.clear();
+    for (const QString &fileName : fileNames) {
+        QString key = frameKey(fileName, width, height);
+        if (frames.contains(key)) {
+            //keep it from being the next to go
+            touch(key);
+            continue;
+        }
+        requests.append(Request{fileName, width, height});
+    }
+    requestCondition.wakeAll();
+}
+
+/**
+ * @brief EnvironmentCache::clear
+ *
+ * Forget every decoded image - e.g. if the files may have changed on disk. Open stacks are kept, as frames already
+ * handed out may still point into them.
+ */
+void EnvironmentCache::clear()
+{
+    QMutexLocker locker(&mutex);
+    requests.clear();
+    frames.clear();
+    recent.clear();
+}
+
+/**
+ * @brief EnvironmentCache::decode
+ *
+ * Read an image, or a frame of a stack, into the environment array layout. As when loading environments directly, an
+ * image smaller than the grid is stretched to fit, and a larger one is cropped to its top left corner.
+ *
+ * @param fileName
+ * @param width
+ * @param height
+ * @return empty if the image could not be read
+ */
+QByteArray EnvironmentCache::decode(const QString &fileName, int width, int height)
+{
+    QString stackName;
+    int index;
+    if (!EnvironmentStack::parseFrameReference(fileName, &stackName, &index))
+        return frameFromImage(QImage(fileName), width, height);
+
+    EnvironmentStack *environmentStack = stack(stackName);
+    if (!environmentStack || index >= environmentStack->frameCount()) return QByteArray();
+
+    if (environmentStack->width() >= width && environmentStack->height() >= height)
+        return environmentStack->frame(index, width, height, height);
+
+    return frameFromImage(environmentStack->frameImage(index), width, height);
+}
+
+/**
+ * @brief EnvironmentCache::frameFromImage
+ * @param image
+ * @param width
+ * @param height
+ * @return the image in the environment array layout, empty for a null image
+ */
+QByteArray EnvironmentCache::frameFromImage(QImage image, int width, int height)
+{
+    if (image.isNull()) return QByteArray();
+
+    if (image.width() < width || image.height() < height)
+        image = image.scaled(QSize(width, height), Qt::IgnoreAspectRatio);
+    image = image.convertToFormat(QImage::Format_RGB32);
+
+    QByteArray decoded(width * height * 3, 0);
+    auto *colours = reinterpret_cast<quint8 *>(decoded.data());
+    for (int j = 0; j < height; j++) {
+        const auto *line = reinterpret_cast<const QRgb *>(image.constScanLine(j));
+        for (int i = 0; i < width; i++) {
+            quint8 *colour = colours + (i * height + j) * 3;
+            colour[0] = static_cast<quint8>(qRed(line[i]));
+            colour[1] = static_cast<quint8>(qGreen(line[i]));
+            colour[2] = static_cast<quint8>(qBlue(line[i]));
+        }
+    }
+    return decoded;
+}
+
+/**
+ * @brief EnvironmentCache::loaderLoop
+ *
+ * The loader thread - decode whatever is asked for until told to stop
+ */
+void EnvironmentCache::loaderLoop()
+{
+    QMutexLocker locker(&mutex);
+
+    while (true) {
+        while (!stopping && requests.isEmpty())
+            requestCondition.wait(&mutex);
+        if (stopping) return;
+
+        Request request = requests.takeFirst();
+        QString key = frameKey(request.fileName, request.width, request.height);
+        if (frames.contains(key)) continue;
+
+        decoding = key;
+        locker.unlock();
+        QByteArray decoded = decode(request.fileName, request.width, request.height);
+        locker.relock();
+
+        //a bad file is left for frame() to report when it is actually needed
+        if (!decoded.isEmpty())
+            insert(key, decoded);
+        decoding.clear();
+        decodedCondition.wakeAll();
+    }
+}
+
+/**
+ * @brief EnvironmentCache::insert
+ *
+ * Add a frame, dropping the least recently used if the cache is full - mutex must be held
+ *
+ * @param key
+ * @param frame
+ */
+void EnvironmentCache::insert(const QString &key, const QByteArray &frame)
+{
+    frames.insert(key, frame);
+    touch(key);
+
+    while (recent.count() > ENVIRONMENT_CACHE_FRAMES)
+        frames.remove(recent.takeFirst());
+}
+
+/**
+ * @brief EnvironmentCache::touch
+ *
+ * Mark a frame as just used - mutex must be held
+ *
+ * @param key
+ */
+void EnvironmentCache::touch(const QString &key)
+{
+    recent.removeOne(key);
+    recent.append(key);
+}
+
+/**
+ * @brief EnvironmentCache::frameKey
+ * @return cache key - the same file decoded for a different grid size is a different frame
+ */
+QString EnvironmentCache::frameKey(const QString &fileName, int width, int height)
+{
+    return QString("%1|%2x%3").arg(fileName).arg(width).arg(height);
+}
+
+/**
+ * @brief EnvironmentCache::stack
+ * @param fileName
+ * @return the open stack, opening it if this is the first time it is needed - nullptr if it can't be opened
+ */
+EnvironmentStack *EnvironmentCache::stack(const QString &fileName)
+{
+    QMutexLocker locker(&stackMutex);
+
+    if (stacks.contains(fileName)) return stacks.value(fileName);
+
+    auto *environmentStack = new EnvironmentStack;
+    if (!environmentStack->open(fileName)) {
+        //try again next time, in case it is fixed
+        delete environmentStack;
+        return nullptr;
+    }
+
+    stacks.insert(fileName, environmentStack);
+    return environmentStack;
+}
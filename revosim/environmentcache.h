@@ -0,0 +1,111 @@
+/**
+ * @file
+ * Header: Environment Cache
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef ENVIRONMENTCACHE_H
+#define ENVIRONMENTCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+#include "environmentstack.h"
+
+#define ENVIRONMENT_CACHE_FRAMES 8 //decoded images kept
+#define ENVIRONMENT_PREFETCH 3 //how many environment changes ahead to decode
+
+class EnvironmentCache;
+
+/**
+ * @brief The EnvironmentLoader class
+ */
+class EnvironmentLoader : public QThread
+{
+public:
+    explicit EnvironmentLoader(EnvironmentCache *environmentCache);
+
+protected:
+    void run() override;
+
+private:
+    EnvironmentCache *cache;
+};
+
+/**
+ * @brief The EnvironmentCache class
+ *
+ * Decoded environment images, ready to copy straight into environmentLast/environmentNext. Each frame is laid out
+ * like those arrays - width columns of height squares of red, green and blue - and is implicitly shared, so handing
+ * one out costs nothing. A background thread decodes the images asked for by prefetch(), so a run doesn't stop for
+ * PNG decoding at each environment change. The least recently used frames are dropped once there are more than
+ * ENVIRONMENT_CACHE_FRAMES.
+ *
+ * Frames of an environment stack ("stack.revostack#n") are read from the mapped file instead of decoded. Stacks are
+ * opened the first time one of their frames is asked for and stay open, and mapped, until the cache is destroyed.
+ */
+class EnvironmentCache
+{
+public:
+    EnvironmentCache();
+    ~EnvironmentCache();
+
+    QByteArray frame(const QString &fileName, int width, int height);
+    void prefetch(const QStringList &fileNames, int width, int height);
+    void clear();
+
+    QByteArray decode(const QString &fileName, int width, int height);
+    static QByteArray frameFromImage(QImage image, int width, int height);
+
+private:
+    Q_DISABLE_COPY(EnvironmentCache)
+    friend class EnvironmentLoader;
+
+    /**
+     * @brief The Request struct
+     */
+    struct Request {
+        QString fileName;
+        int width;
+        int height;
+    };
+
+    void loaderLoop();
+    void insert(const QString &key, const QByteArray &frame);
+    void touch(const QString &key);
+    static QString frameKey(const QString &fileName, int width, int height);
+    EnvironmentStack *stack(const QString &fileName);
+
+    EnvironmentLoader *loader;
+    QMutex mutex; //guards everything below
+    QWaitCondition requestCondition; //loader waits here for work
+    QWaitCondition decodedCondition; //frame() waits here for the loader to finish an image
+    QHash<QString, QByteArray> frames;
+    QStringList recent; //frame keys, least recently used first
+    QList<Request> requests;
+    QString decoding; //key of the image the loader is working on
+    bool stopping;
+
+    QMutex stackMutex; //guards stacks - separate, as decoding happens outside mutex
+    QHash<QString, EnvironmentStack *> stacks;
+};
+
+#endif // ENVIRONMENTCACHE_H
@@ -0,0 +1,382 @@
+/**
+ * @file
+ * Environment Stack
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#include "environmentstack.h"
+
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <cstring>
+
+/**
+ * @brief EnvironmentStack::EnvironmentStack
+ */
+EnvironmentStack::EnvironmentStack()
+{
+    data = nullptr;
+    size = 0;
+    stackWidth = 0;
+    stackHeight = 0;
+    frames = 0;
+}
+
+/**
+ * @brief EnvironmentStack::open
+ *
+ * Map the file and check the header and index - nothing is read from the frames until they are asked for
+ *
+ * @param fileName
+ * @return false if the file is missing or not a valid stack - see errorString()
+ */
+bool EnvironmentStack::open(const QString &fileName)
+{
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = QString("Can't open %1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    size = file.size();
+    if (size < STACK_HEADER_BYTES) {
+        error = QString("%1 is not an environment stack").arg(fileName);
+        return false;
+    }
+
+    data = file.map(0, size);
+    if (!data) {
+        error = QString("Can't map %1 into memory").arg(fileName);
+        return false;
+    }
+
+    if (memcmp(data, STACK_MAGIC, 8) != 0) {
+        error = QString("%1 is not an environment stack").arg(fileName);
+        data = nullptr;
+        return false;
+    }
+
+    quint32 version = qFromLittleEndian<quint32>(data + 8);
+    stackWidth = static_cast<int>(qFromLittleEndian<quint32>(data + 12));
+    stackHeight = static_cast<int>(qFromLittleEndian<quint32>(data + 16));
+    frames = static_cast<int>(qFromLittleEndian<quint32>(data + 20));
+
+    if (version != STACK_VERSION) {
+        error = QString("%1 is a version %2 environment stack - this version of REvoSim reads version %3")
+                .arg(fileName).arg(version).arg(STACK_VERSION);
+        data = nullptr;
+        return false;
+    }
+
+    //check every frame lies inside the file, so frame() never has to
+    qint64 rawBytes = static_cast<qint64>(stackWidth) * stackHeight * 3;
+    bool valid = stackWidth > 0 && stackHeight > 0 && frames > 0
+                 && STACK_HEADER_BYTES + static_cast<qint64>(frames) * STACK_INDEX_BYTES <= size;
+    for (int i = 0; valid && i < frames; i++) {
+        const uchar *entry = data + STACK_HEADER_BYTES + i * STACK_INDEX_BYTES;
+        quint64 offset = qFromLittleEndian<quint64>(entry);
+        quint32 stored = qFromLittleEndian<quint32>(entry + 8);
+        quint32 type = qFromLittleEndian<quint32>(entry + 12);
+
+        if (offset > static_cast<quint64>(size) || stored > static_cast<quint64>(size) - offset)
+            valid = false;
+        else if (type == STACK_FRAME_RAW)
+            valid = stored == rawBytes;
+        else
+            valid = type == STACK_FRAME_ZLIB;
+    }
+
+    if (!valid) {
+        error = QString("%1 is damaged").arg(fileName);
+        data = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief EnvironmentStack::isOpen
+ * @return true if open() succeeded
+ */
+bool EnvironmentStack::isOpen() const
+{
+    return data != nullptr;
+}
+
+/**
+ * @brief EnvironmentStack::width
+ * @return
+ */
+int EnvironmentStack::width() const
+{
+    return stackWidth;
+}
+
+/**
+ * @brief EnvironmentStack::height
+ * @return
+ */
+int EnvironmentStack::height() const
+{
+    return stackHeight;
+}
+
+/**
+ * @brief EnvironmentStack::frameCount
+ * @return
+ */
+int EnvironmentStack::frameCount() const
+{
+    return frames;
+}
+
+/**
+ * @brief EnvironmentStack::errorString
+ * @return why open() failed
+ */
+QString EnvironmentStack::errorString() const
+{
+    return error;
+}
+
+/**
+ * @brief EnvironmentStack::storedFrame
+ * @param index
+ * @return the frame's planes at full stack size - raw frames point straight into the mapped file
+ */
+QByteArray EnvironmentStack::storedFrame(int index) const
+{
+    if (!data || index < 0 || index >= frames) return QByteArray();
+
+    const uchar *entry = data + STACK_HEADER_BYTES + index * STACK_INDEX_BYTES;
+    auto offset = static_cast<qint64>(qFromLittleEndian<quint64>(entry));
+    auto stored = static_cast<int>(qFromLittleEndian<quint32>(entry + 8));
+
+    if (qFromLittleEndian<quint32>(entry + 12) == STACK_FRAME_RAW)
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(data + offset), stored);
+
+    QByteArray planes = qUncompress(data + offset, stored);
+    if (planes.size() != stackWidth * stackHeight * 3) return QByteArray();
+    return planes;
+}
+
+/**
+ * @brief EnvironmentStack::frame
+ *
+ * A frame cut down to the top left gridWidth x gridHeight squares, with columnStride squares per column. The stack
+ * must be at least as big as the grid. If the stack is exactly the grid's size and the frame is stored raw, this is
+ * the mapped file itself - no copy.
+ *
+ * @param index
+ * @param gridWidth
+ * @param gridHeight
+ * @param columnStride
+ * @return empty if the frame can't be read
+ */
+QByteArray EnvironmentStack::frame(int index, int gridWidth, int gridHeight, int columnStride) const
+{
+    if (gridWidth > stackWidth || gridHeight > stackHeight) return QByteArray();
+
+    QByteArray planes = storedFrame(index);
+    if (planes.isEmpty()) return planes;
+
+    if (stackHeight == columnStride) {
+        if (gridWidth == stackWidth) return planes;
+        return planes.left(gridWidth * columnStride * 3);
+    }
+
+    QByteArray cropped(gridWidth * columnStride * 3, 0);
+    for (int i = 0; i < gridWidth; i++)
+        memcpy(cropped.data() + i * columnStride * 3, planes.constData() + i * stackHeight * 3, static_cast<size_t>(gridHeight) * 3);
+    return cropped;
+}
+
+/**
+ * @brief EnvironmentStack::frameImage
+ * @param index
+ * @return the whole frame as an image, e.g. to stretch it to a bigger grid
+ */
+QImage EnvironmentStack::frameImage(int index) const
+{
+    QByteArray planes = storedFrame(index);
+    if (planes.isEmpty()) return QImage();
+
+    QImage image(stackWidth, stackHeight, QImage::Format_RGB32);
+    const auto *colours = reinterpret_cast<const quint8 *>(planes.constData());
+    for (int j = 0; j < stackHeight; j++) {
+        auto *line = reinterpret_cast<QRgb *>(image.scanLine(j));
+        for (int i = 0; i < stackWidth; i++) {
+            const quint8 *colour = colours + (i * stackHeight + j) * 3;
+            line[i] = qRgb(colour[0], colour[1], colour[2]);
+        }
+    }
+    return image;
+}
+
+/**
+ * @brief EnvironmentStack::write
+ *
+ * Pack a list of images into a stack, in the order given. Every frame takes the size of the first image - any that
+ * differ are stretched to match.
+ *
+ * @param imageFiles
+ * @param fileName
+ * @param compress store frames with qCompress where that makes them smaller
+ * @param error set if this fails
+ * @return
+ */
+bool EnvironmentStack::write(const QStringList &imageFiles, const QString &fileName, bool compress, QString *error)
+{
+    if (imageFiles.isEmpty()) {
+        *error = "No images to pack";
+        return false;
+    }
+
+    QImage first(imageFiles[0]);
+    if (first.isNull()) {
+        *error = QString("Can't open image %1").arg(imageFiles[0]);
+        return false;
+    }
+    int width = first.width();
+    int height = first.height();
+
+    QFile out(fileName);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *error = QString("Can't write %1: %2").arg(fileName, out.errorString());
+        return false;
+    }
+
+    uchar header[STACK_HEADER_BYTES];
+    memset(header, 0, sizeof(header));
+    memcpy(header, STACK_MAGIC, 8);
+    qToLittleEndian<quint32>(STACK_VERSION, header + 8);
+    qToLittleEndian<quint32>(static_cast<quint32>(width), header + 12);
+    qToLittleEndian<quint32>(static_cast<quint32>(height), header + 16);
+    qToLittleEndian<quint32>(static_cast<quint32>(imageFiles.count()), header + 20);
+
+    //index is filled in as the frames are written
+    QByteArray index(imageFiles.count() * STACK_INDEX_BYTES, 0);
+    out.write(reinterpret_cast<const char *>(header), STACK_HEADER_BYTES);
+    out.write(index);
+
+    QByteArray planes(width * height * 3, 0);
+    for (int f = 0; f < imageFiles.count(); f++) {
+        QImage image(imageFiles[f]);
+        if (image.isNull()) {
+            *error = QString("Can't open image %1").arg(imageFiles[f]);
+            return false;
+        }
+        if (image.width() != width || image.height() != height)
+            image = image.scaled(QSize(width, height), Qt::IgnoreAspectRatio);
+        image = image.convertToFormat(QImage::Format_RGB32);
+
+        auto *colours = reinterpret_cast<quint8 *>(planes.data());
+        for (int j = 0; j < height; j++) {
+            const auto *line = reinterpret_cast<const QRgb *>(image.constScanLine(j));
+            for (int i = 0; i < width; i++) {
+                quint8 *colour = colours + (i * height + j) * 3;
+                colour[0] = static_cast<quint8>(qRed(line[i]));
+                colour[1] = static_cast<quint8>(qGreen(line[i]));
+                colour[2] = static_cast<quint8>(qBlue(line[i]));
+            }
+        }
+
+        quint32 type = STACK_FRAME_RAW;
+        QByteArray stored = planes;
+        if (compress) {
+            QByteArray compressed = qCompress(planes, 1);
+            if (compressed.size() < planes.size()) {
+                stored = compressed;
+                type = STACK_FRAME_ZLIB;
+            }
+        }
+
+        //pad so the frame starts on a cache line
+        qint64 offset = out.pos();
+        qint64 padding = (STACK_ALIGNMENT - offset % STACK_ALIGNMENT) % STACK_ALIGNMENT;
+        out.write(QByteArray(static_cast<int>(padding), 0));
+        offset += padding;
+
+        if (out.write(stored) != stored.size()) {
+            *error = QString("Can't write %1: %2").arg(fileName, out.errorString());
+            return false;
+        }
+
+        auto *entry = reinterpret_cast<uchar *>(index.data()) + f * STACK_INDEX_BYTES;
+        qToLittleEndian<quint64>(static_cast<quint64>(offset), entry);
+        qToLittleEndian<quint32>(static_cast<quint32>(stored.size()), entry + 8);
+        qToLittleEndian<quint32>(type, entry + 12);
+    }
+
+    out.seek(STACK_HEADER_BYTES);
+    out.write(index);
+    out.close();
+    return true;
+}
+
+/**
+ * @brief EnvironmentStack::expandFiles
+ *
+ * Replace each stack in a list of environment files with its frames, "stack.revostack#0", "stack.revostack#1", etc.
+ * Images, and stacks that can't be opened, are left as they are - the error is reported when the file is loaded.
+ *
+ * @param fileNames
+ * @return
+ */
+QStringList EnvironmentStack::expandFiles(const QStringList &fileNames)
+{
+    QStringList expanded;
+    for (const QString &fileName : fileNames) {
+        EnvironmentStack stack;
+        if (!isStack(fileName) || !stack.open(fileName)) {
+            expanded.append(fileName);
+            continue;
+        }
+        for (int i = 0; i < stack.frameCount(); i++)
+            expanded.append(QString("%1#%2").arg(fileName).arg(i));
+    }
+    return expanded;
+}
+
+/**
+ * @brief EnvironmentStack::isStack
+ * @param fileName
+ * @return true if the name has the stack suffix
+ */
+bool EnvironmentStack::isStack(const QString &fileName)
+{
+    return QFileInfo(fileName).suffix().compare(STACK_SUFFIX, Qt::CaseInsensitive) == 0;
+}
+
+/**
+ * @brief EnvironmentStack::parseFrameReference
+ * @param reference an environmentFiles entry
+ * @param fileName set to the stack file
+ * @param index set to the frame number
+ * @return false if this is not a frame of a stack
+ */
+bool EnvironmentStack::parseFrameReference(const QString &reference, QString *fileName, int *index)
+{
+    int hash = reference.lastIndexOf('#');
+    if (hash < 0 || !isStack(reference.left(hash))) return false;
+
+    bool ok = false;
+    *index = reference.mid(hash + 1).toInt(&ok);
+    if (!ok) return false;
+
+    *fileName = reference.left(hash);
+    return true;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file
+ * Header: Environment Stack
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef ENVIRONMENTSTACK_H
+#define ENVIRONMENTSTACK_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <QStringList>
+
+#define STACK_MAGIC "REVOSTAK"
+#define STACK_VERSION 1
+#define STACK_SUFFIX "revostack"
+#define STACK_HEADER_BYTES 32
+#define STACK_INDEX_BYTES 16 //per frame
+#define STACK_ALIGNMENT 64 //frames start on a cache line
+
+#define STACK_FRAME_RAW 0
+#define STACK_FRAME_ZLIB 1 //qCompress
+
+/**
+ * @brief The EnvironmentStack class
+ *
+ * A whole environment sequence in one file, read by mapping it into memory. All values little endian:
+ *
+ * - header (32 bytes): magic "REVOSTAK", version, width, height, frame count (quint32 each), 8 bytes reserved
+ * - index (16 bytes per frame): offset from the start of the file (quint64), stored size (quint32), STACK_FRAME_ type
+ * - frames: width columns of height squares of red, green and blue bytes - the same order as the environment arrays
+ *
+ * In environmentFiles each frame appears as its own entry, "stack.revostack#n", so the environment modes step
+ * through a stack just as through a list of images.
+ */
+class EnvironmentStack
+{
+public:
+    EnvironmentStack();
+
+    bool open(const QString &fileName);
+    bool isOpen() const;
+    int width() const;
+    int height() const;
+    int frameCount() const;
+    QString errorString() const;
+
+    QByteArray frame(int index, int gridWidth, int gridHeight, int columnStride) const;
+    QImage frameImage(int index) const;
+
+    static bool write(const QStringList &imageFiles, const QString &fileName, bool compress, QString *error);
+    static QStringList expandFiles(const QStringList &fileNames);
+    static bool isStack(const QString &fileName);
+    static bool parseFrameReference(const QString &reference, QString *fileName, int *index);
+
+private:
+    Q_DISABLE_COPY(EnvironmentStack)
+
+    QByteArray storedFrame(int index) const;
+
+    QFile file;
+    const uchar *data;
+    qint64 size;
+    int stackWidth;
+    int stackHeight;
+    int frames;
+    QString error;
+};
+
+#endif // ENVIRONMENTSTACK_H
@@ -0,0 +1,295 @@
+/**
+ * @file
+ * Fitness Kernel
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#include "fitnesskernel.h"
+#include "simmanager.h"
+
+//RJG - The instruction set versions use per-function target attributes, so the rest of the program needs no special
+//compiler flags and still runs on any x86 CPU. Only GCC and Clang support these - other compilers get the table.
+#if defined(Q_CC_GNU) && defined(Q_PROCESSOR_X86)
+#define FITNESS_KERNEL_X86
+#include <immintrin.h>
+#if (defined(__clang__) && __clang_major__ >= 7) || (!defined(__clang__) && __GNUC__ >= 8)
+#define FITNESS_KERNEL_AVX512
+#endif
+#endif
+
+/**
+ * @brief tableBitCount64
+ * @param value
+ * @return set bits, from the bitCounts table
+ */
+static int tableBitCount64(quint64 value)
+{
+    return static_cast<int>(bitCounts[value & 65535] + bitCounts[(value >> 16) & 65535]
+                            + bitCounts[(value >> 32) & 65535] + bitCounts[value >> 48]);
+}
+
+/**
+ * @brief tableBitDistances
+ */
+template <int Words>
+static void tableBitDistances(const typename GenomeType<Words>::Type *genomes, int count, const quint32 *masks, quint8 *distances)
+{
+    for (int i = 0; i < count; i++) {
+        quint32 distance = 0;
+        for (int w = 0; w < Words; w++) {
+            auto lowergenome = static_cast<quint32>(genomeWord(genomes[i], w));
+            for (int c = 0; c < 3; c++) {
+                quint32 answer = lowergenome ^ masks[w * 3 + c];
+                distance += bitCounts[answer & 65535] + bitCounts[answer >> 16];
+            }
+        }
+        distances[i] = static_cast<quint8>((distance + Words / 2) / Words);
+    }
+}
+
+/**
+ * @brief tableGenomeDifference
+ */
+template <int Words>
+static int tableGenomeDifference(const typename GenomeType<Words>::Type &genome, const typename GenomeType<Words>::Type &partnerGenome)
+{
+    int difference = 0;
+    for (int w = 0; w < Words; w++)
+        difference += tableBitCount64(genomeWord(genome, w) ^ genomeWord(partnerGenome, w));
+    return difference;
+}
+
+#ifdef FITNESS_KERNEL_X86
+
+/**
+ * @brief popcntBitCount64
+ */
+__attribute__((target("popcnt")))
+static int popcntBitCount64(quint64 value)
+{
+    return __builtin_popcountll(value);
+}
+
+/**
+ * @brief popcntDistance
+ * @return bit distance of one genome, averaged over its words
+ */
+template <int Words>
+__attribute__((target("popcnt")))
+static inline quint8 popcntDistance(const typename GenomeType<Words>::Type &genome, const quint32 *masks)
+{
+    int distance = 0;
+    for (int w = 0; w < Words; w++) {
+        auto lowergenome = static_cast<quint32>(genomeWord(genome, w));
+        distance += __builtin_popcount(lowergenome ^ masks[w * 3])
+                    + __builtin_popcount(lowergenome ^ masks[w * 3 + 1])
+                    + __builtin_popcount(lowergenome ^ masks[w * 3 + 2]);
+    }
+    return static_cast<quint8>((distance + Words / 2) / Words);
+}
+
+/**
+ * @brief popcntBitDistances
+ */
+template <int Words>
+__attribute__((target("popcnt")))
+static void popcntBitDistances(const typename GenomeType<Words>::Type *genomes, int count, const quint32 *masks, quint8 *distances)
+{
+    for (int i = 0; i < count; i++)
+        distances[i] = popcntDistance<Words>(genomes[i], masks);
+}
+
+/**
+ * @brief popcntGenomeDifference
+ */
+template <int Words>
+__attribute__((target("popcnt")))
+static int popcntGenomeDifference(const typename GenomeType<Words>::Type &genome, const typename GenomeType<Words>::Type &partnerGenome)
+{
+    int difference = 0;
+    for (int w = 0; w < Words; w++)
+        difference += __builtin_popcountll(genomeWord(genome, w) ^ genomeWord(partnerGenome, w));
+    return difference;
+}
+
+/**
+ * @brief avx2NibbleCounts
+ *
+ * AVX2 has no popcount, so count each nibble with a shuffle lookup - gives the set bits in each byte
+ */
+__attribute__((target("avx2")))
+static inline __m256i avx2NibbleCounts(__m256i value)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowNibble = _mm256_set1_epi8(0x0f);
+    __m256i low = _mm256_and_si256(value, lowNibble);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(value, 4), lowNibble);
+    return _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high));
+}
+
+/**
+ * @brief avx2Masks
+ * @return one colour's masks repeated across the 64 bit lanes - lane j lines up with word j % Words of a genome
+ */
+template <int Words>
+__attribute__((target("avx2")))
+static inline __m256i avx2Masks(const quint32 *masks, int colour)
+{
+    alignas(32) quint64 lanes[4];
+    for (int j = 0; j < 4; j++)
+        lanes[j] = masks[(j % Words) * 3 + colour];
+    return _mm256_load_si256(reinterpret_cast<const __m256i *>(lanes));
+}
+
+/**
+ * @brief avx2BitDistances
+ *
+ * Four words at a time - four 64 bit genomes, two 128 bit or one 256 bit
+ */
+template <int Words>
+__attribute__((target("avx2,popcnt")))
+static void avx2BitDistances(const typename GenomeType<Words>::Type *genomes, int count, const quint32 *masks, quint8 *distances)
+{
+    const int perVector = 4 / Words;
+    const auto *words = reinterpret_cast<const quint64 *>(genomes);
+    const __m256i lower32 = _mm256_set1_epi64x(0xffffffffLL);
+    const __m256i red = avx2Masks<Words>(masks, 0);
+    const __m256i green = avx2Masks<Words>(masks, 1);
+    const __m256i blue = avx2Masks<Words>(masks, 2);
+
+    int i = 0;
+    for (; i + perVector <= count; i += perVector) {
+        __m256i genome = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + i * Words)), lower32);
+
+        //per byte counts are at most 8 each, so adding the three can't overflow
+        __m256i bytes = _mm256_add_epi8(avx2NibbleCounts(_mm256_xor_si256(genome, red)),
+                                        _mm256_add_epi8(avx2NibbleCounts(_mm256_xor_si256(genome, green)),
+                                                        avx2NibbleCounts(_mm256_xor_si256(genome, blue))));
+
+        //sum the bytes of each 64 bit lane, then the lanes of each genome
+        alignas(32) quint64 sums[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(sums), _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+        for (int j = 0; j < perVector; j++) {
+            quint64 distance = 0;
+            for (int w = 0; w < Words; w++)
+                distance += sums[j * Words + w];
+            distances[i + j] = static_cast<quint8>((distance + Words / 2) / Words);
+        }
+    }
+
+    for (; i < count; i++)
+        distances[i] = popcntDistance<Words>(genomes[i], masks);
+}
+
+#ifdef FITNESS_KERNEL_AVX512
+/**
+ * @brief avx512BitDistances
+ *
+ * Eight words at a time with VPOPCNTQ - the last partial block uses masked loads and stores
+ */
+template <int Words>
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void avx512BitDistances(const typename GenomeType<Words>::Type *genomes, int count, const quint32 *masks, quint8 *distances)
+{
+    const int perVector = 8 / Words;
+    const auto *words = reinterpret_cast<const quint64 *>(genomes);
+    const __m512i lower32 = _mm512_set1_epi64(0xffffffffLL);
+
+    alignas(64) quint64 lanes[3][8];
+    for (int c = 0; c < 3; c++)
+        for (int j = 0; j < 8; j++)
+            lanes[c][j] = masks[(j % Words) * 3 + c];
+    const __m512i red = _mm512_load_si512(lanes[0]);
+    const __m512i green = _mm512_load_si512(lanes[1]);
+    const __m512i blue = _mm512_load_si512(lanes[2]);
+
+    for (int i = 0; i < count; i += perVector) {
+        int block = qMin(count - i, perVector);
+        __mmask8 loaded = (block * Words >= 8) ? static_cast<__mmask8>(0xff) : static_cast<__mmask8>((1u << (block * Words)) - 1);
+        __m512i genome = _mm512_and_si512(_mm512_maskz_loadu_epi64(loaded, words + i * Words), lower32);
+        __m512i sums = _mm512_add_epi64(_mm512_popcnt_epi64(_mm512_xor_si512(genome, red)),
+                                        _mm512_add_epi64(_mm512_popcnt_epi64(_mm512_xor_si512(genome, green)),
+                                                         _mm512_popcnt_epi64(_mm512_xor_si512(genome, blue))));
+        if (Words == 1) {
+            _mm512_mask_cvtepi64_storeu_epi8(distances + i, loaded, sums);
+        } else {
+            alignas(64) quint64 laneSums[8];
+            _mm512_store_si512(laneSums, sums);
+            for (int j = 0; j < block; j++) {
+                quint64 distance = 0;
+                for (int w = 0; w < Words; w++)
+                    distance += laneSums[j * Words + w];
+                distances[i + j] = static_cast<quint8>((distance + Words / 2) / Words);
+            }
+        }
+    }
+}
+#endif
+
+#endif // FITNESS_KERNEL_X86
+
+int (*FitnessKernel::bitCount64)(quint64 value) = tableBitCount64;
+void (*FitnessKernel::bitDistances)(const Genome *genomes, int count, const quint32 *masks, quint8 *distances) = tableBitDistances<GENOME_WORDS>;
+int (*FitnessKernel::genomeDifference)(const Genome &genome, const Genome &partnerGenome) = tableGenomeDifference<GENOME_WORDS>;
+const char *FitnessKernel::kernelName = "lookup table";
+
+/**
+ * @brief FitnessKernel::initialise
+ *
+ * Pick the kernels for this CPU - the bitCounts table must already be filled in for the fallback
+ */
+void FitnessKernel::initialise()
+{
+    bitCount64 = tableBitCount64;
+    bitDistances = tableBitDistances<GENOME_WORDS>;
+    genomeDifference = tableGenomeDifference<GENOME_WORDS>;
+    kernelName = "lookup table";
+
+#ifdef FITNESS_KERNEL_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("popcnt")) {
+        bitCount64 = popcntBitCount64;
+        bitDistances = popcntBitDistances<GENOME_WORDS>;
+        genomeDifference = popcntGenomeDifference<GENOME_WORDS>;
+        kernelName = "POPCNT";
+
+        if (__builtin_cpu_supports("avx2")) {
+            bitDistances = avx2BitDistances<GENOME_WORDS>;
+            kernelName = "AVX2";
+        }
+
+#ifdef FITNESS_KERNEL_AVX512
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) {
+            bitDistances = avx512BitDistances<GENOME_WORDS>;
+            kernelName = "AVX-512 VPOPCNTQ";
+        }
+#endif
+    }
+#endif
+}
+
+/**
+ * @brief FitnessKernel::name
+ * @return which kernel is in use, for logs
+ */
+QString FitnessKernel::name()
+{
+#if GENOME_WORDS > 1
+    return QString("%1, %2 bit genomes").arg(kernelName).arg(GENOME_BITS);
+#else
+    return QString(kernelName);
+#endif
+}
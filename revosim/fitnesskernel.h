@@ -0,0 +1,57 @@
+/**
+ * @file
+ * Header: Fitness Kernel
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef FITNESSKERNEL_H
+#define FITNESSKERNEL_H
+
+#include "genome.h"
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief The FitnessKernel class
+ *
+ * Bit counting for fitness and breeding checks. initialise() picks the fastest version this CPU can run - AVX-512
+ * VPOPCNTQ, AVX2, or the POPCNT instruction - falling back to the bitCounts lookup table on other CPUs and compilers.
+ * Until initialise() is called the table versions are used.
+ *
+ * The kernels are templates over the number of 64 bit words in a genome, so each genome width (see genome.h) gets
+ * its own unrolled and vectorised versions - a 128 bit genome fills half an AVX2 register rather than taking two
+ * passes. Only the width the program is built for is used.
+ */
+class FitnessKernel
+{
+public:
+    static void initialise();
+    static QString name();
+
+    //Number of set bits in value
+    static int (*bitCount64)(quint64 value);
+
+    //For each genome, total set bits of (lower 32 bits of each word XOR that word's masks) over the three colours,
+    //averaged over the words - 0 to 96. masks holds GENOME_MASKS values.
+    static void (*bitDistances)(const Genome *genomes, int count, const quint32 *masks, quint8 *distances);
+
+    //Number of bits that differ between two genomes, coding and non-coding
+    static int (*genomeDifference)(const Genome &genome, const Genome &partnerGenome);
+
+private:
+    static const char *kernelName;
+};
+
+#endif // FITNESSKERNEL_H
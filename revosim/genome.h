@@ -0,0 +1,156 @@
+/**
+ * @file
+ * Header: Genome
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef GENOME_H
+#define GENOME_H
+
+#include <QDataStream>
+#include <QHash>
+#include <QString>
+#include <QtGlobal>
+
+//RJG - Genome width is fixed when building: qmake "GENOME_BITS=128" (or 256). Only revosim-cli can be built wider -
+//the GUI draws and edits 64 bit genomes.
+#ifndef GENOME_BITS
+#define GENOME_BITS 64
+#endif
+
+#if GENOME_BITS != 64 && GENOME_BITS != 128 && GENOME_BITS != 256
+#error "GENOME_BITS must be 64, 128 or 256"
+#endif
+
+#define GENOME_WORDS (GENOME_BITS / 64)
+#define GENOME_MASKS (3 * GENOME_WORDS) //xorMasks per colour - red, green, blue for word 0, then for word 1 and so on
+
+/**
+ * @brief The WideGenome struct
+ *
+ * A genome of more than one 64 bit word. Every word is laid out like a 64 bit genome - the lower 32 bits are coding,
+ * matched against that word's xorMasks, and the upper 32 bits non-coding.
+ */
+template <int Words> struct WideGenome {
+    quint64 word[Words];
+};
+
+/**
+ * @brief The GenomeType struct
+ *
+ * The type the kernels use for a genome of Words words - 64 bit genomes stay a plain quint64
+ */
+template <int Words> struct GenomeType {
+    typedef WideGenome<Words> Type;
+};
+
+template <> struct GenomeType<1> {
+    typedef quint64 Type;
+};
+
+typedef GenomeType<GENOME_WORDS>::Type Genome;
+
+inline quint64 genomeWord(const quint64 &genome, int)
+{
+    return genome;
+}
+
+inline quint64 &genomeWord(quint64 &genome, int)
+{
+    return genome;
+}
+
+template <int Words> inline quint64 genomeWord(const WideGenome<Words> &genome, int w)
+{
+    return genome.word[w];
+}
+
+template <int Words> inline quint64 &genomeWord(WideGenome<Words> &genome, int w)
+{
+    return genome.word[w];
+}
+
+/**
+ * @brief genomeFromWord
+ * @return genome with word 0 set to value, any other words zero
+ */
+inline Genome genomeFromWord(quint64 value)
+{
+    Genome genome{};
+    genomeWord(genome, 0) = value;
+    return genome;
+}
+
+/**
+ * @brief genomeBinary
+ * @return the genome as 0s and 1s, most significant bit of the last word first
+ */
+inline QString genomeBinary(const Genome &genome)
+{
+    QString binary;
+    binary.reserve(GENOME_BITS);
+    for (int w = GENOME_WORDS - 1; w >= 0; w--)
+        for (int j = 63; j >= 0; j--)
+            binary.append((genomeWord(genome, w) >> j) & 1 ? QChar('1') : QChar('0'));
+    return binary;
+}
+
+template <int Words> inline bool operator==(const WideGenome<Words> &lhs, const WideGenome<Words> &rhs)
+{
+    for (int w = 0; w < Words; w++)
+        if (lhs.word[w] != rhs.word[w]) return false;
+    return true;
+}
+
+template <int Words> inline bool operator!=(const WideGenome<Words> &lhs, const WideGenome<Words> &rhs)
+{
+    return !(lhs == rhs);
+}
+
+//Highest word is most significant, so wide genomes sort the way their binary strings do
+template <int Words> inline bool operator<(const WideGenome<Words> &lhs, const WideGenome<Words> &rhs)
+{
+    for (int w = Words - 1; w >= 0; w--)
+        if (lhs.word[w] != rhs.word[w]) return lhs.word[w] < rhs.word[w];
+    return false;
+}
+
+template <int Words> inline bool operator>(const WideGenome<Words> &lhs, const WideGenome<Words> &rhs)
+{
+    return rhs < lhs;
+}
+
+template <int Words> inline uint qHash(const WideGenome<Words> &genome, uint seed = 0)
+{
+    uint hash = seed;
+    for (int w = 0; w < Words; w++)
+        hash = hash * 31 + qHash(genome.word[w], seed);
+    return hash;
+}
+
+template <int Words> inline QDataStream &operator<<(QDataStream &out, const WideGenome<Words> &genome)
+{
+    for (int w = 0; w < Words; w++)
+        out << genome.word[w];
+    return out;
+}
+
+template <int Words> inline QDataStream &operator>>(QDataStream &in, WideGenome<Words> &genome)
+{
+    for (int w = 0; w < Words; w++)
+        in >> genome.word[w];
+    return in;
+}
+
+#endif // GENOME_H
@@ -0,0 +1,625 @@
+/**
+ * @file
+ * Headless Runner
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#include "environmentstack.h"
+#include "fitnesskernel.h"
+#include "headlessrunner.h"
+#include "philox.h"
+#include "simmanager.h"
+#include "globals.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QThread>
+#include <QVector>
+#include <QXmlStreamReader>
+
+/*!
+ * \brief HeadlessRunner::HeadlessRunner
+ */
+HeadlessRunner::HeadlessRunner()
+{
+    refreshRate = 50;
+    quiet = false;
+    nextRefresh = 0;
+    resumed = false;
+    checkpointInterval = 0;
+}
+
+/*!
+ * \brief HeadlessRunner::loadSettings
+ * \param settingsFilename
+ * \return true if the file was read without error
+ *
+ * Reads a settings file in the same format as written by the GUI (Settings > Save settings). GUI-only options are ignored.
+ */
+bool HeadlessRunner::loadSettings(const QString &settingsFilename)
+{
+    QFile settingsFile(settingsFilename);
+    if (!settingsFile.open(QIODevice::ReadOnly))
+    {
+        qCritical().noquote() << "Error opening settings file" << settingsFilename;
+        return false;
+    }
+
+    QXmlStreamReader settingsFileIn(&settingsFile);
+
+    while (!settingsFileIn.atEnd() && !settingsFileIn.hasError())
+    {
+        QXmlStreamReader::TokenType token = settingsFileIn.readNext();
+
+        if (token != QXmlStreamReader::StartElement)
+            continue;
+        if (settingsFileIn.name() == "revosim")
+            continue;
+        if (simulationManager->loadSettingsElement(settingsFileIn))
+            continue;
+        if (settingsFileIn.name() == "refreshRate")
+            refreshRate = settingsFileIn.readElementText().toInt();
+    }
+
+    if (settingsFileIn.hasError())
+    {
+        qCritical().noquote() << "Error reading settings file" << settingsFilename << "-" << settingsFileIn.errorString();
+        return false;
+    }
+
+    if (refreshRate < 1)
+        refreshRate = 1;
+
+    if (gridX < 1 || gridX > GRID_X || gridY < 1 || gridY > GRID_Y || slotsPerSquare < 1 || slotsPerSquare > SLOTS_PER_GRID_SQUARE)
+    {
+        qCritical().noquote() << QString("%1 asks for a %2 x %3 grid with %4 slots per square - the limits are %5 x %6 and %7")
+                              .arg(settingsFilename).arg(gridX).arg(gridY).arg(slotsPerSquare).arg(GRID_X).arg(GRID_Y)
+                              .arg(SLOTS_PER_GRID_SQUARE);
+        return false;
+    }
+
+    settingsFile.close();
+    return true;
+}
+
+/*!
+ * \brief HeadlessRunner::loadEnvironment
+ * \param paths image files, environment stacks, or directories of these (used in name order)
+ * \return true if at least one image was found
+ */
+bool HeadlessRunner::loadEnvironment(const QStringList &paths)
+{
+    QStringList files;
+    if (!findEnvironmentFiles(paths, &files))
+        return false;
+
+    environmentFiles = EnvironmentStack::expandFiles(files);
+    currentEnvironmentFile = 0;
+    simulationManager->loadEnvironmentFromFile(environmentMode);
+    return true;
+}
+
+/*!
+ * \brief HeadlessRunner::findEnvironmentFiles
+ * \param paths image files, environment stacks, or directories of these
+ * \param files set to the files, with directories replaced by their contents in name order
+ * \return true if at least one file was found - errors are printed
+ */
+bool HeadlessRunner::findEnvironmentFiles(const QStringList &paths, QStringList *files)
+{
+    for (const QString &path : paths)
+    {
+        QFileInfo info(path);
+        if (info.isDir())
+        {
+            QDir directory(path);
+            QStringList images = directory.entryList(QStringList() << "*.png" << "*.bmp" << "*." STACK_SUFFIX, QDir::Files, QDir::Name);
+            for (const QString &image : images)
+                files->append(directory.absoluteFilePath(image));
+        }
+        else if (info.exists())
+            files->append(info.absoluteFilePath());
+        else
+        {
+            qCritical().noquote() << "Environment image" << path << "does not exist";
+            return false;
+        }
+    }
+
+    if (files->isEmpty())
+    {
+        qCritical() << "No environment images found";
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief HeadlessRunner::makeStack
+ * \param paths images, or directories of images used in name order
+ * \param stackFilename
+ * \param compress store frames compressed where that makes them smaller
+ * \return true if the stack was written
+ *
+ * Pack environment images into a single stack file, which is mapped into memory rather than decoded when run.
+ */
+bool HeadlessRunner::makeStack(const QStringList &paths, const QString &stackFilename, bool compress)
+{
+    QStringList files;
+    if (!findEnvironmentFiles(paths, &files))
+        return false;
+
+    for (const QString &file : files)
+        if (EnvironmentStack::isStack(file))
+        {
+            qCritical().noquote() << "Can't put stack" << file << "inside another stack";
+            return false;
+        }
+
+    QString error;
+    if (!EnvironmentStack::write(files, stackFilename, compress, &error))
+    {
+        qCritical().noquote() << error;
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief HeadlessRunner::loadRandoms
+ * \param randomsFilename
+ * \return true if 65536 bytes were read
+ *
+ * As per the GUI, overwrite the pseudorandoms made by the simulation manager with genuine randoms, starting at a random
+ * offset - or one taken from the seed, if one is set.
+ */
+bool HeadlessRunner::loadRandoms(const QString &randomsFilename)
+{
+    QFile rfile(randomsFilename);
+    if (!rfile.open(QIODevice::ReadOnly))
+    {
+        qWarning().noquote() << "Error loading randoms from" << randomsFilename << "- using pseudorandoms";
+        return false;
+    }
+
+    //with a seed set the offset comes from it, so the same randoms are read every time
+    int seedoffset = randomSeed ? static_cast<int>(SimManager::seedValue(randomSeed, SEED_STREAM_RANDOMS) & PORTABLE_RAND_MAX)
+                     : simulationManager->portableRandom();
+    rfile.seek(seedoffset);
+
+    qint64 i = rfile.read(reinterpret_cast<char *>(randoms), 65536);
+    if (i != static_cast<qint64>(65536))
+    {
+        qWarning() << "Failed to read 65536 bytes from randoms file - random numbers may be compromised";
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief HeadlessRunner::setOutputPath
+ * \param path
+ * \return true if the directory exists or could be made
+ */
+bool HeadlessRunner::setOutputPath(const QString &path)
+{
+    QDir directory(path);
+    if (!directory.exists() && !directory.mkpath("."))
+    {
+        qCritical().noquote() << "Can't create output directory" << path << "- permissions issue?";
+        return false;
+    }
+
+    outputPath = directory.absolutePath();
+    if (!outputPath.endsWith(QDir::separator()))
+        outputPath.append(QDir::separator());
+    return true;
+}
+
+/*!
+ * \brief HeadlessRunner::resume
+ * \param checkpointFilename saved from the GUI or by --checkpoint
+ * \param seed new seed to carry on with, e.g. for replicates branching from one checkpoint - 0 keeps the checkpoint's
+ * \return true if the simulation was loaded - run() then carries on from it rather than starting afresh
+ *
+ * As with loading in the GUI, the species history before the checkpoint is not kept, so phylogeny logs start from here.
+ */
+bool HeadlessRunner::resume(const QString &checkpointFilename, quint64 seed)
+{
+    //a fresh run first, for the species log structures a checkpoint doesn't hold
+    simulationManager->setupRun();
+
+    QByteArray guiState;
+    QString error;
+    if (!Checkpoint::load(checkpointFilename, &guiState, &error))
+    {
+        qCritical().noquote() << error;
+        return false;
+    }
+
+    if (seed)
+        randomSeed = runSeed = seed;
+
+    resumed = true;
+    if (!quiet)
+        qInfo() << "Resuming from iteration" << iteration;
+    return true;
+}
+
+/*!
+ * \brief HeadlessRunner::runReplicates
+ * \param replicates
+ * \param jobs how many to run at once
+ * \param outputPath each replicate writes to its own folder in here
+ * \param checkpointFilename if set, each replicate checkpoints to a file of this name in its own folder
+ * \return the worst exit code of the replicates
+ *
+ * Run replicates of the simulation set up by the command line, several at once. The simulation state is global to
+ * a process, so each replicate is a separate revosim-cli process, given the same arguments plus its own seed, output
+ * folder and share of the CPUs. Replicate seeds are derived from the run's seed, and each replicate takes its fitness
+ * landscape, founder and randoms from its own seed (see SimManager::setupRun), so with a seed given a batch repeats
+ * exactly - without one the batch seed comes from the clock.
+ *
+ * If pinning, the replicates running at once get their own CPUs from firstCpu on - a batch that would need more
+ * CPUs than there are is refused, rather than pinning replicates on top of one another.
+ */
+int HeadlessRunner::runReplicates(int replicates, int jobs, const QString &outputPath, const QString &checkpointFilename)
+{
+    int cpus = qMax(1, QThread::idealThreadCount());
+    jobs = qBound(1, jobs, replicates);
+    int threads = threadCount > 0 ? threadCount : qMax(1, cpus / jobs);
+    quint64 batchSeed = randomSeed ? randomSeed : simulationManager->random64();
+
+    if ((pinThreads || numaPlacement) && firstCpu + jobs * threads > cpus)
+    {
+        qCritical().noquote() << QString("Pinning %1 replicates at a time with %2 threads each from CPU %3 needs %4 CPUs, but there are %5 - use fewer jobs or threads, or don't pin")
+                              .arg(jobs).arg(threads).arg(firstCpu).arg(firstCpu + jobs * threads).arg(cpus);
+        return 1;
+    }
+
+    qInfo() << "Running" << replicates << "replicates," << jobs << "at a time with" << threads << "threads each - batch seed" << batchSeed;
+
+    //later options win, so these override anything already given
+    QStringList arguments = QCoreApplication::arguments().mid(1);
+    QDir output(outputPath);
+
+    QVector<QProcess *> running(jobs, nullptr); //by job slot, which picks the CPUs used if pinning
+    QVector<int> runningReplicate(jobs, -1);
+    int next = 0;
+    int remaining = replicates;
+    int exitCode = 0;
+
+    while (remaining > 0)
+    {
+        for (int slot = 0; slot < jobs; slot++)
+        {
+            if (running[slot] || next >= replicates)
+                continue;
+
+            int replicate = next++;
+            quint32 bits[4];
+            Philox::generate(batchSeed, static_cast<quint32>(replicate), 0, 0, 0, bits);
+            quint64 seed = (static_cast<quint64>(bits[1]) << 32) | bits[0];
+            if (seed == 0)
+                seed = 1;
+
+            QString directory = output.filePath(QString("replicate_%1").arg(replicate + 1, 3, 10, QChar('0')));
+            QStringList replicateArguments = arguments;
+            replicateArguments << "--replicates" << "1" << "--output" << directory << "--seed" << QString::number(seed)
+                               << "--threads" << QString::number(threads) << "--first-cpu" << QString::number(firstCpu + slot * threads);
+            if (!checkpointFilename.isEmpty())
+                replicateArguments << "--checkpoint" << QDir(directory).filePath(QFileInfo(checkpointFilename).fileName());
+
+            auto *process = new QProcess;
+            process->setProcessChannelMode(QProcess::ForwardedChannels);
+            process->start(QCoreApplication::applicationFilePath(), replicateArguments);
+            if (!process->waitForStarted())
+            {
+                qCritical().noquote() << "Could not start replicate" << replicate + 1 << "-" << process->errorString();
+                delete process;
+                exitCode = qMax(exitCode, 1);
+                remaining--;
+                continue;
+            }
+
+            qInfo().noquote() << "Replicate" << replicate + 1 << "started - seed" << seed << "output" << directory;
+            running[slot] = process;
+            runningReplicate[slot] = replicate;
+        }
+
+        for (int slot = 0; slot < jobs; slot++)
+        {
+            if (!running[slot] || !running[slot]->waitForFinished(100))
+                continue;
+
+            int code = running[slot]->exitStatus() == QProcess::NormalExit ? running[slot]->exitCode() : 1;
+            qInfo().noquote() << "Replicate" << runningReplicate[slot] + 1 << "finished with exit code" << code;
+            exitCode = qMax(exitCode, code);
+
+            delete running[slot];
+            running[slot] = nullptr;
+            remaining--;
+        }
+    }
+
+    return exitCode;
+}
+
+/*!
+ * \brief HeadlessRunner::setCheckpoint
+ * \param checkpointFilename
+ * \param intervalMinutes
+ *
+ * Save the simulation every intervalMinutes while running, in the background where the OS allows (see CheckpointWriter).
+ */
+void HeadlessRunner::setCheckpoint(const QString &checkpointFilename, int intervalMinutes)
+{
+    checkpointPath = checkpointFilename;
+    checkpointInterval = static_cast<qint64>(intervalMinutes) * 60000;
+}
+
+/*!
+ * \brief HeadlessRunner::checkpoint
+ *
+ * Called between iterations - start a checkpoint if one is due and the last has finished
+ */
+void HeadlessRunner::checkpoint()
+{
+    reportCheckpoint();
+
+    if (checkpointWriter.busy() || checkpointTimer.elapsed() < checkpointInterval)
+        return;
+
+    checkpointTimer.restart();
+    QString error;
+    if (!checkpointWriter.start(checkpointPath, true, &error))
+        qWarning().noquote() << error;
+}
+
+/*!
+ * \brief HeadlessRunner::reportCheckpoint
+ *
+ * Print the outcome of the last checkpoint, once it has finished
+ */
+void HeadlessRunner::reportCheckpoint()
+{
+    bool ok;
+    QString message;
+    if (!checkpointWriter.poll(&ok, &message))
+        return;
+
+    if (!ok)
+        qWarning().noquote() << message;
+    else if (!quiet)
+        qInfo().noquote() << message;
+}
+
+/*!
+ * \brief HeadlessRunner::outputFilename
+ * \param suffix
+ * \return full path of an output file, named as per the GUI
+ */
+QString HeadlessRunner::outputFilename(const QString &suffix) const
+{
+    return outputPath + QString(PRODUCTNAME) + suffix + ".txt";
+}
+
+/*!
+ * \brief HeadlessRunner::run
+ * \param iterations
+ * \return process exit code - 0 on success
+ *
+ * Equivalent of MainWindow::runForNSimulation, with the end run log always written.
+ */
+int HeadlessRunner::run(quint64 iterations)
+{
+    if (!resumed)
+        simulationManager->setupRun();
+    if (!aliveCount)
+        return 1;
+
+    if (logging && speciesMode == SPECIES_MODE_NONE)
+        qWarning() << "Species tracking is off, so the log files won't show species information";
+
+    speciesLoggingFile = outputFilename("_log");
+    if (logging)
+        simulationManager->writeLog(speciesLoggingFile);
+
+    if (!quiet)
+        qInfo().noquote() << "Fitness kernel:" << FitnessKernel::name();
+
+    if (numaPlacement && !quiet)
+        for (const QString &line : simulationManager->numaReport())
+            qInfo().noquote() << line;
+
+    timer.start();
+    checkpointTimer.start();
+    nextRefresh = refreshRate;
+
+    int exitCode = 0;
+    quint64 i = iterations;
+    while (i > 0)
+    {
+        if (--nextRefresh <= 0)
+            report();
+
+        if (simulationManager->iterate(environmentMode, environmentInterpolate))
+        {
+            if (!quiet)
+                qInfo() << "Reached the last environment image at iteration" << iteration;
+            break;
+        }
+
+        if (!aliveCount)
+        {
+            qWarning() << "Nothing is alive in the simulation at iteration" << iteration << "- stopping";
+            exitCode = 2;
+            break;
+        }
+        i--;
+
+        if (!checkpointPath.isEmpty())
+            checkpoint();
+    }
+
+    //and a last one of the end state, waited for
+    if (!checkpointPath.isEmpty())
+    {
+        checkpointWriter.wait();
+        reportCheckpoint();
+        QString error;
+        if (!checkpointWriter.start(checkpointPath, true, &error))
+            qWarning().noquote() << error;
+        checkpointWriter.wait();
+        reportCheckpoint();
+    }
+
+    simulationManager->calculateSpecies();
+    simulationManager->writeRunData(outputFilename("_end_run_log"));
+
+    if (!quiet)
+        qInfo() << "Finished at iteration" << iteration << "with" << aliveCount << "digital organisms";
+
+    //by now critters have used far more of the grid than at the start
+    if (numaPlacement && !quiet)
+        for (const QString &line : simulationManager->numaReport())
+            qInfo().noquote() << line;
+
+    return exitCode;
+}
+
+/*!
+ * \brief HeadlessRunner::benchmarkLayouts
+ * \param iterations per layout
+ * \return 0, or 1 if a run died out or the layouts didn't simulate the same thing
+ *
+ * Run the same simulation from the same start once for each grid layout, timing the settle stages and counting
+ * their cache and TLB misses. No logs are written. Without --seed a fixed one is used, and setupRun() takes the
+ * fitness landscape, founder and starting ages from it, so every layout breeds and settles the same critters - only
+ * the order they sit in memory differs. The alive counts at the end are checked to make sure of that.
+ */
+int HeadlessRunner::benchmarkLayouts(quint64 iterations)
+{
+    if (!randomSeed)
+        randomSeed = 1;
+
+    //everything a run moves on that setupRun() doesn't put back
+    const quint16 startRandom = nextRandom;
+    const int startFile = currentEnvironmentFile;
+    const int startCounter = environmentChangeCounter;
+    const bool startForward = environmentChangeForward;
+    const int startLayout = gridLayout;
+
+    const int layouts[] = {GRID_LAYOUT_COLUMNS, GRID_LAYOUT_TILES, GRID_LAYOUT_MORTON};
+    const char *names[] = {"columns", "tiles", "morton"};
+
+    qInfo().noquote() << QString("Benchmarking %1 x %2 grid, %3 slots, %4 iterations per layout, seed %5")
+                      .arg(gridX).arg(gridY).arg(slotsPerSquare).arg(iterations).arg(randomSeed);
+
+    int exitCode = 0;
+    bool counted = true;
+    quint64 firstIteration = 0;
+    int firstAlive = -1;
+    for (int l = 0; l < 3; l++)
+    {
+        //setupRun() seeds qrand from randomSeed, so picks the same founder for every layout
+        nextRandom = startRandom;
+        currentEnvironmentFile = startFile;
+        environmentChangeCounter = startCounter;
+        environmentChangeForward = startForward;
+        gridLayout = layouts[l];
+        simulationManager->loadEnvironmentFromFile(environmentMode);
+        simulationManager->setupRun();
+
+        simulationManager->startSettleProfile();
+        quint64 i = iterations;
+        while (i > 0 && aliveCount)
+        {
+            if (simulationManager->iterate(environmentMode, environmentInterpolate))
+                break;
+            i--;
+        }
+        SettleProfile profile = simulationManager->stopSettleProfile();
+
+        if (!aliveCount)
+        {
+            qWarning() << "Nothing is alive in the simulation at iteration" << iteration << "- stopping";
+            exitCode = 1;
+            break;
+        }
+
+        double perIteration = profile.iterations ? profile.nanoseconds / 1e6 / profile.iterations : 0.0;
+        double babies = qMax<quint64>(profile.babies, 1);
+        QString line = QString("%1 settle %2 ms/iteration").arg(names[l], -8).arg(perIteration, 0, 'f', 3);
+        if (profile.counted)
+            line += QString(", %1 cache misses and %2 TLB misses per baby").arg(profile.cacheMisses / babies, 0, 'f', 2)
+                    .arg(profile.tlbMisses / babies, 0, 'f', 3);
+        else
+            counted = false;
+        qInfo().noquote() << line + QString(" - %1 alive").arg(aliveCount);
+
+        if (firstAlive < 0)
+        {
+            firstIteration = iteration;
+            firstAlive = aliveCount;
+        }
+        else if (iteration != firstIteration || aliveCount != firstAlive)
+        {
+            qWarning().noquote() << QString("The %1 layout ended with %2 alive at iteration %3, where columns had %4 at iteration %5 - the timings aren't comparable")
+                                 .arg(names[l]).arg(aliveCount).arg(iteration).arg(firstAlive).arg(firstIteration);
+            exitCode = 1;
+        }
+    }
+
+    if (!counted)
+        qWarning() << "Cache and TLB misses couldn't be counted - perf events are Linux only, and need"
+                   << "/proc/sys/kernel/perf_event_paranoid at 2 or lower";
+
+    gridLayout = startLayout;
+    return exitCode;
+}
+
+/*!
+ * \brief HeadlessRunner::report
+ *
+ * Headless equivalent of MainWindow::report - species, log and counter reset, plus a progress line on stdout.
+ */
+void HeadlessRunner::report()
+{
+    nextRefresh = refreshRate;
+
+    simulationManager->calculateSpecies();
+
+    if (logging)
+        simulationManager->writeLog(speciesLoggingFile);
+
+    simulationManager->resetReportCounters();
+
+    if (!quiet)
+    {
+        qint64 time = timer.restart();
+        double perHour = time > 0 ? (3600000.0 * refreshRate) / static_cast<double>(time) : 0;
+        qInfo().noquote() << QString("Iteration %1: %2 alive, %3 species, %4k iterations/hour")
+                          .arg(iteration)
+                          .arg(aliveCount)
+                          .arg(oldSpeciesList.count())
+                          .arg(perHour / 1000, 0, 'f', 2);
+    }
+}
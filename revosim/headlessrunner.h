@@ -0,0 +1,70 @@
+/**
+ * @file
+ * Header: Headless Runner
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef HEADLESSRUNNER_H
+#define HEADLESSRUNNER_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+
+#include "checkpoint.h"
+
+/**
+ * @brief The HeadlessRunner class
+ *
+ * Drives the simulation manager without MainWindow - no event loop, dialogs or images. Used by the
+ * command line build for unattended runs.
+ */
+class HeadlessRunner
+{
+public:
+    HeadlessRunner();
+
+    bool loadSettings(const QString &settingsFilename);
+    bool loadEnvironment(const QStringList &paths);
+    static bool findEnvironmentFiles(const QStringList &paths, QStringList *files);
+    static bool makeStack(const QStringList &paths, const QString &stackFilename, bool compress);
+    static int runReplicates(int replicates, int jobs, const QString &outputPath, const QString &checkpointFilename);
+    bool loadRandoms(const QString &randomsFilename);
+    bool setOutputPath(const QString &path);
+    bool resume(const QString &checkpointFilename, quint64 seed);
+    void setCheckpoint(const QString &checkpointFilename, int intervalMinutes);
+    int run(quint64 iterations);
+    int benchmarkLayouts(quint64 iterations);
+
+    int refreshRate;
+    bool quiet;
+
+private:
+    void report();
+    QString outputFilename(const QString &suffix) const;
+    void checkpoint();
+    void reportCheckpoint();
+
+    QString outputPath;
+    int nextRefresh;
+    QElapsedTimer timer;
+
+    bool resumed;
+    QString checkpointPath; //empty = no checkpoints
+    qint64 checkpointInterval; //ms
+    QElapsedTimer checkpointTimer;
+    CheckpointWriter checkpointWriter;
+};
+
+#endif // HEADLESSRUNNER_H
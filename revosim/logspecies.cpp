@@ -18,7 +18,6 @@
 #include "logspecies.h"
 #include "simmanager.h"
 #include "analysistools.h"
-#include "mainwindow.h"
 
 #include <QTextStream>
 
@@ -58,8 +57,8 @@ QString LogSpecies::writeDataLine(quint64 start, quint64 end, quint64 speciesID,
     foreach (LogSpeciesDataItem *di, dataItems) {
         if (di->iteration >= start && di->iteration < end) {
             out << speciesID << "," << parentID << ",";
-            out << di->iteration << "," << di->size << "," << di->sampleGenome << ","
-                << AnalysisTools::returnBinary(di->sampleGenome) << ","
+            out << di->iteration << "," << di->size << "," << genomeWord(di->sampleGenome, 0) << ","
+                << genomeBinary(di->sampleGenome) << ","
                 << di->genomicDiversity << "," << di->cellsOccupied << ","
                 << di->geographicalRange << "," << di->centroidRangeX << "," << di->centroidRangeY << ",";
             out << di->meanFitness << ",";
@@ -18,6 +18,8 @@
 #ifndef LOGSPECIESDATAITEM_H
 #define LOGSPECIESDATAITEM_H
 
+#include "genome.h"
+
 #include <QtGlobal>
 
 /**
@@ -29,13 +31,13 @@ public:
     LogSpeciesDataItem();
 
     quint64 iteration{};
-    quint64 sampleGenome{};
+    Genome sampleGenome{}; //logged as its first word (read back by AnalysisTools), then in full as binary
     quint32 size{}; //number of critters
     quint32 genomicDiversity{}; //number of genomes
-    quint16 cellsOccupied{}; //number of cells found in - 1 (as real range is 1-65536, to fit in 0-65535)
-    quint8 geographicalRange{}; //max distance between outliers
-    quint8 centroidRangeX{}; //mean of x positions
-    quint8 centroidRangeY{}; //mean of y positions
+    quint32 cellsOccupied{}; //number of cells found in
+    quint32 geographicalRange{}; //max distance between outliers
+    quint32 centroidRangeX{}; //mean of x positions
+    quint32 centroidRangeY{}; //mean of y positions
     quint16 meanFitness{}; //mean of all critter fitnesses, stored as x1000
     quint8 minEnvironment[3] {}; //min red, green, blue found in
     quint8 maxEnvironment[3] {}; //max red, green, blue found in
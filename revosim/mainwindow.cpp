@@ -19,6 +19,8 @@
 
 #include "analyser.h"
 #include "analysistools.h"
+#include "checkpoint.h"
+#include "environmentstack.h"
 #include "mainwindow.h"
 #include "reseed.h"
 #include "resizecatcher.h"
@@ -51,7 +53,6 @@
 #define M_SQRT1_2 0.7071067811865475
 #endif
 
-SimManager *simulationManager;
 MainWindow *mainWindow;
 
 /*!
@@ -80,7 +81,6 @@ public:
  */
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow)
 {
-    analyser = new Analyser; // so can delete next time!
     ui->setupUi(this);
     mainWindow = this;
 
@@ -420,7 +420,7 @@ QDockWidget *MainWindow::createSimulationSettingsDock()
     gridXLabel->setToolTip("<font>Number of grid cells on the <i>x</i> axis.</font>");
     gridXSpin = new QSpinBox;
     gridXSpin->setMinimum(1);
-    gridXSpin->setMaximum(256);
+    gridXSpin->setMaximum(GRID_X);
     gridXSpin->setValue(gridX);
     gridXSpin->setToolTip("<font>Number of grid cells on the <i>x</i> axis.</font>");
     simulationSizeSettingsGrid->addWidget(gridXLabel, 2, 1);
@@ -436,7 +436,7 @@ QDockWidget *MainWindow::createSimulationSettingsDock()
     gridYLabel->setToolTip("<font>Number of grid cells on the <i>y</i> axis.</font>");
     gridYSpin = new QSpinBox;
     gridYSpin->setMinimum(1);
-    gridYSpin->setMaximum(256);
+    gridYSpin->setMaximum(GRID_Y);
     gridYSpin->setValue(gridY);
     gridYSpin->setToolTip("<font>Number of grid cells on the <i>y</i> axis.</font>");
     simulationSizeSettingsGrid->addWidget(gridYLabel, 3, 1);
@@ -1469,10 +1469,7 @@ void MainWindow::report()
     int time = timer.elapsed();
     float atime = static_cast<float>(time / refreshRate);
     timer.restart();
-    double t = 0;
-    for (int n2 = 0; n2 < gridX; n2++)
-        for (int m2 = 0; m2 < gridY; m2++)
-            t += totalFitness[n2][m2];
+    auto t = static_cast<double>(simulationManager->stats.totalFitness);
     t /= static_cast<double>(aliveCount);
     t /= static_cast<double>(settleTolerance);
     t *= 100; //now %age
@@ -1502,7 +1499,7 @@ void MainWindow::report()
     out.sprintf("%d", aliveCount);
     ui->LabelCritters->setText(out);
 
-    calculateSpecies();
+    simulationManager->calculateSpecies();
     out = "-";
     if (speciesMode != SPECIES_MODE_NONE)
     {
@@ -1523,14 +1520,7 @@ void MainWindow::report()
     writeLog();
 
     //reset the breedAttempts and breedFails arrays
-    for (int n2 = 0; n2 < gridX; n2++)
-        for (int m2 = 0; m2 < gridY; m2++)
-        {
-            //breedAttempts[n2][m2]=0;
-            breedFails[n2][m2] = 0;
-            settles[n2][m2] = 0;
-            settleFails[n2][m2] = 0;
-        }
+    simulationManager->resetReportCounters();
 }
 
 /*!
@@ -1615,21 +1605,14 @@ void MainWindow::refreshPopulations()
     // (0) Population Count
     if (currentSelectedMode == 0 || savePopulationCount->isChecked())
     {
-        //Popcount
-        int bigcount = 0;
-        for (int n = 0; n < gridX; n++)
-            for (int m = 0; m < gridY; m++)
-            {
-                int count = 0;
-                for (int c = 0; c < slotsPerSquare; c++)
-                {
-                    if (critters[n][m][c].age) count++;
-                }
-                bigcount += count;
-                count *= 2;
-                if (count > 255) count = 255;
-                populationImage->setPixel(n, m, static_cast<uint>(count));
-            }
+        //Popcount - empty squares stay black
+        populationImage->fill(0);
+        for (const QPoint &cell : activeCellList)
+        {
+            int count = cellPopulation(cell.x(), cell.y()) * 2;
+            if (count > 255) count = 255;
+            populationImage->setPixel(cell, static_cast<uint>(count));
+        }
         //if (ui->actionPopulation_Count->isChecked())populationItem->setPixmap(QPixmap::fromImage(*populationImage));
         if (currentSelectedMode == 0)
             populationItem->setPixmap(QPixmap::fromImage(*populationImage));
@@ -1643,20 +1626,14 @@ void MainWindow::refreshPopulations()
     {
         //Popcount
         int multiplier = 255 / settleTolerance;
-        for (int n = 0; n < gridX; n++)
-            for (int m = 0; m < gridY; m++)
-            {
-                int count = 0;
-                for (int c = 0; c < slotsPerSquare; c++)
-                {
-                    if (critters[n][m][c].age) count++;
-                }
-                if (count == 0)
-                    populationImage->setPixel(n, m, 0);
-                else
-                    populationImage->setPixel(n, m, static_cast<uint>((totalFitness[n][m] * static_cast<uint>(multiplier)) / static_cast<uint>(count)));
-
-            }
+        populationImage->fill(0);
+        for (const QPoint &cell : activeCellList)
+        {
+            int n = cell.x(), m = cell.y();
+            int count = cellPopulation(n, m);
+            if (count)
+                populationImage->setPixel(n, m, static_cast<uint>((totalFitness[n][m] * static_cast<uint>(multiplier)) / static_cast<uint>(count)));
+        }
         if (currentSelectedMode == 1)
             populationItem->setPixmap(QPixmap::fromImage(*populationImage));
         if (saveMeanFitness->isChecked())
@@ -1668,66 +1645,62 @@ void MainWindow::refreshPopulations()
     if (currentSelectedMode == 2 || saveCodingGenomeAsColour->isChecked())
     {
         //find modal genome in each square, convert to colour
-        for (int n = 0; n < gridX; n++)
-            for (int m = 0; m < gridY; m++)
+        populationImageColour->fill(0); //black if square is empty
+        for (const QPoint &cell : activeCellList)
+        {
+            int n = cell.x(), m = cell.y();
+            //data structure for mode
+            quint64 genomes[SLOTS_PER_GRID_SQUARE];
+            int counts[SLOTS_PER_GRID_SQUARE];
+            int arraypos = 0; //pointer
+
+            //for each used slot
+            for (int c = 0; c < maxUsed[n][m]; c++)
             {
-                //data structure for mode
-                quint64 genomes[SLOTS_PER_GRID_SQUARE];
-                int counts[SLOTS_PER_GRID_SQUARE];
-                int arraypos = 0; //pointer
-
-                if (totalFitness[n][m] == 0) populationImageColour->setPixel(n, m, 0); //black if square is empty
-                else
+                if (critters[n][m][c].age > 0)
                 {
-                    //for each used slot
-                    for (int c = 0; c < maxUsed[n][m]; c++)
-                    {
-                        if (critters[n][m][c].age > 0)
-                        {
-                            //If critter is alive
-
-                            quint64 g = critters[n][m][c].genome;
-
-                            //find genome frequencies
-                            for (int i = 0; i < arraypos; i++)
-                            {
-                                if (genomes[i] == g)   //found it
-                                {
-                                    counts[i]++;
-                                    goto gotcounts;
-                                }
-                            }
-                            //didn't find it
-                            genomes[arraypos] = g;
-                            counts[arraypos++] = 1;
-                        }
-gotcounts:
-                        ;
-                    }
+                    //If critter is alive
 
-                    //find max frequency
-                    int max = -1;
-                    quint64 maxg = 0;
+                    quint64 g = critters[n][m][c].genome;
 
+                    //find genome frequencies
                     for (int i = 0; i < arraypos; i++)
-                        if (counts[i] > max)
+                    {
+                        if (genomes[i] == g)   //found it
                         {
-                            max = counts[i];
-                            maxg = genomes[i];
+                            counts[i]++;
+                            goto gotcounts;
                         }
+                    }
+                    //didn't find it
+                    genomes[arraypos] = g;
+                    counts[arraypos++] = 1;
+                }
+gotcounts:
+                ;
+            }
+
+            //find max frequency
+            int max = -1;
+            quint64 maxg = 0;
 
-                    //now convert first 32 bits to a colour
-                    // r,g,b each counts of 11,11,10 bits
-                    auto genome = static_cast<quint32>((maxg & (static_cast<quint64>(65536) * static_cast<quint64>(65536) - static_cast<quint64>(1))));
-                    quint32 b = bitCounts[genome & 2047] * 23;
-                    genome /= 2048;
-                    quint32 g = bitCounts[genome & 2047] * 23;
-                    genome /= 2048;
-                    quint32 r = bitCounts[genome] * 25;
-                    populationImageColour->setPixel(n, m, qRgb(static_cast<int>(r), static_cast<int>(g), static_cast<int>(b)));
+            for (int i = 0; i < arraypos; i++)
+                if (counts[i] > max)
+                {
+                    max = counts[i];
+                    maxg = genomes[i];
                 }
 
-            }
+            //now convert first 32 bits to a colour
+            // r,g,b each counts of 11,11,10 bits
+            auto genome = static_cast<quint32>((maxg & (static_cast<quint64>(65536) * static_cast<quint64>(65536) - static_cast<quint64>(1))));
+            quint32 b = bitCounts[genome & 2047] * 23;
+            genome /= 2048;
+            quint32 g = bitCounts[genome & 2047] * 23;
+            genome /= 2048;
+            quint32 r = bitCounts[genome] * 25;
+            populationImageColour->setPixel(n, m, qRgb(static_cast<int>(r), static_cast<int>(g), static_cast<int>(b)));
+        }
 
         if (currentSelectedMode == 2)
             populationItem->setPixmap(QPixmap::fromImage(*populationImageColour));
@@ -1740,66 +1713,63 @@ gotcounts:
     if (currentSelectedMode == 3 || saveNonCodingGenomeAsColour->isChecked())
     {
         //find modal genome in each square, convert non-coding to colour
-        for (int n = 0; n < gridX; n++)
-            for (int m = 0; m < gridY; m++)
+        populationImageColour->fill(0); //black if square is empty
+        for (const QPoint &cell : activeCellList)
+        {
+            int n = cell.x(), m = cell.y();
+            //data structure for mode
+            quint64 genomes[SLOTS_PER_GRID_SQUARE];
+            int counts[SLOTS_PER_GRID_SQUARE];
+            int arraypos = 0; //pointer
+
+            //for each used slot
+            for (int c = 0; c < maxUsed[n][m]; c++)
             {
-                //data structure for mode
-                quint64 genomes[SLOTS_PER_GRID_SQUARE];
-                int counts[SLOTS_PER_GRID_SQUARE];
-                int arraypos = 0; //pointer
-
-                if (totalFitness[n][m] == 0) populationImageColour->setPixel(n, m, 0); //black if square is empty
-                else
+                if (critters[n][m][c].age > 0)
                 {
-                    //for each used slot
-                    for (int c = 0; c < maxUsed[n][m]; c++)
+                    //If critter is alive
+
+                    quint64 g = critters[n][m][c].genome;
+
+                    //find genome frequencies
+                    for (int i = 0; i < arraypos; i++)
                     {
-                        if (critters[n][m][c].age > 0)
+                        if (genomes[i] == g)   //found it
                         {
-                            //If critter is alive
-
-                            quint64 g = critters[n][m][c].genome;
-
-                            //find genome frequencies
-                            for (int i = 0; i < arraypos; i++)
-                            {
-                                if (genomes[i] == g)   //found it
-                                {
-                                    counts[i]++;
-                                    goto gotcounts2;
-                                }
-                            }
-                            //didn't find it
-                            genomes[arraypos] = g;
-                            counts[arraypos++] = 1;
+                            counts[i]++;
+                            goto gotcounts2;
                         }
-gotcounts2:
-                        ;
                     }
+                    //didn't find it
+                    genomes[arraypos] = g;
+                    counts[arraypos++] = 1;
+                }
+gotcounts2:
+                ;
+            }
 
 
-                    //find max frequency
-                    int max = -1;
-                    quint64 maxg = 0;
-
-                    for (int i = 0; i < arraypos; i++)
-                        if (counts[i] > max)
-                        {
-                            max = counts[i];
-                            maxg = genomes[i];
-                        }
+            //find max frequency
+            int max = -1;
+            quint64 maxg = 0;
 
-                    //now convert second 32 bits to a colour
-                    // r,g,b each counts of 11,11,10 bits
-                    auto genome = static_cast<quint32>((maxg / (static_cast<quint64>(65536) * static_cast<quint64>(65536))));
-                    quint32 b = bitCounts[genome & 2047] * 23;
-                    genome /= 2048;
-                    quint32 g = bitCounts[genome & 2047] * 23;
-                    genome /= 2048;
-                    quint32 r = bitCounts[genome] * 25;
-                    populationImageColour->setPixel(n, m, qRgb(static_cast<int>(r), static_cast<int>(g), static_cast<int>(b)));
+            for (int i = 0; i < arraypos; i++)
+                if (counts[i] > max)
+                {
+                    max = counts[i];
+                    maxg = genomes[i];
                 }
-            }
+
+            //now convert second 32 bits to a colour
+            // r,g,b each counts of 11,11,10 bits
+            auto genome = static_cast<quint32>((maxg / (static_cast<quint64>(65536) * static_cast<quint64>(65536))));
+            quint32 b = bitCounts[genome & 2047] * 23;
+            genome /= 2048;
+            quint32 g = bitCounts[genome & 2047] * 23;
+            genome /= 2048;
+            quint32 r = bitCounts[genome] * 25;
+            populationImageColour->setPixel(n, m, qRgb(static_cast<int>(r), static_cast<int>(g), static_cast<int>(b)));
+        }
 
         if (currentSelectedMode == 3)
             populationItem->setPixmap(QPixmap::fromImage(*populationImageColour));
@@ -1812,32 +1782,32 @@ gotcounts2:
     if (currentSelectedMode == 4 || saveGeneFrequencies->isChecked())
     {
         //Popcount
-        for (int n = 0; n < gridX; n++)
-            for (int m = 0; m < gridY; m++)
+        populationImageColour->fill(qRgb(0, 0, 0));
+        for (const QPoint &cell : activeCellList)
+        {
+            int n = cell.x(), m = cell.y();
+            int count = 0;
+            int gen0tot = 0;
+            int gen1tot = 0;
+            int gen2tot = 0;
+            for (int c = 0; c <= maxUsed[n][m]; c++)
             {
-                int count = 0;
-                int gen0tot = 0;
-                int gen1tot = 0;
-                int gen2tot = 0;
-                for (int c = 0; c < slotsPerSquare; c++)
-                {
-                    if (critters[n][m][c].age)
-                    {
-                        count++;
-                        if (critters[n][m][c].genome & 1) gen0tot++;
-                        if (critters[n][m][c].genome & 2) gen1tot++;
-                        if (critters[n][m][c].genome & 4) gen2tot++;
-                    }
-                }
-                if (count == 0) populationImageColour->setPixel(n, m, qRgb(0, 0, 0));
-                else
+                if (critters[n][m][c].age)
                 {
-                    quint32 r = static_cast<quint32>(gen0tot * 256 / count);
-                    quint32 g = static_cast<quint32>(gen1tot * 256 / count);
-                    quint32 b = static_cast<quint32>(gen2tot * 256 / count);
-                    populationImageColour->setPixel(n, m, qRgb(static_cast<int>(r), static_cast<int>(g), static_cast<int>(b)));
+                    count++;
+                    if (critters[n][m][c].genome & 1) gen0tot++;
+                    if (critters[n][m][c].genome & 2) gen1tot++;
+                    if (critters[n][m][c].genome & 4) gen2tot++;
                 }
             }
+            if (count)
+            {
+                quint32 r = static_cast<quint32>(gen0tot * 256 / count);
+                quint32 g = static_cast<quint32>(gen1tot * 256 / count);
+                quint32 b = static_cast<quint32>(gen2tot * 256 / count);
+                populationImageColour->setPixel(n, m, qRgb(static_cast<int>(r), static_cast<int>(g), static_cast<int>(b)));
+            }
+        }
 
         if (currentSelectedMode == 4)
             populationItem->setPixmap(QPixmap::fromImage(*populationImageColour));
@@ -1971,27 +1941,24 @@ gotcounts2:
     // (10) Species
     if (currentSelectedMode == 10 || saveSpecies->isChecked())   //do visualisation if necessary
     {
-        for (int n = 0; n < gridX; n++)
-            for (int m = 0; m < gridY; m++)
-            {
+        populationImageColour->fill(0); //black if square is empty
+        for (const QPoint &cell : activeCellList)
+        {
+            int n = cell.x(), m = cell.y();
 
-                if (totalFitness[n][m] == 0) populationImageColour->setPixel(n, m, 0); //black if square is empty
-                else
+            quint64 thisspecies = 0;
+            for (int c = 0; c < slotsPerSquare; c++)
+            {
+                if (critters[n][m][c].age > 0)
                 {
-                    quint64 thisspecies = 0;
-                    for (int c = 0; c < slotsPerSquare; c++)
-                    {
-                        if (critters[n][m][c].age > 0)
-                        {
-                            thisspecies = critters[n][m][c].speciesID;
-                            break;
-                        }
-                    }
-
-                    populationImageColour->setPixel(n, m, speciesColours[thisspecies % 65536]);
+                    thisspecies = critters[n][m][c].speciesID;
+                    break;
                 }
             }
 
+            populationImageColour->setPixel(n, m, speciesColours[thisspecies % 65536]);
+        }
+
         if (currentSelectedMode == 10)
             populationItem->setPixmap(QPixmap::fromImage(*populationImageColour));
         if (saveSpecies->isChecked())
@@ -2105,20 +2072,8 @@ void MainWindow::writeRunData()
     if (batchRunning)
         FinalLoggingFile.append(QString("_run_%1").arg(batchRuns, 4, 10, QChar('0')));
     FinalLoggingFile.append(".txt");
-    QFile outputfile(FinalLoggingFile);
-    outputfile.open(QIODevice::WriteOnly | QIODevice::Text);
-    QTextStream out(&outputfile);
 
-    out << "End run log ";
-    QDateTime t(QDateTime::currentDateTime());
-    out << t.toString(Qt::ISODate) << "\n\n===================\n\n" << printSettings() <<
-        "\n\n===================\n";
-    out << "\nThis log features the tree from a finished run, in Newick format, and then data for all the species that have existed with more individuals than minimum species size. The exact data provided depends on the phylogeny tracking mode selected in the GUI.\n";
-    out << "\n\n===================\n\n";
-    out << "Tree:\n\n" << handleAnalysisTool(ANALYSIS_TOOL_CODE_MAKE_NEWICK);
-    out << "\n\nSpecies data:\n\n";
-    out << handleAnalysisTool(ANALYSIS_TOOL_CODE_WRITE_DATA);
-    outputfile.close();
+    simulationManager->writeRunData(FinalLoggingFile);
 }
 
 /*!
@@ -2222,8 +2177,10 @@ void MainWindow::speciesModeChanged(int changeSpeciesMode, bool updateGUI)
  */
 void MainWindow::resetSquare(int n, int m)
 {
-    //grid expanded - make sure everything is zeroed in new slots
-    for (int c = 0; c < slotsPerSquare; c++) critters[n][m][c].age = 0;
+    //grid expanded - make sure everything is zeroed in new slots. Only slots up to maxUsed can be alive, so those are all
+    //that need it - the rest of a new square's tiles are left untouched
+    for (int c = 0; c <= maxUsed[n][m]; c++) critters[n][m][c].age = 0;
+    maxUsed[n][m] = -1;
 
     totalFitness[n][m] = 0;
 
@@ -2259,10 +2216,8 @@ void MainWindow::resizeImageObjects()
  */
 void MainWindow::redoImages(int oldRows, int oldColumns)
 {
-    //check that the maxUsed's are in the new range
-    for (int n = 0; n < gridX; n++)
-        for (int m = 0; m < gridY; m++)
-            if (maxUsed[n][m] >= slotsPerSquare) maxUsed[n][m] = slotsPerSquare - 1;
+    //resize the arena arrays first - keeps everything that still fits
+    simulationManager->allocateArrays();
 
     //If either rows or cols are bigger - make sure age is set to 0 in all critters in new bit!
     if (gridX > oldRows)
@@ -2278,6 +2233,9 @@ void MainWindow::redoImages(int oldRows, int oldColumns)
                 resetSquare(n, m);
     }
 
+    //occupancy and maxUsed to match
+    simulationManager->rebuildOccupancy();
+
     resizeImageObjects();
 
     refreshPopulations();
@@ -2354,7 +2312,7 @@ bool MainWindow::loadEnvironmentFiles()
                             this,
                             "Select one or more image files to load in simulation environment...",
                             "",
-                            "Images (*.png *.bmp)"
+                            "Images (*.png *.bmp *." STACK_SUFFIX ")"
                         );
 
     if (files.length() == 0) return false;
@@ -2363,9 +2321,19 @@ bool MainWindow::loadEnvironmentFiles()
     bool different_size = false;
     for (int i = 0; i < files.length(); i++)
     {
-        QImage LoadImage(files[i]);
-        int x = LoadImage.width();
-        int y = LoadImage.height();
+        int x, y;
+        EnvironmentStack stack;
+        if (EnvironmentStack::isStack(files[i]) && stack.open(files[i]))
+        {
+            x = stack.width();
+            y = stack.height();
+        }
+        else
+        {
+            QImage LoadImage(files[i]);
+            x = LoadImage.width();
+            y = LoadImage.height();
+        }
         if (x != y)notsquare = true;
         if (x != 100 || y != 100)different_size = true;
     }
@@ -2378,7 +2346,7 @@ bool MainWindow::loadEnvironmentFiles()
             + QString(EMAIL) + " with this message or go to " + QString(GITURL) + QString(GITREPOSITORY) + QString(GITISSUE) + " and raise a feature request."
         );
 
-    environmentFiles = files;
+    environmentFiles = EnvironmentStack::expandFiles(files);
     currentEnvironmentFile = 0;
     simulationManager->loadEnvironmentFromFile(environmentMode);
     refreshEnvironment();
@@ -2397,7 +2365,7 @@ bool MainWindow::loadEnvironmentFiles()
 /*!
  * \brief MainWindow::saveSimulation
  *
- * Action to save the current settings and simulation to an .revosim file.
+ * Action to save the current settings and simulation to an .revosim file (see Checkpoint for the format).
  *
  */
 void MainWindow::saveSimulation()
@@ -2412,50 +2380,21 @@ void MainWindow::saveSimulation()
     if (filename.length() == 0)
         return;
 
-    //Otherwise - serialise all my crap
-    QFile outfile(filename);
-    outfile.open(QIODevice::WriteOnly | QIODevice::Text);
-
-    QDataStream out(&outfile);
+    QString error;
+    if (!Checkpoint::save(filename, saveGUIState(), true, &error))
+        QMessageBox::warning(this, "Error", error);
+}
 
-    out << QString("REvoSim Format File");
-    out << static_cast<int>(FILEVERSION);
+/*!
+ * \brief MainWindow::saveGUIState
+ * \return the GUI's own settings and window state, kept in the GUI chunk of a saved simulation
+ */
+QByteArray MainWindow::saveGUIState()
+{
+    QByteArray state;
+    QDataStream out(&state, QIODevice::WriteOnly);
 
-    //Ints
-    out << gridX;
-    out << gridY;
-    out << settleTolerance;
-    out << slotsPerSquare;
-    out << startAge;
-    out << dispersal;
-    out << food;
-    out << breedCost;
-    out << mutate;
-    out << maxDifference;
-    out << breedThreshold;
-    out << target;
-    out << environmentChangeRate;
-    out << environmentMode;
     out << refreshRate;
-    out << speciesSamples;
-    out << speciesSensitivity;
-    out << timeSliceConnect;
-    out << minSpeciesSize;
-    out << speciesMode;
-
-    //Bools
-    out << recalculateFitness;
-    out << toroidal;
-    out << nonspatial;
-    out << breedDifference;
-    out << breedSpecies;
-    out << allowExcludeWithDescendants;
-    out << sexual;
-    out << asexual;
-    out << logging;
-    out << gui;
-    out << environmentInterpolate;
-    out << fitnessLoggingToFile;
     out << autowriteLogCheckbox->isChecked();
     out << savePopulationCount->isChecked();
     out << saveMeanFitness->isChecked();
@@ -2466,136 +2405,74 @@ void MainWindow::saveSimulation()
     out << saveSettles->isChecked();
     out << saveFailsSettles->isChecked();
     out << saveEnvironment->isChecked();
-
-    //Strings
     out << globalSavePath->text();
-
-    int vmode = 0;
-    vmode = ui->populationWindowComboBox->itemData(ui->populationWindowComboBox->currentIndex()).toInt();
-    out << vmode;
-
-    //file list
-    out << environmentFiles.count();
-    for (int i = 0; i < environmentFiles.count(); i++)
-        out << environmentFiles[i];
-
-    //now the big arrays
-    for (int i = 0; i < gridX; i++)
-        for (int j = 0; j < gridY; j++)
-            for (int k = 0; k < slotsPerSquare; k++)
-            {
-                if ((critters[i][j][k]).age == 0) //its dead
-                    out << static_cast<int>(0);
-                else
-                {
-                    out << critters[i][j][k].age;
-                    out << critters[i][j][k].genome;
-                    out << critters[i][j][k].fitness;
-                    out << critters[i][j][k].energy;
-                    out << critters[i][j][k].xPosition;
-                    out << critters[i][j][k].yPosition;
-                    out << critters[i][j][k].zPosition;
-                }
-            }
-
-    for (int i = 0; i < gridX; i++)
-        for (int j = 0; j < gridY; j++)
-        {
-            out << environment[i][j][0];
-            out << environment[i][j][1];
-            out << environment[i][j][2];
-        }
-
-    for (int i = 0; i < gridX; i++)
-        for (int j = 0; j < gridY; j++)
-        {
-            out << totalFitness[i][j];
-        }
-
-    for (auto &xormask : xorMasks)
-        for (int j = 0; j < 3; j++)
-        {
-            out << xormask[j];
-        }
-
-    //ARTS - Genome Comparison Saving
+    out << ui->populationWindowComboBox->itemData(ui->populationWindowComboBox->currentIndex()).toInt();
+    out << saveState(); //window state
+    out << ui->actionGenomeComparison->isChecked();
     out << genoneComparison->saveComparison();
 
-    for (int i = 0; i < gridX; i++)
-        for (int j = 0; j < gridY; j++)
-        {
-            out << breedAttempts[i][j];
-            out << breedFails[i][j];
-            out << settles[i][j];
-            out << settleFails[i][j];
-            out << maxUsed[i][j];
-        }
+    return state;
+}
 
-    //And some window state stuff
-    out << saveState(); //window state
-    out << ui->actionGenomeComparison->isChecked();
+/*!
+ * \brief MainWindow::restoreGUIState
+ * \param state as from saveGUIState() - ignored if empty, e.g. a simulation saved from the command line
+ */
+void MainWindow::restoreGUIState(const QByteArray &state)
+{
+    if (state.isEmpty())
+        return;
 
-    //interpolate environment stuff
-    out << environmentInterpolate;
-    for (int i = 0; i < gridX; i++)
-        for (int j = 0; j < gridY; j++)
-        {
-            out << environmentLast[i][j][0];
-            out << environmentLast[i][j][1];
-            out << environmentLast[i][j][2];
-        }
-    for (int i = 0; i < gridX; i++)
-        for (int j = 0; j < gridY; j++)
-        {
-            out << environmentNext[i][j][0];
-            out << environmentNext[i][j][1];
-            out << environmentNext[i][j][2];
-        }
+    QDataStream in(state);
 
-    out << speciesSamples;
-    out << speciesSensitivity;
-    out << timeSliceConnect;
+    in >> refreshRate;
+    bool in_bool;
+    in >> in_bool;
+    autowriteLogCheckbox->setChecked(in_bool);
+    in >> in_bool;
+    savePopulationCount->setChecked(in_bool);
+    in >> in_bool;
+    saveMeanFitness->setChecked(in_bool);
+    in >> in_bool;
+    saveCodingGenomeAsColour->setChecked(in_bool);
+    in >> in_bool;
+    saveSpecies->setChecked(in_bool);
+    in >> in_bool;
+    saveNonCodingGenomeAsColour->setChecked(in_bool);
+    in >> in_bool;
+    saveGeneFrequencies->setChecked(in_bool);
+    in >> in_bool;
+    saveSettles->setChecked(in_bool);
+    in >> in_bool;
+    saveFailsSettles->setChecked(in_bool);
+    in >> in_bool;
+    saveEnvironment->setChecked(in_bool);
 
-    //now the species archive
-    out << oldSpeciesList.count();
-    for (int j = 0; j < oldSpeciesList.count(); j++)
-    {
-        out << oldSpeciesList[j].ID;
-        out << oldSpeciesList[j].type;
-        out << oldSpeciesList[j].originTime;
-        out << oldSpeciesList[j].parent;
-        out << oldSpeciesList[j].size;
-        out << oldSpeciesList[j].internalID;
-    }
+    QString load_path;
+    in >> load_path;
+    globalSavePath->setText(load_path);
 
-    out << archivedSpeciesLists.count();
-    for (int i = 0; i < archivedSpeciesLists.count(); i++)
-    {
-        out << archivedSpeciesLists[i].count();
-        for (int j = 0; j < archivedSpeciesLists[i].count(); j++)
-        {
-            out << archivedSpeciesLists[i][j].ID;
-            out << archivedSpeciesLists[i][j].type;
-            out << archivedSpeciesLists[i][j].originTime;
-            out << archivedSpeciesLists[i][j].parent;
-            out << archivedSpeciesLists[i][j].size;
-            out << archivedSpeciesLists[i][j].internalID;
-        }
-    }
-    out << nextSpeciesID;
-    out << lastSpeciesCalculated;
+    int vmode;
+    in >> vmode;
+    int index = ui->populationWindowComboBox->findData(vmode);
+    if (index != -1)   // -1 for not found
+        ui->populationWindowComboBox->setCurrentIndex(index);
 
-    //now random number array
-    for (unsigned char random : randoms)
-        out << random;
+    QByteArray Temp;
+    in >> Temp;
+    restoreState(Temp); //window state
 
-    outfile.close();
+    in >> in_bool;
+    ui->actionGenomeComparison->setChecked(in_bool);
+
+    in >> Temp;
+    genoneComparison->loadComparison(Temp);
 }
 
 /*!
  * \brief MainWindow::loadSimulation
  *
- * Load a REvoSim file of saved settings and simulations.
+ * Load a REvoSim file of saved settings and simulations - either format.
  *
  * \todo RJG - Fitness logging to file not sorted on load as yet.
  */
@@ -2614,6 +2491,37 @@ void MainWindow::loadSimulation()
     if (!stopFlag)
         stopFlag = true;
 
+    if (Checkpoint::isCheckpoint(filename))
+    {
+        QByteArray state;
+        QString error;
+        if (!Checkpoint::load(filename, &state, &error))
+        {
+            QMessageBox::warning(this, "", error);
+            return;
+        }
+        restoreGUIState(state);
+    }
+    else if (!loadSimulationVersion1(filename))
+        return;
+
+    nextRefresh = 0;
+    resizeImageObjects();
+    report();
+    resize();
+
+    updateGUIFromVariables();
+}
+
+/*!
+ * \brief MainWindow::loadSimulationVersion1
+ * \param filename
+ * \return false if this is not an REvoSim file
+ *
+ * Load a simulation saved in the FILEVERSION 1 format - every slot of every square written field by field.
+ */
+bool MainWindow::loadSimulationVersion1(const QString &filename)
+{
     //Otherwise - serialise all my crap
     QFile infile(filename);
     infile.open(QIODevice::ReadOnly);
@@ -2625,12 +2533,12 @@ void MainWindow::loadSimulation()
     if (strtemp != "REvoSim Format File")
     {
         QMessageBox::warning(this, "", "Not an REvoSim Format File.");
-        return;
+        return false;
     }
 
     int version;
     in >> version;
-    if (version > FILEVERSION)
+    if (version > 1)
     {
         QMessageBox::warning(this, "", "Version too high - will try to read, but may go horribly wrong.");
     }
@@ -2744,20 +2652,29 @@ void MainWindow::loadSimulation()
         environmentFiles.append(t);
     }
 
+    //make sure the arrays match the grid we have just read
+    simulationManager->allocateArrays();
+
     //now the big arrays
     for (int i = 0; i < gridX; i++)
         for (int j = 0; j < gridY; j++)
             for (int k = 0; k < slotsPerSquare; k++)
             {
-                in >> critters[i][j][k].age;
-                if (critters[i][j][k].age > 0)
+                Critter critter = critters[i][j][k];
+                int age, fitness, energy, position;
+                in >> age;
+                critter.age = static_cast<quint16>(age);
+                if (age > 0)
                 {
-                    in >> critters[i][j][k].genome;
-                    in >> critters[i][j][k].fitness;
-                    in >> critters[i][j][k].energy;
-                    in >> critters[i][j][k].xPosition;
-                    in >> critters[i][j][k].yPosition;
-                    in >> critters[i][j][k].zPosition;
+                    in >> critter.genome;
+                    in >> fitness;
+                    in >> energy;
+                    critter.fitness = static_cast<quint8>(fitness);
+                    critter.energy = energy;
+                    //RJG - position is implied by the slot, so discard the stored copy
+                    in >> position;
+                    in >> position;
+                    in >> position;
                 }
             }
 
@@ -2824,6 +2741,10 @@ void MainWindow::loadSimulation()
             in >> environmentNext[i][j][2];
         }
 
+    //environment and masks replaced - work out every square's fitness afresh
+    simulationManager->invalidateEnvironment();
+    simulationManager->rebuildOccupancy();
+
     in >> speciesSamples;
     in >> speciesSensitivity;
     in >> timeSliceConnect;
@@ -2876,12 +2797,7 @@ void MainWindow::loadSimulation()
         in >> random;
 
     infile.close();
-    nextRefresh = 0;
-    resizeImageObjects();
-    report();
-    resize();
-
-    updateGUIFromVariables();
+    return true;
 }
 
 /*!
@@ -2910,26 +2826,6 @@ bool MainWindow::genomeComparisonAdd()
     return false;
 }
 
-/*!
- * \brief MainWindow::calculateSpecies
- */
-void MainWindow::calculateSpecies()
-{
-    if (speciesMode == SPECIES_MODE_NONE) return; //do nothing!
-
-    if (iteration != lastSpeciesCalculated)
-    {
-        delete analyser;  //replace old analyser object with new
-        analyser = new Analyser;
-
-        //New species analyser
-        analyser->groupsGenealogicalTracker();
-
-        //Makre sure this is updated
-        lastSpeciesCalculated = iteration;
-    }
-}
-
 /*!
  * \brief MainWindow::writeLog
  *
@@ -2947,80 +2843,8 @@ void MainWindow::writeLog()
         if (batchRunning)
             speciesLoggingFile.append(QString("_run_%1").arg(batchRuns, 4, 10, QChar('0')));
         speciesLoggingFile.append(".txt");
-        QFile outputfile(speciesLoggingFile);
 
-        if (iteration == 0)
-        {
-            outputfile.open(QIODevice::WriteOnly | QIODevice::Text);
-            QTextStream out(&outputfile);
-            out << "New run ";
-            QDateTime t(QDateTime::currentDateTime());
-            out << t.toString(Qt::ISODate) << "\n\n";
-            out << "===================\n\n";
-            out << printSettings();
-            out << "\n\n";
-            out << "===================\n";
-            out << "\nFor each iteration, this log features:\n\n";
-            out << "- [I] Iteration Number\n";
-            out << "- [P] Population Grid Data:\n";
-            out << "-- Number of living digital organisms\n";
-            out << "-- Mean fitness of living digital organisms\n";
-            out << "-- Number of entries on the breed list\n";
-            out << "-- Number of failed breed attempts\n";
-            out << "-- Number of species\n";
-            out << "- [S] Species Data:\n";
-            out << "-- Species id\n";
-            out << "-- Species origin (iterations)\n";
-            out << "-- Species parent\n";
-            out << "-- Species current size (number of individuals)\n";
-            out << "-- Species current genome (for speed this is the genome of a randomly sampled individual, not the modal organism)\n\n";
-            out << "**Note that this excludes species with less individuals than Minimum species size, but is not able to exlude species without descendants, which can only be achieved with the end-run log.**\n\n";
-            out << "===================\n\n";
-            outputfile.close();
-        }
-
-        outputfile.open(QIODevice::Append | QIODevice::Text);
-        QTextStream out(&outputfile);
-
-        out << "[I] " << iteration << "\n";
-
-        int gridNumberAlive = 0, gridTotalFitness = 0, gridBreedEntries = 0, gridBreedFails = 0;
-        for (int i = 0; i < gridX; i++)
-            for (int j = 0; j < gridY; j++)
-            {
-                gridTotalFitness += totalFitness[i][j];
-                //----RJG: Manually count breed stufffor grid
-                gridBreedEntries += breedAttempts[i][j];
-                gridBreedFails += breedFails[i][j];
-                //----RJG: Manually count number alive thanks to maxUsed descendants
-                for  (int k = 0; k < slotsPerSquare; k++)if (critters[i][j][k].fitness)gridNumberAlive++;
-            }
-        double meanFitness = double(gridTotalFitness) / double(gridNumberAlive);
-
-        out << "[P] " << gridNumberAlive << "," << meanFitness << "," << gridBreedEntries << "," <<
-            gridBreedFails << "," << oldSpeciesList.count() << "\n";
-
-        //----RJG: And species details for each iteration
-        for (int i = 0; i < oldSpeciesList.count(); i++)
-        {
-            //----RJG: Unable to exclude species without descendants, for obvious reasons.
-            if (quint64(oldSpeciesList[i].size) > minSpeciesSize)
-            {
-                out << "[S] ";
-                out << (oldSpeciesList[i].ID) << ",";
-                out << oldSpeciesList[i].originTime << ",";
-                out << oldSpeciesList[i].parent << ",";
-                out << oldSpeciesList[i].size << ",";
-                //---- RJG - output binary genome if needed
-                for (int j = 0; j < 63; j++)if (tweakers64[63 - j] & oldSpeciesList[i].type) out << "1";
-                    else out << "0";
-                if (tweakers64[0] & oldSpeciesList[i].type) out << "1";
-                else out << "0";
-                out << "\n";
-            }
-        }
-        out << "\n";
-        outputfile.close();
+        simulationManager->writeLog(speciesLoggingFile);
     }
 }
 
@@ -3141,54 +2965,6 @@ QString MainWindow::handleAnalysisTool(int code)
     return OutputString;
 }
 
-/*!
- * \brief MainWindow::printSettings
- * \return text
- */
-QString MainWindow::printSettings()
-{
-    QString settings;
-    QTextStream settingsOut(&settings);
-
-    settingsOut << "REvoSim settings:\n\n";
-
-    settingsOut << "- Integers:\n";
-    settingsOut << "-- Grid X: " << gridX << "\n";
-    settingsOut << "-- Grid Y: " << gridY << "\n";
-    settingsOut << "-- Settle tolerance: " << settleTolerance << "\n";
-    settingsOut << "-- Start age: " << startAge << "\n";
-    settingsOut << "-- Disperal: " << dispersal << "\n";
-    settingsOut << "-- Food: " << food << "\n";
-    settingsOut << "-- Breed cost: " << breedCost << "\n";
-    settingsOut << "-- Mutate: " << mutate << "\n";
-    settingsOut << "-- Max diff to breed: " << maxDifference << "\n";
-    settingsOut << "-- Breed threshold: " << breedThreshold << "\n";
-    settingsOut << "-- Slots per square: " << slotsPerSquare << "\n";
-    settingsOut << "-- Fitness target: " << target << "\n";
-    settingsOut << "-- Environmental change rate: " << environmentChangeRate << "\n";
-    settingsOut << "-- Minimum species size:" << minSpeciesSize << "\n";
-    settingsOut << "-- Environment mode:" << environmentMode << "\n";
-    settingsOut << "-- Speices mode:" << speciesMode << "\n";
-
-    settingsOut << "\n- Bools:\n";
-    settingsOut << "-- Recalculate fitness: " << recalculateFitness << "\n";
-    settingsOut << "-- Toroidal environment: " << toroidal << "\n";
-    settingsOut << "-- Interpolate environment: " << environmentInterpolate << "\n";
-    settingsOut << "-- Nonspatial setling: " << nonspatial << "\n";
-    settingsOut << "-- Enforce max diff to breed:" << breedDifference << "\n";
-    settingsOut << "-- Only breed within species:" << breedSpecies << "\n";
-    settingsOut << "-- Exclude species without descendants:" << allowExcludeWithDescendants << "\n";
-    settingsOut << "-- Breeding: ";
-    if (sexual)
-        settingsOut << "sexual" << "\n";
-    else if (asexual)
-        settingsOut << "asexual" << "\n";
-    else
-        settingsOut << "variable" << "\n";
-
-    return settings;
-}
-
 /*!
  * \brief MainWindow::loadSettings
  *
@@ -3219,77 +2995,13 @@ void MainWindow::loadSettings()
             continue;
         if (token == QXmlStreamReader::StartElement)
         {
-            //Ints
             if (settingsFileIn.name() == "revosim")
                 continue;
-            if (settingsFileIn.name() == "gridX")
-                gridX = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "gridY")
-                gridY = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "settleTolerance")
-                settleTolerance = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "slotsPerSquare")
-                slotsPerSquare = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "startAge")
-                startAge = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "dispersal")
-                dispersal = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "food")
-                food = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "breedCost")
-                breedCost = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "mutate")
-                mutate = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "maxDifference")
-                maxDifference = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "breedThreshold")
-                breedThreshold = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "target")
-                target = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "environmentChangeRate")
-                environmentChangeRate = settingsFileIn.readElementText().toInt();
+            //RJG - Simulation settings are shared with the command line build, so are read by the simulation manager
+            if (simulationManager->loadSettingsElement(settingsFileIn))
+                continue;
             if (settingsFileIn.name() == "refreshRate")
                 refreshRate = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "environmentMode")
-                environmentModeChanged(settingsFileIn.readElementText().toInt(), true);
-            //No Gui options for the remaining settings as yet.
-            if (settingsFileIn.name() == "speciesSamples")
-                speciesSamples = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "speciesSensitivity")
-                speciesSensitivity = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "timeSliceConnect")
-                timeSliceConnect = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "minSpeciesSize")
-                minSpeciesSize = static_cast<quint64>(settingsFileIn.readElementText().toInt());
-            if (settingsFileIn.name() == "speciesMode")
-                minSpeciesSize = static_cast<quint64>(settingsFileIn.readElementText().toInt());
-
-            //Bools
-            if (settingsFileIn.name() == "recalculateFitness")
-                recalculateFitness = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "toroidal")
-                toroidal = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "nonspatial")
-                nonspatial = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "breedDifference")
-                breedDifference = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "breedSpecies")
-                breedSpecies = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "allowExcludeWithDescendants")
-                allowExcludeWithDescendants = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "sexual")
-                sexual = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "asexual")
-                asexual = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "logging")
-                logging = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "gui")
-                gui = settingsFileIn.readElementText().toInt();
-            if (settingsFileIn.name() == "environmentInterpolate")
-                environmentInterpolate = settingsFileIn.readElementText().toInt();
-            //No gui options for below
-            if (settingsFileIn.name() == "fitnessLoggingToFile")
-                fitnessLoggingToFile = settingsFileIn.readElementText().toInt();
             //Only GUI options
             if (settingsFileIn.name() == "autowrite")
                 autowriteLogCheckbox->setChecked(settingsFileIn.readElementText().toInt());
@@ -3502,6 +3214,30 @@ void MainWindow::saveSettings()
     settingsFileOut.writeCharacters(QString("%1").arg(allowExcludeWithDescendants));
     settingsFileOut.writeEndElement();
 
+    settingsFileOut.writeStartElement("hugePages");
+    settingsFileOut.writeCharacters(QString("%1").arg(hugePages));
+    settingsFileOut.writeEndElement();
+
+    settingsFileOut.writeStartElement("gridLayout");
+    settingsFileOut.writeCharacters(QString("%1").arg(gridLayout));
+    settingsFileOut.writeEndElement();
+
+    settingsFileOut.writeStartElement("randomSeed");
+    settingsFileOut.writeCharacters(QString("%1").arg(randomSeed));
+    settingsFileOut.writeEndElement();
+
+    settingsFileOut.writeStartElement("threadCount");
+    settingsFileOut.writeCharacters(QString("%1").arg(threadCount));
+    settingsFileOut.writeEndElement();
+
+    settingsFileOut.writeStartElement("pinThreads");
+    settingsFileOut.writeCharacters(QString("%1").arg(pinThreads));
+    settingsFileOut.writeEndElement();
+
+    settingsFileOut.writeStartElement("numaPlacement");
+    settingsFileOut.writeCharacters(QString("%1").arg(numaPlacement));
+    settingsFileOut.writeEndElement();
+
     settingsFileOut.writeStartElement("sexual");
     settingsFileOut.writeCharacters(QString("%1").arg(sexual));
     settingsFileOut.writeEndElement();
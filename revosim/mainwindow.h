@@ -27,7 +27,9 @@
 #include <QAction>
 #include <QActionGroup>
 #include <QCheckBox>
+#include <QGraphicsPixmapItem>
 #include <QMainWindow>
+#include <QPlainTextEdit>
 #include <QProgressBar>
 #include <QRadioButton>
 #include <QShortcut>
@@ -74,8 +76,6 @@ protected:
     void resizeEvent(QResizeEvent *e);
 
 private:
-    Analyser *analyser;
-
     void closeEvent(QCloseEvent *e);
     void report();
     void runSetUp();
@@ -86,12 +86,13 @@ private:
     void resizeImageObjects();
     void writeLog();
     void simulationDead();
-    void calculateSpecies();
     void restartTimer();
     int scaleFails(int fails, float generations);
     int waitUntilPauseSignalIsEmitted();
     QString handleAnalysisTool(int code);
-    QString printSettings();
+    QByteArray saveGUIState();
+    void restoreGUIState(const QByteArray &state);
+    bool loadSimulationVersion1(const QString &filename);
 
     bool stopFlag{};
     bool pauseFlag;
@@ -0,0 +1,165 @@
+/**
+ * @file
+ * Perf Counters
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#include "perfcounters.h"
+
+#ifdef Q_OS_LINUX
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief openCounter
+ *
+ * One hardware counter on the calling thread, any CPU, user space only. Starts disabled.
+ *
+ * @return file descriptor, or -1
+ */
+static int openCounter(quint32 type, quint64 config)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+/**
+ * @brief readCounter
+ * @return the count, or 0 if it can't be read
+ */
+static quint64 readCounter(int fd)
+{
+    quint64 value = 0;
+    if (read(fd, &value, sizeof(value)) != static_cast<ssize_t>(sizeof(value))) return 0;
+    return value;
+}
+#endif
+
+/**
+ * @brief PerfCounters::PerfCounters
+ */
+PerfCounters::PerfCounters()
+{
+    cacheFd = -1;
+    tlbFd = -1;
+    cacheCount = 0;
+    tlbCount = 0;
+}
+
+/**
+ * @brief PerfCounters::~PerfCounters
+ */
+PerfCounters::~PerfCounters()
+{
+    close();
+}
+
+/**
+ * @brief PerfCounters::open
+ *
+ * Must be called from the thread to be counted - counts are per thread, wherever it runs.
+ *
+ * @return true if both counters could be opened
+ */
+bool PerfCounters::open()
+{
+    close();
+#ifdef Q_OS_LINUX
+    cacheFd = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    tlbFd = openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    if (cacheFd < 0 || tlbFd < 0) close();
+#endif
+    return isOpen();
+}
+
+/**
+ * @brief PerfCounters::close
+ */
+void PerfCounters::close()
+{
+#ifdef Q_OS_LINUX
+    if (cacheFd >= 0)::close(cacheFd);
+    if (tlbFd >= 0)::close(tlbFd);
+#endif
+    cacheFd = -1;
+    tlbFd = -1;
+    cacheCount = 0;
+    tlbCount = 0;
+}
+
+/**
+ * @brief PerfCounters::isOpen
+ * @return
+ */
+bool PerfCounters::isOpen() const
+{
+    return cacheFd >= 0 && tlbFd >= 0;
+}
+
+/**
+ * @brief PerfCounters::start
+ *
+ * Count from here to the next stop() - a no op if not open
+ */
+void PerfCounters::start()
+{
+#ifdef Q_OS_LINUX
+    if (!isOpen()) return;
+    ioctl(cacheFd, PERF_EVENT_IOC_ENABLE, 0);
+    ioctl(tlbFd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+/**
+ * @brief PerfCounters::stop
+ */
+void PerfCounters::stop()
+{
+#ifdef Q_OS_LINUX
+    if (!isOpen()) return;
+    ioctl(cacheFd, PERF_EVENT_IOC_DISABLE, 0);
+    ioctl(tlbFd, PERF_EVENT_IOC_DISABLE, 0);
+    cacheCount = readCounter(cacheFd);
+    tlbCount = readCounter(tlbFd);
+#endif
+}
+
+/**
+ * @brief PerfCounters::cacheMisses
+ * @return last level cache misses counted between start() and stop() since open()
+ */
+quint64 PerfCounters::cacheMisses() const
+{
+    return cacheCount;
+}
+
+/**
+ * @brief PerfCounters::tlbMisses
+ * @return data TLB load misses counted between start() and stop() since open()
+ */
+quint64 PerfCounters::tlbMisses() const
+{
+    return tlbCount;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file
+ * Header: Perf Counters
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <QtGlobal>
+
+/**
+ * @brief The PerfCounters class
+ *
+ * Hardware cache and TLB miss counts for the thread that opened them - Linux only (perf_event_open). Elsewhere, or
+ * where the kernel won't allow it (see /proc/sys/kernel/perf_event_paranoid), isOpen() is false and the counts are 0.
+ */
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    bool open();
+    void close();
+    bool isOpen() const;
+
+    void start();
+    void stop();
+    quint64 cacheMisses() const;
+    quint64 tlbMisses() const;
+
+private:
+    Q_DISABLE_COPY(PerfCounters)
+
+    int cacheFd; //-1 = not open
+    int tlbFd;
+    quint64 cacheCount; //totals since open()
+    quint64 tlbCount;
+};
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,61 @@
+/**
+ * @file
+ * Header: Philox
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <QtGlobal>
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+/**
+ * @brief The Philox class
+ *
+ * Philox4x32-10 counter based random numbers (Salmon et al. 2011, "Parallel random numbers: as easy as 1, 2, 3").
+ * There's no state to share - the same key and counter always give the same 128 bits - so any thread can make the
+ * numbers for any critter, in any order.
+ */
+class Philox
+{
+public:
+    static inline void generate(quint64 key, quint32 c0, quint32 c1, quint32 c2, quint32 c3, quint32 *out)
+    {
+        auto k0 = static_cast<quint32>(key);
+        auto k1 = static_cast<quint32>(key >> 32);
+
+        for (int round = 0; round < 10; round++) {
+            quint64 product0 = static_cast<quint64>(PHILOX_M0) * c0;
+            quint64 product1 = static_cast<quint64>(PHILOX_M1) * c2;
+            c0 = static_cast<quint32>(product1 >> 32) ^ c1 ^ k0;
+            c1 = static_cast<quint32>(product1);
+            c2 = static_cast<quint32>(product0 >> 32) ^ c3 ^ k1;
+            c3 = static_cast<quint32>(product0);
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+};
+
+#endif // PHILOX_H
@@ -14,6 +14,9 @@ TEMPLATE = app
 # Load the version number
 include(../version.pri)
 
+# The GUI draws and edits 64 bit genomes - wider ones are for revosim-cli only (see revosimcli.pro)
+!isEmpty(GENOME_BITS):!equals(GENOME_BITS, 64): error("GENOME_BITS=$$GENOME_BITS is only supported by revosim-cli")
+
 MOC_DIR += build
 
 OBJECTS_DIR += build
@@ -21,6 +24,13 @@ OBJECTS_DIR += build
 SOURCES += main.cpp \
     mainwindow.cpp \
     simmanager.cpp \
+    arena.cpp \
+    fitnesskernel.cpp \
+    workerpool.cpp \
+    perfcounters.cpp \
+    environmentcache.cpp \
+    environmentstack.cpp \
+    checkpoint.cpp \
     critter.cpp \
     populationscene.cpp \
     environmentscene.cpp \
@@ -37,7 +47,16 @@ SOURCES += main.cpp \
 
 HEADERS += mainwindow.h \
     simmanager.h \
+    arena.h \
+    fitnesskernel.h \
+    philox.h \
+    workerpool.h \
+    perfcounters.h \
+    environmentcache.h \
+    environmentstack.h \
+    checkpoint.h \
     critter.h \
+    genome.h \
     populationscene.h \
     environmentscene.h \
     sortablegenome.h \
@@ -0,0 +1,78 @@
+# -------------------------------------------------
+# Headless command line build of REvoSim - simulation core only, no widgets
+# -------------------------------------------------
+QT = core gui concurrent
+
+TARGET = revosim-cli
+
+DESTDIR \
+    += \
+    bin
+
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+# Load the version number
+include(../version.pri)
+
+# Strips GUI calls (dialogs, status bar, progress bars) out of the shared simulation sources
+DEFINES += REVOSIM_CLI
+
+# Genome width in bits - 64, 128 or 256, e.g. qmake "GENOME_BITS=128" (see genome.h)
+isEmpty(GENOME_BITS): GENOME_BITS = 64
+DEFINES += GENOME_BITS=$$GENOME_BITS
+
+MOC_DIR += build_cli
+
+OBJECTS_DIR += build_cli
+
+RCC_DIR += build_cli
+
+SOURCES += climain.cpp \
+    headlessrunner.cpp \
+    sweep.cpp \
+    simmanager.cpp \
+    arena.cpp \
+    fitnesskernel.cpp \
+    workerpool.cpp \
+    perfcounters.cpp \
+    environmentcache.cpp \
+    environmentstack.cpp \
+    checkpoint.cpp \
+    critter.cpp \
+    sortablegenome.cpp \
+    analyser.cpp \
+    analysistools.cpp \
+    logspecies.cpp \
+    logspeciesdataitem.cpp
+
+HEADERS += headlessrunner.h \
+    sweep.h \
+    simmanager.h \
+    arena.h \
+    fitnesskernel.h \
+    philox.h \
+    workerpool.h \
+    perfcounters.h \
+    environmentcache.h \
+    environmentstack.h \
+    checkpoint.h \
+    critter.h \
+    genome.h \
+    sortablegenome.h \
+    analyser.h \
+    analysistools.h \
+    logspecies.h \
+    logspeciesdataitem.h \
+    globals.h
+
+RESOURCES += \
+    resources_cli.qrc
+
+#Needed to use C++ lamda functions
+CONFIG += c++11
+
+#Needed to make binaries launchable from file in Ubuntu - GCC default link flag -pie on newer Ubuntu versions this so otherwise recognised as shared library
+QMAKE_LFLAGS += -no-pie
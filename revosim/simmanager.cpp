@@ -15,25 +15,39 @@
  * hope that it will be useful, but WITHOUT ANY WARRANTY.
  */
 
-#include "mainwindow.h"
 #include "simmanager.h"
+#include "analysistools.h"
+#include "fitnesskernel.h"
+#include "globals.h"
+
+#ifndef REVOSIM_CLI
+#include "mainwindow.h"
+#include <QMessageBox>
+#endif
 
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
+#include <QDateTime>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QImage>
-#include <QMessageBox>
+#include <QTextStream>
 #include <QThread>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define ENVIRONMENT_BLEND_SSE2
+#include <emmintrin.h>
+#endif
+
 // Simulation variables
 quint32 tweakers[32]; // the 32 single bit XOR values (many uses!)
 quint64 tweakers64[64]; // the 64 bit version
 quint32 bitCounts[65536]; // the bytes representing bit count of each number 0-635535
-quint32 xorMasks[256][3]; // determine fitness
+quint32 xorMasks[256][GENOME_MASKS]; // determine fitness
 int dispersalX[256][256];
 int dispersalY[256][256];
-quint64 geneX[65536];
-int nextGeneX;
 
 // Settable ints
 int gridX = 100;
@@ -57,7 +71,7 @@ int environmentChangeCounter;
 quint64 lastReport = 0;
 quint8 environmentMode;
 quint64 minSpeciesSize;
-quint64 reseedGenome = 0; // Genome for reseed with known genome
+Genome reseedGenome{}; // Genome for reseed with known genome
 
 // Settable bools
 bool recalculateFitness = false;
@@ -74,6 +88,14 @@ bool breedSpecies = false;
 bool breedDifference = true;
 bool gui = false;
 bool allowExcludeWithDescendants;
+bool hugePages = false;
+int gridLayout = GRID_LAYOUT_AUTO;
+int threadCount = 0;
+bool pinThreads = false;
+bool numaPlacement = false;
+int firstCpu = 0;
+quint64 randomSeed = 0;
+quint64 runSeed = 0;
 bool environmentChangeForward;
 
 // File handling
@@ -82,31 +104,35 @@ QString speciesLoggingFile = "";
 QString fitnessLoggingFile = "";
 
 // Global data
-Critter critters[GRID_X][GRID_Y][SLOTS_PER_GRID_SQUARE]; //main array - static for speed
-quint8 environment[GRID_X][GRID_Y][3];  //0 = red, 1 = green, 2 = blue
-quint8 environmentLast[GRID_X][GRID_Y][3];  //Used for interpolation
-quint8 environmentNext[GRID_X][GRID_Y][3];  //Used for interpolation
-quint32 totalFitness[GRID_X][GRID_Y];
+quint16 *critterAge; //main critter arrays - carved from the arena in SimManager::allocateArrays
+quint8 *critterFitness;
+qint32 *critterEnergy;
+Genome *critterGenome;
+quint64 *critterSpeciesID;
+CritterGrid critters;
+ColumnGrid<quint8[3]> environment;  //0 = red, 1 = green, 2 = blue
+ColumnGrid<quint8[3]> environmentLast;  //Used for interpolation
+ColumnGrid<quint8[3]> environmentNext;  //Used for interpolation
+CellArray<quint32[GENOME_MASKS]> environmentMasks;
+quint64 *environmentDirty;
+quint64 *occupancy;
+int occupancyWords = 0;
+quint64 *activeCells;
+int columnWords = 0;
+QVector<QPoint> activeCellList;
+CellArray<quint32> totalFitness;
 quint64 iteration;
 
-// These next to hold the babies... old style arrays for max speed
-quint64 newGenomes[GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2];
-quint32 newGenomeX[GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2];
-quint32 newGenomeY[GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2];
-int newGenomeDispersal[GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2];
-quint64 newGenomeSpecies[GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2];
-int newGenomeCount;
-
 // Randoms
 quint8 randoms[65536];
 quint16 nextRandom = 0;
 
 // Analysis
-int breedAttempts[GRID_X][GRID_Y]; //for analysis purposes
-int breedFails[GRID_X][GRID_Y]; //for analysis purposes
-int settles[GRID_X][GRID_Y]; //for analysis purposes
-int settleFails[GRID_X][GRID_Y]; //for analysis purposes
-int maxUsed[GRID_X][GRID_Y];
+CellArray<int> breedAttempts; //for analysis purposes
+CellArray<int> breedFails; //for analysis purposes
+CellArray<int> settles; //for analysis purposes
+CellArray<int> settleFails; //for analysis purposes
+CellArray<int> maxUsed;
 int aliveCount;
 int totalRecombination;
 
@@ -122,7 +148,13 @@ quint8 speciesMode;
 quint64 ids; //used in tree export -
 
 
-QMutex *mutexes[GRID_X][GRID_Y]; //set up array of mutexes
+int allocatedGridX = 0;
+int allocatedGridY = 0;
+int allocatedSlots = 0;
+CellLayout cellLayout;
+int allocatedCells = 0;
+
+SimManager *simulationManager;
 
 /**
  * @brief SimManager::SimManager
@@ -134,22 +166,12 @@ SimManager::SimManager()
     environmentMode = ENV_MODE_LOOP;
     environmentInterpolate = true;
     makeLookups();
+    FitnessKernel::initialise();
     aliveCount = 0;
-    processorCount = QThread::idealThreadCount();
-
-    if (processorCount == -1)
-        processorCount = 1;
-
-    //a sanity check
-    if (processorCount > 256)
-        processorCount = 256;
-
-    for (auto &mutexe : mutexes)
-        for (int j = 0; j < GRID_X; j++)
-            mutexe[j] = new QMutex();
-
-    for (int i = 0; i < processorCount; i++)
-        futuresList.append(new QFuture<int>);
+    processorCount = 0;
+    workerPool = nullptr;
+    setupThreads();
+    selectKernels();
 
 
     environmentFiles.clear();
@@ -158,8 +180,667 @@ SimManager::SimManager()
     environmentChangeForward = true;
     nextSpeciesID = 1;
     rootSpecies = static_cast<LogSpecies *>(nullptr);
+    analyser = new Analyser; // so can delete next time!
+    environmentCache = new EnvironmentCache;
+
+    arena = nullptr;
+    allocatedHugePages = false;
+    allocatedNumaPlacement = false;
+    allocatedThreads = 0;
+    allocatedFirstCpu = 0;
+    allocateArrays();
 
     warningCount = 0;
+    profiling = false;
+}
+
+/**
+ * @brief SimManager::~SimManager
+ */
+SimManager::~SimManager()
+{
+    //stop the worker threads before anything they use goes away
+    delete workerPool;
+    qDeleteAll(workerBuffers);
+    delete environmentCache;
+}
+
+/**
+ * @brief SimManager::setupThreads
+ *
+ * (Re)starts the worker pool if threadCount, pinThreads or firstCpu have changed - 0 threads means one per CPU. Only ever
+ * called between iterations, when the pool is idle. NUMA placement needs pinned threads, so it pins them too, and
+ * places the arrays again for the new pool.
+ */
+void SimManager::setupThreads()
+{
+    int wanted = threadCount > 0 ? threadCount : QThread::idealThreadCount();
+    bool pin = pinThreads || numaPlacement;
+
+    //a sanity check
+    if (wanted < 1)
+        wanted = 1;
+    if (wanted > 256)
+        wanted = 256;
+
+    if (workerPool && workerPool->count() == wanted && workerPool->pinned() == pin && workerPool->firstCpu() == firstCpu)
+        return;
+
+    delete workerPool;
+    workerPool = new WorkerPool(wanted, pin, firstCpu);
+    processorCount = wanted;
+
+    while (workerBuffers.count() < processorCount)
+        workerBuffers.append(new WorkerBuffers);
+    settleOffsets.resize(processorCount * processorCount);
+    ownerStarts.resize(processorCount + 1);
+
+    //NUMA strips follow the pool - arrays placed for the old one would leave workers on remote memory
+    if (arena && numaPlacement)
+        allocateArrays();
+}
+
+/**
+ * @brief CellLayout::resolve
+ * @return the layout GRID_LAYOUT_AUTO stands for on a width x height grid, or layout itself
+ */
+int CellLayout::resolve(int layout, int width, int height)
+{
+    if (layout == GRID_LAYOUT_COLUMNS || layout == GRID_LAYOUT_TILES || layout == GRID_LAYOUT_MORTON)
+        return layout;
+    return (width > TILE_GRID_THRESHOLD || height > TILE_GRID_THRESHOLD) ? GRID_LAYOUT_TILES : GRID_LAYOUT_COLUMNS;
+}
+
+/**
+ * @brief CellLayout::set
+ *
+ * Fill in the tile size and the in-tile offset tables for a layout
+ *
+ * @param layout GRID_LAYOUT_
+ * @param width
+ * @param height
+ */
+void CellLayout::set(int layout, int width, int height)
+{
+    mode = resolve(layout, width, height);
+    shift = mode == GRID_LAYOUT_MORTON ? MORTON_TILE_SHIFT : mode == GRID_LAYOUT_TILES ? TILE_SHIFT : 0;
+    mask = (1 << shift) - 1;
+    rows = (height + mask) >> shift;
+    tileCells = 1 << (2 * shift);
+
+    for (int i = 0; i <= mask; i++) {
+        if (mode == GRID_LAYOUT_MORTON) {
+            //spread the bits of i out to every other bit - y takes the even bits, x the odd
+            int spread = 0;
+            for (int b = 0; b < shift; b++)
+                spread |= ((i >> b) & 1) << (2 * b);
+            offsetX[i] = spread << 1;
+            offsetY[i] = spread;
+        } else {
+            offsetX[i] = i << shift;
+            offsetY[i] = i;
+        }
+    }
+
+    for (int x = 0; x <= mask; x++)
+        for (int y = 0; y <= mask; y++) {
+            tileX[offsetX[x] + offsetY[y]] = static_cast<quint8>(x);
+            tileY[offsetX[x] + offsetY[y]] = static_cast<quint8>(y);
+        }
+}
+
+/**
+ * @brief CellLayout::cellCount
+ * @return squares in a grid width wide, padded to whole tiles
+ */
+int CellLayout::cellCount(int width) const
+{
+    return ((width + mask) >> shift) * rows * tileCells;
+}
+
+/**
+ * @brief SimManager::allocateArrays
+ *
+ * (Re)builds the arena holding the big per-slot and per-square arrays so they match gridX, gridY and
+ * slotsPerSquare. Does nothing if the sizes (and huge page setting) have not changed - nor, with NUMA placement, the
+ * worker pool the arrays were placed for. Critters, per-square counts and environment within the overlap of the old
+ * and new grids are kept, so this is safe to call mid-run.
+ *
+ * Squares are ordered as gridLayout asks (see CellLayout) - big grids are tiled, so the slots of neighbouring squares
+ * are close in memory both ways. Arena pages are only committed when first written, so the critter arrays - by far
+ * the biggest - only take memory for the tiles critters have ever lived in.
+ */
+void SimManager::allocateArrays()
+{
+    if (arena && allocatedGridX == gridX && allocatedGridY == gridY && allocatedSlots == slotsPerSquare && allocatedHugePages == hugePages
+            && cellLayout.mode == CellLayout::resolve(gridLayout, gridX, gridY) && allocatedNumaPlacement == numaPlacement
+            && (!numaPlacement || (allocatedThreads == processorCount && allocatedFirstCpu == workerPool->firstCpu())))
+        return;
+
+    CellLayout newLayout;
+    newLayout.set(gridLayout, gridX, gridY);
+
+    const size_t cellCount = static_cast<size_t>(newLayout.cellCount(gridX));
+    const size_t slotCount = cellCount * static_cast<size_t>(slotsPerSquare);
+    const size_t environmentCount = static_cast<size_t>(gridX) * static_cast<size_t>(gridY);
+    const size_t columnCount = static_cast<size_t>(gridX) * static_cast<size_t>((gridY + 63) / 64);
+    const size_t occupancyCount = cellCount * static_cast<size_t>((slotsPerSquare + 63) / 64);
+
+    size_t bytes = Arena::alignedSize(slotCount * sizeof(quint16))
+                   + Arena::alignedSize(slotCount * sizeof(quint8))
+                   + Arena::alignedSize(slotCount * sizeof(qint32))
+                   + Arena::alignedSize(slotCount * sizeof(Genome))
+                   + Arena::alignedSize(slotCount * sizeof(quint64))
+                   + Arena::alignedSize(environmentCount * sizeof(*environment.data)) * 3
+                   + Arena::alignedSize(cellCount * sizeof(*environmentMasks.data))
+                   + Arena::alignedSize(cellCount * sizeof(quint32))
+                   + Arena::alignedSize(cellCount * sizeof(int)) * 5
+                   + Arena::alignedSize(columnCount * sizeof(quint64))
+                   + Arena::alignedSize(occupancyCount * sizeof(quint64))
+                   + Arena::alignedSize(columnCount * sizeof(quint64));
+
+    auto *newArena = new Arena;
+    if (!newArena->allocate(bytes, hugePages)) {
+        showWarning("Error", QString("Could not allocate %1 MB for a grid of %2 x %3 with %4 slots per square.")
+                    .arg(bytes / (1024 * 1024)).arg(gridX).arg(gridY).arg(slotsPerSquare));
+        exit(1);
+    }
+
+    //Arena memory comes back zeroed, so every slot starts dead and every square black
+    auto *newAge = newArena->take<quint16>(slotCount);
+    auto *newFitness = newArena->take<quint8>(slotCount);
+    auto *newEnergy = newArena->take<qint32>(slotCount);
+    auto *newGenome = newArena->take<Genome>(slotCount);
+    auto *newSpeciesID = newArena->take<quint64>(slotCount);
+    auto *newEnvironment = newArena->take<quint8[3]>(environmentCount);
+    auto *newEnvironmentLast = newArena->take<quint8[3]>(environmentCount);
+    auto *newEnvironmentNext = newArena->take<quint8[3]>(environmentCount);
+    auto *newEnvironmentMasks = newArena->take<quint32[GENOME_MASKS]>(cellCount);
+    auto *newTotalFitness = newArena->take<quint32>(cellCount);
+    auto *newBreedAttempts = newArena->take<int>(cellCount);
+    auto *newBreedFails = newArena->take<int>(cellCount);
+    auto *newSettles = newArena->take<int>(cellCount);
+    auto *newSettleFails = newArena->take<int>(cellCount);
+    auto *newMaxUsed = newArena->take<int>(cellCount);
+    auto *newEnvironmentDirty = newArena->take<quint64>(columnCount);
+    auto *newOccupancy = newArena->take<quint64>(occupancyCount);
+    auto *newActiveCells = newArena->take<quint64>(columnCount);
+
+    //Before anything is written - each strip's pages then go on the NUMA node of the thread that works on it
+    if (numaPlacement) {
+        const size_t slots = static_cast<size_t>(slotsPerSquare);
+        QVector<PlacedArray> placed;
+        placed << PlacedArray{newAge, slots * sizeof(quint16), false}
+               << PlacedArray{newFitness, slots * sizeof(quint8), false}
+               << PlacedArray{newEnergy, slots * sizeof(qint32), false}
+               << PlacedArray{newGenome, slots * sizeof(Genome), false}
+               << PlacedArray{newSpeciesID, slots * sizeof(quint64), false}
+               << PlacedArray{newEnvironment, gridY * sizeof(*environment.data), true}
+               << PlacedArray{newEnvironmentLast, gridY * sizeof(*environment.data), true}
+               << PlacedArray{newEnvironmentNext, gridY * sizeof(*environment.data), true}
+               << PlacedArray{newEnvironmentMasks, sizeof(*environmentMasks.data), false}
+               << PlacedArray{newTotalFitness, sizeof(quint32), false}
+               << PlacedArray{newBreedAttempts, sizeof(int), false}
+               << PlacedArray{newBreedFails, sizeof(int), false}
+               << PlacedArray{newSettles, sizeof(int), false}
+               << PlacedArray{newSettleFails, sizeof(int), false}
+               << PlacedArray{newMaxUsed, sizeof(int), false}
+               << PlacedArray{newEnvironmentDirty, ((gridY + 63) / 64) * sizeof(quint64), true}
+               << PlacedArray{newOccupancy, ((slotsPerSquare + 63) / 64) * sizeof(quint64), false}
+               << PlacedArray{newActiveCells, ((gridY + 63) / 64) * sizeof(quint64), true};
+        placeArrays(newLayout, placed);
+    }
+
+    //Nothing is living anywhere yet - every byte 0xff makes each maxUsed -1
+    memset(newMaxUsed, 0xff, cellCount * sizeof(int));
+
+    //Carry over whatever fits in the new grid
+    if (arena) {
+        int keepX = qMin(gridX, allocatedGridX);
+        int keepY = qMin(gridY, allocatedGridY);
+        int keepSlots = qMin(slotsPerSquare, allocatedSlots);
+
+        for (int n = 0; n < keepX; n++) {
+            const size_t columnBytes = static_cast<size_t>(keepY) * sizeof(*environment.data);
+            memcpy(newEnvironment + n * gridY, environment[n], columnBytes);
+            memcpy(newEnvironmentLast + n * gridY, environmentLast[n], columnBytes);
+            memcpy(newEnvironmentNext + n * gridY, environmentNext[n], columnBytes);
+
+            for (int m = 0; m < keepY; m++) {
+                int fromCell = cellIndex(n, m);
+                int toCell = newLayout.index(n, m);
+                newTotalFitness[toCell] = totalFitness.data[fromCell];
+                newBreedAttempts[toCell] = breedAttempts.data[fromCell];
+                newBreedFails[toCell] = breedFails.data[fromCell];
+                newSettles[toCell] = settles.data[fromCell];
+                newSettleFails[toCell] = settleFails.data[fromCell];
+
+                //nothing living here - leave the new slots untouched, so they take no memory
+                if (maxUsed.data[fromCell] < 0) continue;
+                newMaxUsed[toCell] = qMin(maxUsed.data[fromCell], keepSlots - 1);
+
+                int from = fromCell * allocatedSlots;
+                int to = toCell * slotsPerSquare;
+                memcpy(newAge + to, critterAge + from, keepSlots * sizeof(quint16));
+                memcpy(newFitness + to, critterFitness + from, keepSlots * sizeof(quint8));
+                memcpy(newEnergy + to, critterEnergy + from, keepSlots * sizeof(qint32));
+                memcpy(newGenome + to, critterGenome + from, keepSlots * sizeof(Genome));
+                memcpy(newSpeciesID + to, critterSpeciesID + from, keepSlots * sizeof(quint64));
+            }
+        }
+    }
+
+    critterAge = newAge;
+    critterFitness = newFitness;
+    critterEnergy = newEnergy;
+    critterGenome = newGenome;
+    critterSpeciesID = newSpeciesID;
+    environment.data = newEnvironment;
+    environmentLast.data = newEnvironmentLast;
+    environmentNext.data = newEnvironmentNext;
+    environmentMasks.data = newEnvironmentMasks;
+    totalFitness.data = newTotalFitness;
+    breedAttempts.data = newBreedAttempts;
+    breedFails.data = newBreedFails;
+    settles.data = newSettles;
+    settleFails.data = newSettleFails;
+    maxUsed.data = newMaxUsed;
+    environmentDirty = newEnvironmentDirty;
+    occupancy = newOccupancy;
+    activeCells = newActiveCells;
+
+    bool shrunk = arena && (gridX < allocatedGridX || gridY < allocatedGridY || slotsPerSquare < allocatedSlots);
+
+    delete arena;
+    arena = newArena;
+    allocatedGridX = gridX;
+    allocatedGridY = gridY;
+    allocatedSlots = slotsPerSquare;
+    allocatedHugePages = hugePages;
+    allocatedNumaPlacement = numaPlacement;
+    allocatedThreads = processorCount;
+    allocatedFirstCpu = workerPool->firstCpu();
+    cellLayout = newLayout;
+    allocatedCells = static_cast<int>(cellCount);
+    occupancyWords = (slotsPerSquare + 63) / 64;
+    columnWords = (gridY + 63) / 64;
+
+    invalidateEnvironment();
+
+    //Critters outside the new grid are gone - bring the per-square totals back into line
+    if (shrunk) {
+        aliveCount = 0;
+        for (int n = 0; n < gridX; n++)
+            for (int m = 0; m < gridY; m++) {
+                if (totalFitness[n][m] == 0) continue;
+                totalFitness[n][m] = 0;
+                int base = critterIndex(n, m, 0);
+                for (int c = 0; c <= maxUsed[n][m]; c++)
+                    if (critterAge[base + c] > 0) {
+                        totalFitness[n][m] += critterFitness[base + c];
+                        aliveCount++;
+                    }
+            }
+    }
+
+    rebuildOccupancy();
+}
+
+/**
+ * @brief SimManager::rebuildOccupancy
+ *
+ * Work out the occupancy bits and maxUsed for every square from the critter ages. The simulation loops keep these up
+ * to date themselves - this is for anything that changes critters wholesale (setting up, loading, resizing). Anything
+ * that does must leave maxUsed at or above each square's highest living slot (-1 for none), as only slots up to it
+ * are looked at - so slots, and tiles, nothing has lived in are never read.
+ */
+void SimManager::rebuildOccupancy()
+{
+    memset(activeCells, 0, static_cast<size_t>(gridX) * static_cast<size_t>(columnWords) * sizeof(quint64));
+
+    for (int n = 0; n < gridX; n++)
+        for (int m = 0; m < gridY; m++) {
+            quint64 *bits = cellOccupancy(n, m);
+            for (int w = 0; w < occupancyWords; w++)
+                bits[w] = 0;
+
+            const quint16 *age = critterAge + critterIndex(n, m, 0);
+            const int highest = maxUsed[n][m];
+            for (int c = 0; c <= highest; c++)
+                if (age[c])
+                    setOccupied(bits, c);
+
+            maxUsed[n][m] = highestOccupied(bits);
+            if (maxUsed[n][m] >= 0)
+                setCellActive(n, m);
+        }
+
+    columnLive.resize(gridX);
+    countColumns(0, gridX - 1);
+    buildActiveCellList();
+
+    //critters may have been added or removed outside iterate() - recount the current totals
+    stats.alive = 0;
+    stats.totalFitness = 0;
+    for (const QPoint &cell : activeCellList) {
+        stats.alive += cellPopulation(cell.x(), cell.y());
+        stats.totalFitness += totalFitness[cell.x()][cell.y()];
+    }
+    aliveCount = stats.alive;
+}
+
+/**
+ * @brief SimManager::buildActiveCellList
+ *
+ * Refill activeCellList from the activeCells bits - done at the end of each iteration, so reports, logs and the
+ * population views only visit squares with something living in them
+ */
+void SimManager::buildActiveCellList()
+{
+    activeCellList.clear();
+    for (int n = 0; n < gridX; n++) {
+        const quint64 *active = columnActiveCells(n);
+        for (int w = 0; w < columnWords; w++) {
+            quint64 activeBits = active[w];
+            while (activeBits) {
+                activeCellList.append(QPoint(n, w * 64 + static_cast<int>(qCountTrailingZeroBits(activeBits))));
+                activeBits &= activeBits - 1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief SimManager::countColumns
+ *
+ * Count the living critters in each column from the occupancy bits, ready for the next partitionStrips()
+ *
+ * @param firstX
+ * @param lastX
+ */
+void SimManager::countColumns(int firstX, int lastX)
+{
+    for (int n = firstX; n <= lastX; n++) {
+        int live = 0;
+        const quint64 *active = columnActiveCells(n);
+        for (int w = 0; w < columnWords; w++) {
+            quint64 activeBits = active[w];
+            while (activeBits) {
+                live += cellPopulation(n, w * 64 + static_cast<int>(qCountTrailingZeroBits(activeBits)));
+                activeBits &= activeBits - 1;
+            }
+        }
+        columnLive[n] = live;
+    }
+}
+
+/**
+ * @brief numaStripStart
+ *
+ * With NUMA placement, strips are fixed - an even share of the columns each, rounded to whole columns of tiles - so
+ * each thread keeps working on the memory placed on its node
+ *
+ * @return first column of strip, or width for strip == strips
+ */
+static int numaStripStart(int strip, int strips, int width, int mask)
+{
+    int x = static_cast<int>(static_cast<qint64>(width) * strip / strips);
+    return qMin(width, (x + mask) & ~mask);
+}
+
+/**
+ * @brief SimManager::partitionStrips
+ *
+ * Split the columns into one strip per thread so each gets about the same work, going by where critters were living
+ * after the last iteration. Strips stay in order left to right, so babies still settle in parent order whatever the
+ * split. A thread can end up with an empty strip. On a tiled grid strips are whole columns of tiles, so each strip's
+ * squares are contiguous in the per-square arrays.
+ */
+void SimManager::partitionStrips()
+{
+    columnLive.resize(gridX);
+    stripStarts.resize(processorCount + 1);
+    ownerOfX.resize(gridX);
+
+    if (numaPlacement) {
+        for (int i = 0; i <= processorCount; i++)
+            stripStarts[i] = numaStripStart(i, processorCount, gridX, cellLayout.mask);
+        for (int i = 0; i < processorCount; i++)
+            for (int n = stripStarts[i]; n < stripStarts[i + 1]; n++)
+                ownerOfX[n] = i;
+        return;
+    }
+
+    //An empty square still costs something to visit - weigh each critter as STRIP_CRITTER_WEIGHT squares
+    qint64 totalWeight = 0;
+    for (int n = 0; n < gridX; n++)
+        totalWeight += static_cast<qint64>(columnLive[n]) * STRIP_CRITTER_WEIGHT + gridY;
+
+    //Prefix sum - each strip starts at the first column of tiles the running total reaches its share in
+    int owner = 0;
+    qint64 runningWeight = 0;
+    stripStarts[0] = 0;
+    for (int n = 0; n < gridX; n++) {
+        while (owner < processorCount - 1 && (n & cellLayout.mask) == 0 && runningWeight >= (totalWeight * (owner + 1)) / processorCount)
+            stripStarts[++owner] = n;
+        ownerOfX[n] = owner;
+        runningWeight += static_cast<qint64>(columnLive[n]) * STRIP_CRITTER_WEIGHT + gridY;
+    }
+    while (owner < processorCount)
+        stripStarts[++owner] = gridX;
+}
+
+/**
+ * @brief SimManager::placeArrays
+ *
+ * NUMA first touch - each worker touches its own strip of every array, and sets up its offspring buffer, so the pages
+ * are committed on the node it is pinned to. Must come before anything else writes to the arrays.
+ *
+ * @param layout the layout the arrays are for - not yet cellLayout when called from allocateArrays()
+ * @param arrays
+ */
+void SimManager::placeArrays(const CellLayout &layout, const QVector<PlacedArray> &arrays)
+{
+    workerPool->run([&](int i) {
+        int firstX = numaStripStart(i, processorCount, gridX, layout.mask);
+        int endX = numaStripStart(i + 1, processorCount, gridX, layout.mask);
+        if (firstX >= endX) return;
+
+        //Strips are whole columns of tiles, so their cells are one block
+        const size_t firstCell = static_cast<size_t>(layout.cellCount(firstX));
+        const size_t endCell = static_cast<size_t>(layout.cellCount(endX));
+        for (const PlacedArray &array : arrays) {
+            size_t first = array.perColumn ? static_cast<size_t>(firstX) : firstCell;
+            size_t end = array.perColumn ? static_cast<size_t>(endX) : endCell;
+            char *data = static_cast<char *>(array.data);
+            Arena::touchPages(data + first * array.unitBytes, data + end * array.unitBytes);
+        }
+
+        //Room for a baby per square to start with - the buffer grows from here, in this thread, if need be
+        QVector<Offspring> &offspring = workerBuffers[i]->offspring;
+        offspring.clear();
+        offspring.squeeze();
+        offspring.reserve((endX - firstX) * gridY);
+        offspring.resize(offspring.capacity());
+        offspring.clear();
+    });
+}
+
+/**
+ * @brief SimManager::numaReport
+ *
+ * Where each worker is running, and where the pages of its strip of the critter genomes (the biggest array) are -
+ * sampled, as there are far too many to look at every one. Pages not yet used by any critter aren't committed yet.
+ *
+ * @return a line per worker and a summary, or why there's no report
+ */
+QStringList SimManager::numaReport()
+{
+    QStringList report;
+    QVector<QString> lines(processorCount);
+    QVector<int> local(processorCount, 0);
+    QVector<int> sampled(processorCount, 0);
+    QVector<int> unknown(processorCount, 0);
+
+    setupThreads();
+    partitionStrips();
+    workerPool->run([&](int i) {
+        int node;
+        int cpu = WorkerPool::currentCpu(&node);
+
+        int firstX = stripStarts[i];
+        int endX = stripStarts[i + 1];
+        char *first = reinterpret_cast<char *>(critterGenome + static_cast<size_t>(cellLayout.cellCount(firstX)) * allocatedSlots);
+        char *end = reinterpret_cast<char *>(critterGenome + static_cast<size_t>(cellLayout.cellCount(endX)) * allocatedSlots);
+
+        //an even spread of the strip's pages
+        void *pages[NUMA_REPORT_SAMPLES];
+        int nodes[NUMA_REPORT_SAMPLES];
+        size_t pageCount = static_cast<size_t>(end - first) / ARENA_PAGE_SIZE;
+        int samples = static_cast<int>(qMin<size_t>(pageCount, NUMA_REPORT_SAMPLES));
+        for (int p = 0; p < samples; p++)
+            pages[p] = first + (pageCount * p / samples) * ARENA_PAGE_SIZE;
+        if (!Arena::pageNodes(pages, samples, nodes) && samples) {
+            unknown[i] = 1;
+            return;
+        }
+
+        int onNode = 0;
+        int elsewhere = 0;
+        for (int p = 0; p < samples; p++) {
+            if (nodes[p] < 0) continue;
+            if (nodes[p] == node) onNode++;
+            else elsewhere++;
+        }
+        local[i] = onNode;
+        sampled[i] = onNode + elsewhere;
+        lines[i] = QString("Worker %1: CPU %2, node %3, columns %4-%5 - %6 sampled pages local, %7 on other nodes, %8 not yet used")
+                   .arg(i).arg(cpu).arg(node).arg(firstX).arg(endX - 1).arg(onNode).arg(elsewhere).arg(samples - onNode - elsewhere);
+    });
+
+    if (unknown.contains(1)) {
+        report << "NUMA placement can't be reported - the OS won't say where pages are (Linux only)";
+        return report;
+    }
+
+    int totalLocal = 0;
+    int totalSampled = 0;
+    for (int i = 0; i < processorCount; i++) {
+        report << lines[i];
+        totalLocal += local[i];
+        totalSampled += sampled[i];
+    }
+    if (totalSampled)
+        report << QString("NUMA placement: %1% of sampled critter pages are on their worker's node")
+               .arg(100.0 * totalLocal / totalSampled, 0, 'f', 1);
+    return report;
+}
+
+/**
+ * @brief blendColours
+ *
+ * colour = (last * (256 - weight) + next * weight + 128) / 256 for each byte. The sum is at most 65408, so it fits in
+ * 16 bits - with SSE2 that's sixteen bytes at a time.
+ *
+ * @param weight how far along from last to next, 0 to 256
+ */
+static void blendColours(const quint8 *last, const quint8 *next, quint8 *colour, int count, int weight)
+{
+    int i = 0;
+
+#ifdef ENVIRONMENT_BLEND_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lastWeight = _mm_set1_epi16(static_cast<short>(256 - weight));
+    const __m128i nextWeight = _mm_set1_epi16(static_cast<short>(weight));
+    const __m128i half = _mm_set1_epi16(128);
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i lastBytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(last + i));
+        __m128i nextBytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(next + i));
+
+        __m128i low = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(lastBytes, zero), lastWeight),
+                                                  _mm_mullo_epi16(_mm_unpacklo_epi8(nextBytes, zero), nextWeight)), half);
+        __m128i high = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(lastBytes, zero), lastWeight),
+                                                   _mm_mullo_epi16(_mm_unpackhi_epi8(nextBytes, zero), nextWeight)), half);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(colour + i), _mm_packus_epi16(_mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8)));
+    }
+#endif
+
+    for (; i < count; i++)
+        colour[i] = static_cast<quint8>((last[i] * (256 - weight) + next[i] * weight + 128) >> 8);
+}
+
+/**
+ * @brief SimManager::interpolateEnvironment
+ *
+ * Blend environmentLast and environmentNext into environment for columns firstX to lastX. Sixteen squares at a time,
+ * skipping any run where the two images are the same - those squares already hold that colour. Only squares whose
+ * colour actually changes get new masks and are marked dirty.
+ *
+ * @param firstX
+ * @param lastX
+ * @param weight how far along from last to next, 0 to 256
+ */
+void SimManager::interpolateEnvironment(int firstX, int lastX, int weight)
+{
+    quint8 blended[16 * 3];
+
+    for (int n = firstX; n <= lastX; n++) {
+        const quint8 *last = environmentLast[n][0];
+        const quint8 *next = environmentNext[n][0];
+
+        for (int m = 0; m < gridY; m += 16) {
+            int squares = qMin(16, gridY - m);
+            if (memcmp(last + m * 3, next + m * 3, static_cast<size_t>(squares) * 3) == 0) continue;
+
+            blendColours(last + m * 3, next + m * 3, blended, squares * 3, weight);
+            for (int k = 0; k < squares; k++)
+                setEnvironmentColour(n, m + k, blended[k * 3], blended[k * 3 + 1], blended[k * 3 + 2]);
+        }
+    }
+}
+
+/**
+ * @brief SimManager::invalidateEnvironment
+ *
+ * Recalculate every square's masks and mark them all dirty. Needed whenever the environment or xorMasks are replaced
+ * wholesale (e.g. loading a simulation), or the fitness settings change.
+ */
+void SimManager::invalidateEnvironment()
+{
+    for (int n = 0; n < gridX; n++)
+        for (int m = 0; m < gridY; m++)
+            for (int c = 0; c < GENOME_MASKS; c++)
+                environmentMasks[n][m][c] = xorMasks[environment[n][m][c % 3]][c];
+
+    memset(environmentDirty, 0xff, static_cast<size_t>(gridX) * static_cast<size_t>(columnWords) * sizeof(quint64));
+
+    maskedTarget = target;
+    maskedSettleTolerance = settleTolerance;
+}
+
+/**
+ * @brief SimManager::setEnvironmentColour
+ *
+ * Change one square's colour - the square is only marked dirty if the colour really changed
+ */
+inline void SimManager::setEnvironmentColour(int x, int y, quint8 red, quint8 green, quint8 blue)
+{
+    quint8 *colour = environment[x][y];
+    if (colour[0] == red && colour[1] == green && colour[2] == blue) return;
+
+    colour[0] = red;
+    colour[1] = green;
+    colour[2] = blue;
+
+    for (int w = 0; w < GENOME_MASKS; w += 3) {
+        environmentMasks[x][y][w] = xorMasks[red][w];
+        environmentMasks[x][y][w + 1] = xorMasks[green][w + 1];
+        environmentMasks[x][y][w + 2] = xorMasks[blue][w + 2];
+    }
+
+    environmentDirty[x * columnWords + y / 64] |= static_cast<quint64>(1) << (y % 64);
 }
 
 /**
@@ -182,6 +863,35 @@ int SimManager::portableRandom()
     return qrand();
 }
 
+/**
+ * @brief SimManager::makeMasks
+ *
+ * Make the xorMasks - the fitness landscape - from qrand, so a run with a seed set can seed qrand first and get the
+ * same landscape every time (see setupRun)
+ */
+void SimManager::makeMasks()
+{
+    //now set up xor masks for 3 variables - these are used for each of R G and B to work out fitness
+    //Start - random bit pattern for each
+    xorMasks[0][0] = static_cast<quint32>(portableRandom() * portableRandom() * 2);
+    xorMasks[0][1] = static_cast<quint32>(portableRandom() * portableRandom() * 2);
+    xorMasks[0][2] = static_cast<quint32>(portableRandom() * portableRandom() * 2);
+
+    for (int n = 1; n < 256; n++) {
+        //for all the others - flip a random bit each time (^ is xor) - will slowly modify from 0 to 255
+        xorMasks[n][0] = xorMasks[n - 1][0] ^ tweakers[portableRandom() / (PORTABLE_RAND_MAX / 32)];
+        xorMasks[n][1] = xorMasks[n - 1][1] ^ tweakers[portableRandom() / (PORTABLE_RAND_MAX / 32)];
+        xorMasks[n][2] = xorMasks[n - 1][2] ^ tweakers[portableRandom() / (PORTABLE_RAND_MAX / 32)];
+    }
+
+    //Wide genomes - each further word gets its own masks, made the same way
+    for (int c = 3; c < GENOME_MASKS; c++) {
+        xorMasks[0][c] = static_cast<quint32>(portableRandom() * portableRandom() * 2);
+        for (int n = 1; n < 256; n++)
+            xorMasks[n][c] = xorMasks[n - 1][c] ^ tweakers[portableRandom() / (PORTABLE_RAND_MAX / 32)];
+    }
+}
+
 /**
  * @brief SimManager::makeLookups
  */
@@ -209,34 +919,13 @@ void SimManager::makeLookups()
     //RJG - seed random from time qsrand(RAND_SEED);
     qsrand(static_cast<uint>(QTime::currentTime().msec()));
 
-    //now set up xor masks for 3 variables - these are used for each of R G and B to work out fitness
-    //Start - random bit pattern for each
-    xorMasks[0][0] = static_cast<quint32>(portableRandom() * portableRandom() * 2);
-    xorMasks[0][1] = static_cast<quint32>(portableRandom() * portableRandom() * 2);
-    xorMasks[0][2] = static_cast<quint32>(portableRandom() * portableRandom() * 2);
-
-    for (int n = 1; n < 256; n++) {
-        //for all the others - flip a random bit each time (^ is xor) - will slowly modify from 0 to 255
-        xorMasks[n][0] = xorMasks[n - 1][0] ^ tweakers[portableRandom() / (PORTABLE_RAND_MAX / 32)];
-        xorMasks[n][1] = xorMasks[n - 1][1] ^ tweakers[portableRandom() / (PORTABLE_RAND_MAX / 32)];
-        xorMasks[n][2] = xorMasks[n - 1][2] ^ tweakers[portableRandom() / (PORTABLE_RAND_MAX / 32)];
-    }
+    makeMasks();
 
     // Now the randoms - pre_rolled random numbers 0-255
     for (quint8 &random : randoms)
         random = static_cast<quint8>(((portableRandom() & 255)));
     nextRandom = 0;
 
-    // Gene exchange lookup
-    for (quint64 &n : geneX) {  //random bit combs, averaging every other bit on
-        quint64 value = 0;
-        for (quint64 m : tweakers64)
-            if (portableRandom() > (PORTABLE_RAND_MAX / 2))
-                value += m;
-        n = value;
-    }
-    nextGeneX = 0;
-
     // Dispersal table - lookups for dispersal amount
     for (int distance = 0; distance < 256; distance++) {
         double newDistance = sqrt(65536 / static_cast<double>((distance + 1))) - 16;
@@ -254,89 +943,108 @@ void SimManager::makeLookups()
     }
 }
 
+/**
+ * @brief SimManager::stepEnvironmentFile
+ *
+ * Move on to the environment image after file, in the order emode gives - loop, bounce or once
+ *
+ * @param emode
+ * @param file
+ * @param forward direction, for bounce mode
+ * @return false if there are no more images (once mode)
+ */
+bool SimManager::stepEnvironmentFile(int emode, int *file, bool *forward) const
+{
+    if (emode != 3 && !(*forward)) //should not be going backwards!
+        *forward = true;
+    if (*forward) {
+        (*file)++; //next image
+        if (*file >= environmentFiles.count()) {
+            if (emode == 1) return false; //no more files and we are in 'once' mode
+            if (emode == 2) *file = 0; //loop mode
+            if (emode == 3) {
+                *file -= 2; //bounce mode - back two to undo the extra ++
+                *forward = false;
+            }
+        }
+    } else { //going backwards - must be in emode 3 (bounce)
+        (*file)--; //next image
+        if (*file < 0) {
+            *file = 1; //bounce mode - one to one again, must have just been 0
+            *forward = true;
+        }
+    }
+    return true;
+}
+
 /**
  * @brief SimManager::loadEnvironmentFromFile
+ *
+ * Set environment and environmentLast to the current image, and environmentNext to the one after it. The images come
+ * from the environment cache, which is then asked to start on the ones after that.
+ *
  * @param emode
  */
 void SimManager::loadEnvironmentFromFile(int emode)
 // Load current envirnonment from file
 {
-    //Use make qimage from file method
-    //Load the image
+    allocateArrays();
+
     if (currentEnvironmentFile >= environmentFiles.count()) {
         return;
     }
-    QImage LoadImage(environmentFiles[currentEnvironmentFile]);
 
-    if (LoadImage.isNull()) {
-        QMessageBox::critical(nullptr, "Error", "Fatal - can't open image " + environmentFiles[currentEnvironmentFile]);
-        exit(1);
+    //work out next file - depends on emode
+    int nextFile = currentEnvironmentFile;
+    if (emode != 0 && environmentFiles.count() > 1) {
+        bool forward = environmentChangeForward;
+        if (!stepEnvironmentFile(emode, &nextFile, &forward))
+            nextFile = currentEnvironmentFile; //won't matter
     }
-    //check size works
-    int xsize = LoadImage.width();
-    int ysize = LoadImage.height();
 
-    if (xsize < gridX || ysize < gridY) //rescale if necessary - only if too small
-        LoadImage = LoadImage.scaled(QSize(gridX, gridY), Qt::IgnoreAspectRatio);
+    QByteArray current = environmentCache->frame(environmentFiles[currentEnvironmentFile], gridX, gridY);
+    QByteArray next = nextFile == currentEnvironmentFile ? current : environmentCache->frame(environmentFiles[nextFile], gridX, gridY);
 
-    //turn into environment array
-    for (int i = 0; i < gridX; i++)
-        for (int j = 0; j < gridY; j++) {
-            QRgb colour = LoadImage.pixel(i, j);
-            environment[i][j][0] = static_cast<quint8>(qRed(colour));
-            environment[i][j][1] = static_cast<quint8>(qGreen(colour));
-            environment[i][j][2] = static_cast<quint8>(qBlue(colour));
-        }
+    if (current.isEmpty() || next.isEmpty()) {
+        QString fileName = environmentFiles[current.isEmpty() ? currentEnvironmentFile : nextFile];
+#ifndef REVOSIM_CLI
+        QMessageBox::critical(nullptr, "Error", "Fatal - can't open image " + fileName);
+#else
+        qCritical().noquote() << "Fatal - can't open image" << fileName;
+#endif
+        exit(1);
+    }
 
-    //set up environmentLast - same as environment
-    for (int i = 0; i < gridX; i++)
-        for (int j = 0; j < gridY; j++) {
-            QRgb colour = LoadImage.pixel(i, j);
-            environmentLast[i][j][0] = static_cast<quint8>(qRed(colour));
-            environmentLast[i][j][1] = static_cast<quint8>(qGreen(colour));
-            environmentLast[i][j][2] = static_cast<quint8>(qBlue(colour));
-        }
-    //set up environment next - depends on emode
-
-    if (emode == 0 || environmentFiles.count() == 1) { //static environment
-        for (int i = 0; i < gridX; i++)
-            for (int j = 0; j < gridY; j++) {
-                QRgb colour = LoadImage.pixel(i, j);
-                environmentNext[i][j][0] = static_cast<quint8>(qRed(colour));
-                environmentNext[i][j][1] = static_cast<quint8>(qGreen(colour));
-                environmentNext[i][j][2] = static_cast<quint8>(qBlue(colour));
-            }
-    } else {
-        //work out next file
-        int nextFile = 0;
-        if (environmentChangeForward) {
-            if ((currentEnvironmentFile + 1) < environmentFiles.count()) //not yet at end
-                nextFile = currentEnvironmentFile + 1;
-            else {
-                //depends on emode
-                if (emode == 1) nextFile = currentEnvironmentFile; //won't matter
-                if (emode == 2) nextFile = 0; //loop mode
-                if (emode == 3) nextFile = currentEnvironmentFile - 1; //bounce mode
-            }
-        } else { //backwards - simpler, must be emode 3
-            if (currentEnvironmentFile > 0) //not yet at end
-                nextFile = currentEnvironmentFile - 1;
-            else
-                nextFile = 1; //bounce mode
+    //frames are laid out just like the arrays
+    const size_t frameBytes = static_cast<size_t>(gridX) * static_cast<size_t>(gridY) * sizeof(*environmentLast.data);
+    memcpy(environmentLast.data, current.constData(), frameBytes);
+    memcpy(environmentNext.data, next.constData(), frameBytes);
+
+    //environment starts at environmentLast - only squares that change colour are marked dirty. Frames in a sequence
+    //mostly match, so skip unchanged columns, then unchanged blocks of squares, with memcmp before going square by square
+    const size_t columnBytes = static_cast<size_t>(gridY) * sizeof(*environment.data);
+    for (int i = 0; i < gridX; i++) {
+        if (memcmp(environment[i], environmentLast[i], columnBytes) == 0) continue;
+
+        for (int block = 0; block < gridY; block += ENVIRONMENT_COMPARE_SQUARES) {
+            int blockEnd = qMin(gridY, block + ENVIRONMENT_COMPARE_SQUARES);
+            if (memcmp(environment[i][block], environmentLast[i][block], static_cast<size_t>(blockEnd - block) * sizeof(*environment.data)) == 0)
+                continue;
+            for (int j = block; j < blockEnd; j++)
+                setEnvironmentColour(i, j, environmentLast[i][j][0], environmentLast[i][j][1], environmentLast[i][j][2]);
         }
+    }
 
-        QImage LoadImage2(environmentFiles[nextFile]);
-        if (xsize < gridX || ysize < gridY) //rescale if necessary - only if too small
-            LoadImage2 = LoadImage2.scaled(QSize(gridX, gridY), Qt::IgnoreAspectRatio);
-        //get it
-        for (int i = 0; i < gridX; i++)
-            for (int j = 0; j < gridY; j++) {
-                QRgb colour = LoadImage2.pixel(i, j);
-                environmentNext[i][j][0] = static_cast<quint8>(qRed(colour));
-                environmentNext[i][j][1] = static_cast<quint8>(qGreen(colour));
-                environmentNext[i][j][2] = static_cast<quint8>(qBlue(colour));
-            }
+    //Get the loader going on the images the next few changes will need
+    QStringList upcoming;
+    if (emode != 0 && environmentFiles.count() > 1) {
+        int file = currentEnvironmentFile;
+        bool forward = environmentChangeForward;
+        if (stepEnvironmentFile(emode, &file, &forward)) //on to nextFile, already loaded
+            for (int i = 0; i < ENVIRONMENT_PREFETCH && stepEnvironmentFile(emode, &file, &forward); i++)
+                upcoming.append(environmentFiles[file]);
     }
+    environmentCache->prefetch(upcoming, gridX, gridY);
 }
 
 /**
@@ -356,41 +1064,25 @@ bool SimManager::regenerateEnvironment(int emode, bool interpolate)
     if (environmentChangeCounter <= 0)
         //is it time to do a full change?
     {
-        if (emode != 3 && !environmentChangeForward) //should not be going backwards!
-            environmentChangeForward = true;
-        if (environmentChangeForward) {
-            currentEnvironmentFile++; //next image
-            if (currentEnvironmentFile >= environmentFiles.count()) {
-                if (emode == 1) return true; //no more files and we are in 'once' mode - stop the sim
-                if (emode == 2) currentEnvironmentFile = 0; //loop mode
-                if (emode == 3) {
-                    currentEnvironmentFile -= 2; //bounce mode - back two to undo the extra ++
-                    environmentChangeForward = false;
-                }
-            }
-        } else { //going backwards - must be in emode 3 (bounce)
-            currentEnvironmentFile--; //next image
-            if (currentEnvironmentFile < 0) {
-                currentEnvironmentFile = 1; //bounce mode - one to one again, must have just been 0
-                environmentChangeForward = true;
-            }
-        }
+        if (!stepEnvironmentFile(emode, &currentEnvironmentFile, &environmentChangeForward))
+            return true; //no more files and we are in 'once' mode - stop the sim
         environmentChangeCounter = environmentChangeRate; //reset counter
         loadEnvironmentFromFile(emode); //and load it from the file
 
     } else {
         if (interpolate) {
-            float progress;
-            float invprogress;
-            invprogress = (static_cast<float>(environmentChangeCounter + 1) / (static_cast<float>(environmentChangeRate)));
-            progress = 1 - invprogress;
-            //not getting new, doing an interpolate
-            for (int i = 0; i < gridX; i++)
-                for (int j = 0; j < gridY; j++) {
-                    environment[i][j][0] = static_cast<quint8>(static_cast<float>(0.5) + (static_cast<float>(environmentLast[i][j][0])) * invprogress + (static_cast<float>(environmentNext[i][j][0])) * progress);
-                    environment[i][j][1] = static_cast<quint8>(static_cast<float>(0.5) + (static_cast<float>(environmentLast[i][j][1])) * invprogress + (static_cast<float>(environmentNext[i][j][1])) * progress);
-                    environment[i][j][2] = static_cast<quint8>(static_cast<float>(0.5) + (static_cast<float>(environmentLast[i][j][2])) * invprogress + (static_cast<float>(environmentNext[i][j][2])) * progress);
-                }
+            //not getting new, doing an interpolate - progress towards next, in 256ths
+            int progress = ((environmentChangeRate - environmentChangeCounter - 1) * 256 + environmentChangeRate / 2) / environmentChangeRate;
+
+            //every square is independent, so split the columns evenly between the workers - with NUMA placement, along
+            //the same strips the columns were first touched in (see placeArrays), so each blends memory on its own node
+            workerPool->run([&](int i) {
+                if (numaPlacement)
+                    interpolateEnvironment(numaStripStart(i, processorCount, gridX, cellLayout.mask),
+                                           numaStripStart(i + 1, processorCount, gridX, cellLayout.mask) - 1, progress);
+                else
+                    interpolateEnvironment((i * gridX) / processorCount, (((i + 1) * gridX) / processorCount) - 1, progress);
+            });
         }
 
     }
@@ -398,6 +1090,21 @@ bool SimManager::regenerateEnvironment(int emode, bool interpolate)
 }
 
 
+/**
+ * @brief SimManager::seedValue
+ *
+ * A value derived from a run's seed for one of the things set up from it (SEED_STREAM_), so they all repeat with
+ * the seed but don't follow each other
+ *
+ * @return
+ */
+quint32 SimManager::seedValue(quint64 seed, quint32 stream)
+{
+    quint32 bits[4];
+    Philox::generate(seed, stream, 1, 0, 0, bits);
+    return bits[0];
+}
+
 /**
  * @brief SimManager::random64
  *
@@ -410,6 +1117,21 @@ quint64 SimManager::random64()
     return static_cast<quint64>(random32()) + static_cast<quint64>(65536) * static_cast<quint64>(65536) * static_cast<quint64>(random32());
 }
 
+/**
+ * @brief SimManager::randomGenome
+ *
+ * random64() for each word of the genome
+ *
+ * @return
+ */
+Genome SimManager::randomGenome()
+{
+    Genome genome;
+    for (int w = 0; w < GENOME_WORDS; w++)
+        genomeWord(genome, w) = random64();
+    return genome;
+}
+
 /**
  * @brief SimManager::random32
  * @return
@@ -444,12 +1166,25 @@ void SimManager::setupRun()
     //RJG - called on initial program load and reseed, but also when run/run for are hit
     //RJG - with modification for dual seed if selected
 
-    //Kill em all
+    setupThreads();
+    allocateArrays();
+
+    //Seed for the breeding and settling randoms - logged in the settings, so a run can be repeated
+    runSeed = randomSeed ? randomSeed : random64();
+
+    //With a seed set, the fitness landscape, founder and starting ages come from it too, so the whole run repeats
+    if (randomSeed) {
+        qsrand(seedValue(randomSeed, SEED_STREAM_SETUP));
+        makeMasks();
+    }
+    invalidateEnvironment();
+
+    //Kill em all - only slots up to maxUsed can be alive, and leaving the rest alone keeps untouched tiles uncommitted
     for (int n = 0; n < gridX; n++)
         for (int m = 0; m < gridY; m++) {
-            for (int c = 0; c < slotsPerSquare; c++) {
-                critters[n][m][c].age = 0;
-                critters[n][m][c].fitness = 0;
+            for (int c = 0; c <= maxUsed[n][m]; c++) {
+                critterAge[critterIndex(n, m, c)] = 0;
+                critterFitness[critterIndex(n, m, c)] = 0;
             }
             totalFitness[n][m] = 0;
             maxUsed[n][m] = -1;
@@ -460,6 +1195,7 @@ void SimManager::setupRun()
         }
 
     aliveCount = 0;
+    stats = SimulationStats();
     nextSpeciesID = 1; //reset id counter
 
     int n = gridX / 2;
@@ -476,11 +1212,11 @@ void SimManager::setupRun()
 
     //RJG - Either reseed with known genome if set
     if (reseedKnown && !reseedDual) {
-        critters[n][m][0].initialise(reseedGenome, environment[n][m], n, m, 0, nextSpeciesID);
+        critters[n][m][0].initialise(reseedGenome, environment[n][m], nextSpeciesID);
         if (critters[n][m][0].fitness == 0) {
             // RJG - But sort out if it can't survive...
-            QMessageBox::warning(nullptr, "Oops",
-                                 "The genome you're trying to reseed with can't survive in one of the two chosen environmental pixels. Please either try different settings, or contact the Palaeoware team to discuss.");
+            showWarning("Oops",
+                        "The genome you're trying to reseed with can't survive in one of the two chosen environmental pixels. Please either try different settings, or contact the Palaeoware team to discuss.");
 
             reseedKnown = false;
             setupRun();
@@ -489,53 +1225,55 @@ void SimManager::setupRun()
 
         //RJG - I think this is a good thing to flag in an obvious fashion.
         QString reseedGenomeString("Started simulation with known genome: ");
-        for (quint64 i : tweakers64)
-            if (i & reseedGenome)
-                reseedGenomeString.append("1");
-            else
-                reseedGenomeString.append("0");
-
-        mainWindow->setStatusBarText(reseedGenomeString);
+        for (int w = 0; w < GENOME_WORDS; w++)
+            for (quint64 i : tweakers64)
+                if (i & genomeWord(reseedGenome, w))
+                    reseedGenomeString.append("1");
+                else
+                    reseedGenomeString.append("0");
+
+        setStatusText(reseedGenomeString);
     } else if (reseedKnown && reseedDual) {
-        critters[n][m][0].initialise(reseedGenome, environment[n][m], n, m, 0, nextSpeciesID);
-        critters[n2][m][0].initialise(reseedGenome, environment[n2][m], n2, m, 0, nextSpeciesID);
+        critters[n][m][0].initialise(reseedGenome, environment[n][m], nextSpeciesID);
+        critters[n2][m][0].initialise(reseedGenome, environment[n2][m], nextSpeciesID);
         if (critters[n][m][0].fitness == 0 || critters[n2][m][0].fitness == 0) {
             // RJG - But sort out if it can't survive...
-            QMessageBox::warning(nullptr, "Oops",
-                                 "The genome you're trying to reseed with can't survive in one of the two chosen environmental pixels. Please either try different settings, or contact the Palaeoware team to discuss.");
+            showWarning("Oops",
+                        "The genome you're trying to reseed with can't survive in one of the two chosen environmental pixels. Please either try different settings, or contact the Palaeoware team to discuss.");
             reseedKnown = false;
             setupRun();
             return;
         }
         //RJG - I think this is a good thing to flag in an obvious fashion.
         QString reseedGenomeString("Started simulation with dual known genomes: ");
-        for (unsigned long long i : tweakers64)if (i & reseedGenome) reseedGenomeString.append("1");
-            else reseedGenomeString.append("0");
-        mainWindow->setStatusBarText(reseedGenomeString);
+        for (int w = 0; w < GENOME_WORDS; w++)
+            for (unsigned long long i : tweakers64)if (i & genomeWord(reseedGenome, w)) reseedGenomeString.append("1");
+                else reseedGenomeString.append("0");
+        setStatusText(reseedGenomeString);
     } else if (!reseedKnown && reseedDual) {
         //RJG - or try till one lives. If alive, fitness (in critter file) >0
         int flag = 0;
         do {
             flag = 0;
             do {
-                critters[n][m][0].initialise(random64(), environment[n][m], n, m, 0, nextSpeciesID);
+                critters[n][m][0].initialise(randomGenome(), environment[n][m], nextSpeciesID);
             } while (critters[n][m][0].fitness < 1);
-            quint64 iteration = critters[n][m][0].genome;
-            critters[n2][m][0].initialise(iteration, environment[n2][m], n2, m, 0, nextSpeciesID);
+            Genome iteration = critters[n][m][0].genome;
+            critters[n2][m][0].initialise(iteration, environment[n2][m], nextSpeciesID);
             flag = critters[n2][m][0].fitness;
         } while (flag < 1);
-        mainWindow->setStatusBarText("");
+        setStatusText("");
     } else {
         while (critters[n][m][0].fitness < 1) {
-            critters[n][m][0].initialise(random64(), environment[n][m], n, m, 0, nextSpeciesID);
+            critters[n][m][0].initialise(randomGenome(), environment[n][m], nextSpeciesID);
             count ++;
             if (count > 10000000) {
-                QMessageBox::warning(nullptr, "Problem",
-                                     "It looks like no digital organisms are capable of surviving using the current settings. There could be a number of reasons why this is: either try different settings, or contact the Palaeoware team to discuss.");
+                showWarning("Problem",
+                            "It looks like no digital organisms are capable of surviving using the current settings. There could be a number of reasons why this is: either try different settings, or contact the Palaeoware team to discuss.");
                 return;
             }
         }
-        mainWindow->setStatusBarText("");
+        setStatusText("");
     }
 
     totalFitness[n][m] = static_cast<quint32>(critters[n][m][0].fitness); //may have gone wrong from above
@@ -543,16 +1281,23 @@ void SimManager::setupRun()
 
     aliveCount = 1;
     iteration = 0;
+    maxUsed[n][m] = 0;
+    if (reseedDual) maxUsed[n2][m] = 0;
+
+    Genome iteration = critters[n][m][0].genome;
 
-    quint64 iteration = critters[n][m][0].genome;
+    //the randoms table depends on where a randoms file was read from, so with a seed set ages come from qrand as well
+    auto startingAgeRandom = [this]() {
+        return randomSeed ? static_cast<quint8>(portableRandom() & 255) : random8();
+    };
 
     //RJG - Fill square with successful critter
     for (int c = 1; c < slotsPerSquare; c++) {
-        critters[n][m][c].initialise(iteration, environment[n][m], n, m, c, nextSpeciesID);
-        if (reseedDual)critters[n2][m][c].initialise(iteration, environment[n2][m], n2, m, c, nextSpeciesID);
+        critters[n][m][c].initialise(iteration, environment[n][m], nextSpeciesID);
+        if (reseedDual)critters[n2][m][c].initialise(iteration, environment[n2][m], nextSpeciesID);
 
         if (critters[n][m][c].age > 0) {
-            critters[n][m][c].age /= ((random8() / 10) + 1);
+            critters[n][m][c].age /= ((startingAgeRandom() / 10) + 1);
             critters[n][m][c].age += 10;
             aliveCount++;
             maxUsed[n][m] = c;
@@ -560,7 +1305,7 @@ void SimManager::setupRun()
         }
 
         if (reseedDual && critters[n2][m][c].age > 0) {
-            critters[n2][m][c].age /= ((random8() / 10) + 1);
+            critters[n2][m][c].age /= ((startingAgeRandom() / 10) + 1);
             critters[n2][m][c].age += 10;
             aliveCount++;
             maxUsed[n2][m] = c;
@@ -568,6 +1313,8 @@ void SimManager::setupRun()
         }
     }
 
+    rebuildOccupancy();
+
     environmentChangeCounter = environmentChangeRate;
     environmentChangeForward = true;
 
@@ -583,14 +1330,13 @@ void SimManager::setupRun()
     rootSpecies->timeOfLastAppearance = 0;
     rootSpecies->parent = static_cast<LogSpecies *>(nullptr);
     auto *newdata = new LogSpeciesDataItem;
-    newdata->centroidRangeX = static_cast<quint8>(n);
-    newdata->centroidRangeY = static_cast<quint8>(m);
+    newdata->centroidRangeX = static_cast<quint32>(n);
+    newdata->centroidRangeY = static_cast<quint32>(m);
     newdata->iteration = 0;
     newdata->cellsOccupied = 1;
     newdata->genomicDiversity = 1;
     newdata->size = static_cast<quint32>(aliveCount);
     newdata->geographicalRange = 0;
-    newdata->cellsOccupied = 0; //=1, this is stored as -1
     newdata->sampleGenome = iteration;
     newdata->maxEnvironment[0] = environment[n][m][0];
     newdata->maxEnvironment[1] = environment[n][m][1];
@@ -629,177 +1375,384 @@ void SimManager::setupRun()
 /**
  * @brief SimManager::iterateParallel
  *
- * Parallel version - takes newGenomesLocal as the start point it can write to in main genomes array
+ * Parallel version - babies go in this thread's own offspring buffer, which is emptied first. Compiled once for
+ * each combination of the KERNEL_ settings in Flags, so none of them are tested inside the loops - selectKernels()
+ * picks the one to run.
  *
  * @param firstX
  * @param lastX
- * @param newGenomeCountLocal
+ * @param offspring
  * @param killCountLocal
+ * @param countsLocal
  * @return returns number of new genomes
  */
-int SimManager::iterateParallel(int firstX, int lastX, int newGenomeCountLocal, int *killCountLocal)
+template <int Flags>
+int SimManager::iterateParallel(int firstX, int lastX, QVector<Offspring> *offspring, int *killCountLocal, SimulationStats *countsLocal)
 {
+    //clear() keeps the capacity (Qt 5.7+), so after the first few iterations this never allocates
+    offspring->clear();
+
     int breedlist[SLOTS_PER_GRID_SQUARE];
-    int maxalive;
+    quint8 newFitness[SLOTS_PER_GRID_SQUARE];
     int deathcount;
 
-    for (int n = firstX; n <= lastX; n++)
-        for (int m = 0; m < gridY; m++) {
-            int maxv = maxUsed[n][m];
+    //RJG - only squares with something living in them - empty ones have nothing to do
+    for (int n = firstX; n <= lastX; n++) {
+        quint64 *active = columnActiveCells(n);
+        for (int w = 0; w < columnWords; w++) {
+            //work from a copy - squares that empty are cleared from the real word as we go
+            quint64 activeBits = active[w];
+            while (activeBits) {
+                int m = w * 64 + static_cast<int>(qCountTrailingZeroBits(activeBits));
+                activeBits &= activeBits - 1;
+
+                int cell = cellIndex(n, m);
+                int maxv = maxUsed.data[cell];
+
+                //RJG - This square's slots in each of the critter arrays
+                int base = cell * allocatedSlots;
+                quint16 *age = critterAge + base;
+                quint8 *fitness = critterFitness + base;
+                qint32 *energy = critterEnergy + base;
+                quint64 *occupied = occupancy + cell * occupancyWords;
+
+                //RJG - fitness can only have changed if the square's colour has
+                if ((Flags & KERNEL_RECALCULATE_FITNESS) && environmentIsDirty(n, m)) {
+                    //RJG - whole square in one go, then pick out the living
+                    Critter::calculateFitnessBatch(critterGenome + base, maxv + 1, environmentMasks.data[cell], newFitness);
+                    totalFitness.data[cell] = 0;
+                    deathcount = 0;
+                    for (int c = 0; c <= maxv; c++) {
+                        if (age[c]) {
+                            int f = newFitness[c];
+                            fitness[c] = static_cast<quint8>(f);
+                            totalFitness.data[cell] += static_cast<quint32>(f);
+                            if (!f) {
+                                age[c] = 0;
+                                clearOccupied(occupied, c);
+                                deathcount++;
+                            }
+                        }
+                    }
+                    if (deathcount) {
+                        maxUsed.data[cell] = highestOccupied(occupied);
+                        maxv = maxUsed.data[cell];
+                    }
+                    (*killCountLocal) += deathcount;
+                }
 
-            Critter *crit = critters[n][m];
+                // RJG - reset counters for fitness logging to file
+                if (Flags & KERNEL_LOG_BREEDING) breedAttempts.data[cell] = 0;
+
+                if (totalFitness.data[cell]) { //skip whole square if needbe
+                    int addFood = 1 + static_cast<int>(static_cast<quint32>(food) / totalFitness.data[cell]);
+
+                    int breedListEntries = 0;
+
+                    for (int c = 0; c <= maxv; c++) {
+                        if (!age[c]) continue;
+
+                        //RJG - Here is where an individual dies.
+                        if ((--age[c]) == 0) {
+                            (*killCountLocal)++;
+                            totalFitness.data[cell] -= static_cast<quint32>(fitness[c]);
+                            fitness[c] = 0;
+                            clearOccupied(occupied, c);
+                            if (maxUsed.data[cell] == c)
+                                maxUsed.data[cell] = highestOccupied(occupied);
+                            continue;
+                        }
+                        energy[c] += fitness[c] * addFood;
+
+                        //non-slot version - try breeding if our energy is high enough
+                        if (energy[c] > (breedThreshold + breedCost)) {
+                            energy[c] -= breedCost;
+                            breedlist[breedListEntries++] = c;
+                        }
+                    }
 
-            if (recalculateFitness) {
-                totalFitness[n][m] = 0;
-                maxalive = 0;
-                deathcount = 0;
-                for (int c = 0; c <= maxv; c++) {
-                    if (crit[c].age) {
-                        quint32 f = static_cast<quint32>(crit[c].recalculateFitness(environment[n][m]));
-                        totalFitness[n][m] += f;
-                        if (f > 0) maxalive = c;
-                        else deathcount++;
+                    // ----RJG: breedAttempts was no longer used - co-opting for fitness report.
+                    if (Flags & KERNEL_LOG_BREEDING) breedAttempts.data[cell] = breedListEntries;
+                    countsLocal->breedEntries += breedListEntries;
+
+                    //----RJG Do breeding
+                    if (breedListEntries > 0) {
+                        quint8 divider = static_cast<quint8>(255 / breedListEntries);
+                        int square = squareNumber(n, m);
+                        for (int c = 0; c < breedListEntries; c++) {
+                            int partner;
+
+                            quint32 randomBits[4];
+                            runRandoms(square, breedlist[c], RANDOM_STREAM_BREED, randomBits);
+
+                            if (Flags & KERNEL_ASEXUAL)partner = c;
+                            else partner = static_cast<int>(randomBits[2] & 255) / divider;
+
+                            if (partner < breedListEntries) {
+                                if (Critter::breedWithParallel<Flags & (KERNEL_BREED_SPECIES | KERNEL_BREED_DIFFERENCE)>(
+                                            n, m, base + breedlist[c], base + breedlist[partner], randomBits, *offspring)) {
+                                    breedFails.data[cell]++; //for analysis purposes
+                                    countsLocal->breedFails++;
+                                }
+                            } else //didn't find a partner, refund breed cost
+                                energy[breedlist[c]] += breedCost;
+                        }
                     }
+
                 }
-                maxUsed[n][m] = maxalive;
-                maxv = maxalive;
-                (*killCountLocal) += deathcount;
+
+                countsLocal->totalFitness += totalFitness.data[cell];
+
+                //RJG - everything here died
+                if (maxUsed.data[cell] < 0)
+                    clearCellActive(n, m);
             }
+        }
+    }
 
-            // RJG - reset counters for fitness logging to file
-            if (fitnessLoggingToFile || logging)breedAttempts[n][m] = 0;
+    return offspring->count();
+}
 
-            if (totalFitness[n][m]) { //skip whole square if needbe
-                int addFood = 1 + static_cast<int>(static_cast<quint32>(food) / totalFitness[n][m]);
+/**
+ * @brief SimManager::settleDestinations
+ *
+ * Settle stage one - work out which square each of this thread's babies lands in (-1 if it falls off the grid), and
+ * count how many are heading for each thread's strip. Compiled for each combination of KERNEL_TOROIDAL and
+ * KERNEL_NONSPATIAL in Flags.
+ *
+ * @param thread
+ * @return
+ */
+template <int Flags>
+int SimManager::settleDestinations(int thread)
+{
+    WorkerBuffers *buffers = workerBuffers[thread];
+    int babyCount = buffers->offspring.count();
+    buffers->destinations.resize(babyCount);
 
-                int breedListEntries = 0;
+    const Offspring *babies = buffers->offspring.constData();
+    int *destinations = buffers->destinations.data();
+    int *ownerCounts = settleOffsets.data() + thread * processorCount;
+    for (int i = 0; i < processorCount; i++)
+        ownerCounts[i] = 0;
+
+    for (int n = 0; n < babyCount; n++) {
+        const Offspring &baby = babies[n];
+        quint32 randomBits[4];
+        runRandoms(squareNumber(static_cast<int>(baby.xPosition), static_cast<int>(baby.yPosition)), static_cast<int>(baby.slot), RANDOM_STREAM_SETTLE, randomBits);
+
+        int xPosition;
+        int yPosition;
+
+        if (Flags & KERNEL_NONSPATIAL) {
+            //settling with no geography - just randomly pick a cell
+            xPosition = static_cast<int>((static_cast<quint64>(randomBits[0]) * static_cast<quint64>(gridX)) >> 32);
+            yPosition = static_cast<int>((static_cast<quint64>(randomBits[1]) * static_cast<quint64>(gridY)) >> 32);
+        } else {
+            //normal settling with radiation from original point
+            auto t1 = static_cast<quint8>(randomBits[0]);
+            auto t2 = static_cast<quint8>(randomBits[0] >> 8);
+
+            xPosition = (dispersalX[t1][t2]) / baby.dispersal;
+            yPosition = (dispersalY[t1][t2]) / baby.dispersal;
+            xPosition += static_cast<int>(baby.xPosition);
+            yPosition += static_cast<int>(baby.yPosition);
+
+            if (Flags & KERNEL_TOROIDAL) {
+                //NOTE - this assumes max possible settle distance is less than grid size. Otherwise it will go tits up
+                if (xPosition < 0) xPosition += gridX;
+                if (xPosition >= gridX) xPosition -= gridX;
+                if (yPosition < 0) yPosition += gridY;
+                if (yPosition >= gridY) yPosition -= gridY;
+            } else if (xPosition < 0 || xPosition >= gridX || yPosition < 0 || yPosition >= gridY) {
+                destinations[n] = -1;
+                continue;
+            }
+        }
+
+        destinations[n] = cellIndex(xPosition, yPosition);
+        ownerCounts[ownerOfX[xPosition]]++;
+    }
+    return 0;
+}
 
-                for (int c = 0; c <= maxv; c++)
-                    if (crit[c].iterateParallel(killCountLocal, addFood))
-                        breedlist[breedListEntries++] = c;
+/**
+ * @brief SimManager::settleScatter
+ *
+ * Settle stage two - copy this thread's babies into the range of settleEntries belonging to the strip they land in.
+ * settleOffsets has already been turned into start positions, so no two threads write to the same place.
+ *
+ * @param thread
+ * @return
+ */
+int SimManager::settleScatter(int thread)
+{
+    WorkerBuffers *buffers = workerBuffers[thread];
+    const Offspring *babies = buffers->offspring.constData();
+    const int *destinations = buffers->destinations.constData();
+    int *offsets = settleOffsets.data() + thread * processorCount;
+    SettleEntry *entries = settleEntries.data();
+
+    for (int n = 0; n < buffers->destinations.count(); n++) {
+        if (destinations[n] < 0) continue;
+        SettleEntry &entry = entries[offsets[ownerOfX[cellX(destinations[n])]]++];
+        entry.baby = babies + n;
+        entry.cell = destinations[n];
+    }
+    return 0;
+}
 
-                // ----RJG: breedAttempts was no longer used - co-opting for fitness report.
-                if (fitnessLoggingToFile || logging)breedAttempts[n][m] = breedListEntries;
+/**
+ * @brief The IterateKernels struct
+ *
+ * Fills table[0] to table[Flags] with the iterateParallel variant for each set of KERNEL_ settings
+ */
+template <int Flags>
+struct IterateKernels {
+    static void fill(SimManager::IterateKernel *table)
+    {
+        table[Flags] = &SimManager::iterateParallel<Flags>;
+        IterateKernels<Flags - 1>::fill(table);
+    }
+};
 
-                //----RJG Do breeding
-                if (breedListEntries > 0) {
-                    quint8 divider = static_cast<quint8>(255 / breedListEntries);
-                    for (int c = 0; c < breedListEntries; c++) {
-                        int partner;
-                        bool temp_asexual = asexual;
+template <>
+struct IterateKernels<-1> {
+    static void fill(SimManager::IterateKernel *) {}
+};
 
-                        if (temp_asexual)partner = c;
-                        else partner = random8() / divider;
+/**
+ * @brief The SettleKernels struct
+ *
+ * As IterateKernels, for settleDestinations
+ */
+template <int Flags>
+struct SettleKernels {
+    static void fill(SimManager::SettleKernel *table)
+    {
+        table[Flags] = &SimManager::settleDestinations<Flags>;
+        SettleKernels<Flags - 1>::fill(table);
+    }
+};
 
-                        if (partner < breedListEntries) {
-                            if (crit[breedlist[c]].breedWithParallel(n, m, &(crit[breedlist[partner]]), &newGenomeCountLocal))
-                                breedFails[n][m]++; //for analysis purposes
-                        } else //didn't find a partner, refund breed cost
-                            crit[breedlist[c]].energy += breedCost;
-                    }
-                }
+template <>
+struct SettleKernels<-1> {
+    static void fill(SimManager::SettleKernel *) {}
+};
 
-            }
-        }
+/**
+ * @brief SimManager::selectKernels
+ *
+ * Picks the iterateParallel and settleDestinations variants compiled for the current settings. Cheap enough to call
+ * every iteration, so changes made in the GUI mid-run take effect on the next one.
+ */
+void SimManager::selectKernels()
+{
+    static IterateKernel iterateKernels[ITERATE_KERNEL_COUNT];
+    static SettleKernel settleKernels[SETTLE_KERNEL_COUNT];
+    static bool filled = false;
+    if (!filled) {
+        //only ever called from the main thread
+        IterateKernels<ITERATE_KERNEL_COUNT - 1>::fill(iterateKernels);
+        SettleKernels<SETTLE_KERNEL_COUNT - 1>::fill(settleKernels);
+        filled = true;
+    }
 
-    return newGenomeCountLocal;
+    int iterateFlags = 0;
+    if (recalculateFitness) iterateFlags |= KERNEL_RECALCULATE_FITNESS;
+    if (asexual) iterateFlags |= KERNEL_ASEXUAL;
+    if (breedSpecies) iterateFlags |= KERNEL_BREED_SPECIES;
+    if (breedDifference) iterateFlags |= KERNEL_BREED_DIFFERENCE;
+    if (fitnessLoggingToFile || logging) iterateFlags |= KERNEL_LOG_BREEDING;
+    iterateKernel = iterateKernels[iterateFlags];
+
+    int settleFlags = 0;
+    if (toroidal) settleFlags |= KERNEL_TOROIDAL;
+    if (nonspatial) settleFlags |= KERNEL_NONSPATIAL;
+    settleKernel = settleKernels[settleFlags];
 }
 
 /**
  * @brief SimManager::settleParallel
- * @param newGenomeCountsStart
- * @param newGenomeCountsEnd
+ *
+ * Settle stage three - this thread owns every square in its strip, so it can fill them without locks. The babies
+ * heading here are sorted by square first, so each square's slots are filled in one go. Within a square, babies
+ * arrive in the order their parents were processed, which doesn't depend on the number of threads.
+ *
+ * @param owner thread number - its strip is the same as in iterateParallel
  * @param tryCountLocal
  * @param settleCountLocal
  * @param birthCountsLocal
  * @return
  */
-int SimManager::settleParallel(int newGenomeCountsStart, int newGenomeCountsEnd, int *tryCountLocal, int *settleCountLocal, int *birthCountsLocal)
+int SimManager::settleParallel(int owner, int *tryCountLocal, int *settleCountLocal, int *birthCountsLocal)
 {
-    if (nonspatial) {
-        //settling with no geography - just randomly pick a cell
-        for (int n = newGenomeCountsStart; n < newGenomeCountsEnd; n++) {
-            quint64 xPosition = static_cast<quint64>(random32()) * static_cast<quint64>(gridX);
-            xPosition /= static_cast<quint64>(65536) * static_cast<quint64>(65536);
-
-            quint64 yPosition = static_cast<quint64>(random32()) * static_cast<quint64>(gridY);
-            yPosition /= static_cast<quint64>(65536) * static_cast<quint64>(65536);
-
-            mutexes[static_cast<int>(xPosition)][static_cast<int>(yPosition)]->lock(); //ensure no-one else buggers with this square
+    int firstX = stripStarts[owner];
+    int lastX = stripStarts[owner + 1] - 1;
+    int entryCount = ownerStarts[owner + 1] - ownerStarts[owner];
+    if (firstX > lastX || entryCount == 0) return 0;
+
+    //the strip is whole columns of tiles (see partitionStrips), so its squares are one run of cells - padding and all
+    const SettleEntry *entries = settleEntries.constData() + ownerStarts[owner];
+    int firstCell = cellIndex(firstX, 0);
+    int cellCount = ((lastX >> cellLayout.shift) - (firstX >> cellLayout.shift) + 1) * cellLayout.rows * cellLayout.tileCells;
+
+    //counting sort by square - keeps the arrival order within each square
+    WorkerBuffers *buffers = workerBuffers[owner];
+    SimulationStats &counts = buffers->counts;
+    buffers->cellStarts.fill(0, cellCount + 1);
+    buffers->sorted.resize(entryCount);
+    int *cellStarts = buffers->cellStarts.data();
+    const Offspring **sorted = buffers->sorted.data();
+
+    for (int e = 0; e < entryCount; e++)
+        cellStarts[entries[e].cell - firstCell + 1]++;
+    for (int c = 0; c < cellCount; c++)
+        cellStarts[c + 1] += cellStarts[c];
+    for (int e = 0; e < entryCount; e++)
+        sorted[cellStarts[entries[e].cell - firstCell]++] = entries[e].baby;
+
+    //cellStarts[c] is now the end of square c's babies, and the start of square c+1's
+    int start = 0;
+    for (int c = 0; c < cellCount; c++) {
+        int end = cellStarts[c];
+        if (end == start) continue;
+
+        int cell = firstCell + c;
+        int xPosition = cellX(cell);
+        int yPosition = cellY(cell);
+        int base = cell * allocatedSlots;
+        quint64 *occupied = occupancy + cell * occupancyWords;
+
+        //Now put each baby into the first free slot here
+        for (int b = start; b < end; b++) {
             (*tryCountLocal)++;
-            Critter *crit = critters[static_cast<int>(xPosition)][static_cast<int>(yPosition)];
-            //Now put the baby into any free slot here
-            for (int m = 0; m < slotsPerSquare; m++) {
-                Critter *crit2 = &(crit[m]);
-                if (crit2->age == 0) {
-                    //place it
-
-                    crit2->initialise(newGenomes[n], environment[xPosition][yPosition], static_cast<int>(xPosition), static_cast<int>(yPosition), m, newGenomeSpecies[n]);
-                    if (crit2->age) {
-                        int fit = crit2->fitness;
-                        totalFitness[xPosition][yPosition] += static_cast<quint32>(fit);
-                        (*birthCountsLocal)++;
-                        if (m > maxUsed[xPosition][yPosition]) maxUsed[xPosition][yPosition] = m;
-                        settles[xPosition][yPosition]++;
-                        (*settleCountLocal)++;
-                    } else settleFails[xPosition][yPosition]++;
-                    break;
-                }
+            int m = firstFreeSlot(occupied);
+            if (m >= slotsPerSquare) {
+                //square full - the rest have nowhere to go
+                (*tryCountLocal) += end - b - 1;
+                break;
             }
-            mutexes[xPosition][yPosition]->unlock();
-        }
-    } else {
-        //old code - normal settling with radiation from original point
-        for (int n = newGenomeCountsStart; n < newGenomeCountsEnd; n++) {
-            //first handle dispersal
-
-            quint8 t1 = random8();
-            quint8 t2 = random8();
-
-            int xPosition = (dispersalX[t1][t2]) / newGenomeDispersal[n];
-            int yPosition = (dispersalY[t1][t2]) / newGenomeDispersal[n];
-            xPosition += newGenomeX[n];
-            yPosition += newGenomeY[n];
-
 
-            if (toroidal) {
-                //NOTE - this assumes max possible settle distance is less than grid size. Otherwise it will go tits up
-                if (xPosition < 0) xPosition += gridX;
-                if (xPosition >= gridX) xPosition -= gridX;
-                if (yPosition < 0) yPosition += gridY;
-                if (yPosition >= gridY) yPosition -= gridY;
+            //place it - a baby that can't live here leaves the slot free for the next
+            int fit = Critter::initialiseSlot(base + m, sorted[b]->genome, environment[xPosition][yPosition], sorted[b]->speciesID);
+            if (fit) {
+                totalFitness[xPosition][yPosition] += static_cast<quint32>(fit);
+                counts.totalFitness += static_cast<quint64>(fit);
+                (*birthCountsLocal)++;
+                if (m > maxUsed[xPosition][yPosition])
+                    maxUsed[xPosition][yPosition] = m;
+                settles[xPosition][yPosition]++;
+                counts.settles++;
+                (*settleCountLocal)++;
+                setOccupied(occupied, m);
+                setCellActive(xPosition, yPosition);
             } else {
-                if (xPosition < 0) continue;
-                if (xPosition >= gridX)  continue;
-                if (yPosition < 0)  continue;
-                if (yPosition >= gridY)  continue;
+                settleFails[xPosition][yPosition]++;
+                counts.settleFails++;
             }
-
-            mutexes[xPosition][yPosition]->lock(); //ensure no-one else buggers with this square
-            (*tryCountLocal)++;
-            Critter *crit = critters[xPosition][yPosition];
-            //Now put the baby into any free slot here
-            for (int m = 0; m < slotsPerSquare; m++) {
-                Critter *crit2 = &(crit[m]);
-                if (crit2->age == 0) {
-                    //place it
-                    crit2->initialise(newGenomes[n], environment[xPosition][yPosition], xPosition, yPosition, m, newGenomeSpecies[n]);
-                    if (crit2->age) {
-                        int fit = crit2->fitness;
-                        totalFitness[xPosition][yPosition] += static_cast<quint32>(fit);
-                        (*birthCountsLocal)++;
-                        if (m > maxUsed[xPosition][yPosition])
-                            maxUsed[xPosition][yPosition] = m;
-                        settles[xPosition][yPosition]++;
-                        (*settleCountLocal)++;
-                    } else
-                        settleFails[xPosition][yPosition]++;
-                    break;
-                }
-            }
-            mutexes[xPosition][yPosition]->unlock();
-
         }
+        start = end;
     }
     return 0;
 }
@@ -816,6 +1769,7 @@ bool SimManager::iterate(int emode, bool interpolate)
 
     //RJG - Provide user with warning if the system is grinding through so many species it's taking>5 seconds.Option to turn off species mode.
     if (warningCount == 1) {
+#ifndef REVOSIM_CLI
         if (QMessageBox::question(
                     nullptr,
                     "A choice awaits...",
@@ -828,40 +1782,40 @@ bool SimManager::iterate(int emode, bool interpolate)
             speciesMode = 0;
             mainWindow->updateGUIFromVariables();
         }
+#else
+        //RJG - No one to ask on a headless run, so keep tracking species as the settings file requested
+        qWarning() << "The last species search took more than five seconds - the species system is a bottleneck for these settings.";
+#endif
         warningCount++;
     }
 
-    if (regenerateEnvironment(emode, interpolate)) return true;
+    //pick up any change to the thread settings, and the loop variants for the current settings
+    setupThreads();
+    selectKernels();
 
-    //New parallelised version
+    if (regenerateEnvironment(emode, interpolate)) return true;
 
-    int newgenomecounts_starts[256]; //allow for up to 256 threads
-    int newgenomecounts_ends[256]; //allow for up to 256 threads
+    if (target != maskedTarget || settleTolerance != maskedSettleTolerance)
+        invalidateEnvironment();
 
-    //work out positions in genome array that each thread can write to to guarantee no overlap
-    int positionadd = (GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2) / processorCount;
-    for (int i = 0; i < processorCount; i++)
-        newgenomecounts_starts[i] = i * positionadd;
+    //New parallelised version - each thread has a strip of squares, the same in every stage
+    partitionStrips();
 
     int killCounts[256];
-    for (int i = 0; i < processorCount; i++)
+    for (int i = 0; i < processorCount; i++) {
         killCounts[i] = 0;
+        workerBuffers[i]->counts = SimulationStats();
+    }
 
-    //do the magic! Set up futures objects, call the functions, wait till done, retrieve values
-
-    for (int i = 0; i < processorCount; i++)
-        *(futuresList[i]) = QtConcurrent::run(
-                                this,
-                                &SimManager::iterateParallel,
-                                (i * gridX) / processorCount, (((i + 1) * gridX) / processorCount) - 1, newgenomecounts_starts[i],
-                                &(killCounts[i])
-                            );
-
-    for (int i = 0; i < processorCount; i++)
-        futuresList[i]->waitForFinished();
+    //do the magic! Each worker breeds in its own strip
+    workerPool->run([&](int i) {
+        (this->*iterateKernel)(stripStarts[i], stripStarts[i + 1] - 1, &(workerBuffers[i]->offspring), &(killCounts[i]),
+                               &(workerBuffers[i]->counts));
+    });
 
-    for (int i = 0; i < processorCount; i++)
-        newgenomecounts_ends[i] = futuresList[i]->result();
+    //all recalculated - nothing is dirty until the environment next changes
+    if (recalculateFitness)
+        memset(environmentDirty, 0, static_cast<size_t>(gridX) * static_cast<size_t>(columnWords) * sizeof(quint64));
 
     //apply all the kills to the global count
     for (int i = 0; i < processorCount; i++)
@@ -881,20 +1835,46 @@ bool SimManager::iterate(int emode, bool interpolate)
     for (int i = 0; i < processorCount; i++)
         birthcounts[i] = 0;
 
-    //Parallel version of settle functions
-    for (int i = 0; i < processorCount; i++)
-        *(futuresList[i]) = QtConcurrent::run(
-                                this,
-                                &SimManager::settleParallel,
-                                newgenomecounts_starts[i],
-                                newgenomecounts_ends[i],
-                                &(trycounts[i]),
-                                &(settlecounts[i]),
-                                &(birthcounts[i])
-                            );
-
-    for (int i = 0; i < processorCount; i++)
-        futuresList[i]->waitForFinished();
+    QElapsedTimer settleTimer;
+    if (profiling)
+        settleTimer.start();
+
+    //Settle stage one - where does each baby land?
+    workerPool->run([&](int i) {
+        if (profiling) workerBuffers[i]->settleCounters.start();
+        (this->*settleKernel)(i);
+    });
+
+    //Turn the counts into where each thread writes its babies for each strip - strip by strip, then thread by thread
+    int settleTotal = 0;
+    for (int owner = 0; owner < processorCount; owner++) {
+        ownerStarts[owner] = settleTotal;
+        for (int i = 0; i < processorCount; i++) {
+            int count = settleOffsets[i * processorCount + owner];
+            settleOffsets[i * processorCount + owner] = settleTotal;
+            settleTotal += count;
+        }
+    }
+    ownerStarts[processorCount] = settleTotal;
+    settleEntries.resize(settleTotal);
+
+    //Settle stage two - group the babies by the strip they land in
+    workerPool->run([&](int i) {
+        settleScatter(i);
+    });
+
+    //Settle stage three - each thread fills the squares in its own strip
+    workerPool->run([&](int i) {
+        settleParallel(i, &(trycounts[i]), &(settlecounts[i]), &(birthcounts[i]));
+        if (profiling) workerBuffers[i]->settleCounters.stop();
+        countColumns(stripStarts[i], stripStarts[i + 1] - 1);
+    });
+
+    if (profiling) {
+        settleProfile.iterations++;
+        settleProfile.nanoseconds += settleTimer.nsecsElapsed();
+        settleProfile.babies += static_cast<quint64>(settleTotal);
+    }
 
     //sort out all the counts
     for (int i = 0; i < processorCount; i++) {
@@ -903,9 +1883,418 @@ bool SimManager::iterate(int emode, bool interpolate)
         settlecount += settlecounts[i];
     }
 
+    //add up the threads' stats - fitness and breed entries are for this iteration, the rest build up between resets
+    stats.alive = aliveCount;
+    stats.totalFitness = 0;
+    stats.breedEntries = 0;
+    for (int i = 0; i < processorCount; i++) {
+        const SimulationStats &counts = workerBuffers[i]->counts;
+        stats.totalFitness += counts.totalFitness;
+        stats.breedEntries += counts.breedEntries;
+        stats.breedFails += counts.breedFails;
+        stats.settles += counts.settles;
+        stats.settleFails += counts.settleFails;
+    }
+
+    buildActiveCellList();
+
     return false;
 }
 
+/**
+ * @brief SimManager::resetReportCounters
+ *
+ * Reset the per-square breed and settle counters - called after each report/log
+ */
+void SimManager::resetReportCounters()
+{
+    //whole arrays, padding and all, so this is one block each
+    const size_t cellBytes = static_cast<size_t>(allocatedCells) * sizeof(int);
+    memset(breedFails.data, 0, cellBytes);
+    memset(settles.data, 0, cellBytes);
+    memset(settleFails.data, 0, cellBytes);
+
+    stats.breedFails = 0;
+    stats.settles = 0;
+    stats.settleFails = 0;
+}
+
+/**
+ * @brief SimManager::startSettleProfile
+ *
+ * Time the settle stages of every iteration from now on, and count their cache and TLB misses where the hardware
+ * counters are available. Counters are per thread, so each worker opens its own.
+ */
+void SimManager::startSettleProfile()
+{
+    setupThreads();
+
+    settleProfile = SettleProfile();
+    QVector<int> opened(processorCount, 0);
+    workerPool->run([&](int i) {
+        opened[i] = workerBuffers[i]->settleCounters.open();
+    });
+    settleProfile.counted = !opened.contains(0);
+    profiling = true;
+}
+
+/**
+ * @brief SimManager::stopSettleProfile
+ * @return the profile since startSettleProfile()
+ */
+SettleProfile SimManager::stopSettleProfile()
+{
+    profiling = false;
+    for (int i = 0; i < processorCount; i++) {
+        PerfCounters &counters = workerBuffers[i]->settleCounters;
+        settleProfile.cacheMisses += counters.cacheMisses();
+        settleProfile.tlbMisses += counters.tlbMisses();
+        counters.close();
+    }
+    if (!settleProfile.counted) {
+        settleProfile.cacheMisses = 0;
+        settleProfile.tlbMisses = 0;
+    }
+    return settleProfile;
+}
+
+/**
+ * @brief SimManager::calculateSpecies
+ */
+void SimManager::calculateSpecies()
+{
+    if (speciesMode == SPECIES_MODE_NONE) return; //do nothing!
+
+    if (iteration != lastSpeciesCalculated) {
+        delete analyser;  //replace old analyser object with new
+        analyser = new Analyser;
+
+        //New species analyser
+        analyser->groupsGenealogicalTracker();
+
+        //Makre sure this is updated
+        lastSpeciesCalculated = iteration;
+    }
+}
+
+/**
+ * @brief SimManager::loadSettingsElement
+ *
+ * Reads a single simulation setting from a settings file. Shared between the GUI and the command line
+ * build - anything that only makes sense in the GUI is left for the caller to handle.
+ *
+ * @param settingsFileIn reader positioned on a start element
+ * @return true if the element was a simulation setting and has been consumed
+ */
+bool SimManager::loadSettingsElement(QXmlStreamReader &settingsFileIn)
+{
+    QString name = settingsFileIn.name().toString();
+    if (!isSettingElement(name))
+        return false;
+
+    //Ints
+    if (name == "gridX")
+        gridX = settingsFileIn.readElementText().toInt();
+    else if (name == "gridY")
+        gridY = settingsFileIn.readElementText().toInt();
+    else if (name == "settleTolerance")
+        settleTolerance = settingsFileIn.readElementText().toInt();
+    else if (name == "slotsPerSquare")
+        slotsPerSquare = settingsFileIn.readElementText().toInt();
+    else if (name == "startAge")
+        startAge = settingsFileIn.readElementText().toInt();
+    else if (name == "dispersal")
+        dispersal = settingsFileIn.readElementText().toInt();
+    else if (name == "food")
+        food = settingsFileIn.readElementText().toInt();
+    else if (name == "breedCost")
+        breedCost = settingsFileIn.readElementText().toInt();
+    else if (name == "mutate")
+        mutate = settingsFileIn.readElementText().toInt();
+    else if (name == "maxDifference")
+        maxDifference = settingsFileIn.readElementText().toInt();
+    else if (name == "breedThreshold")
+        breedThreshold = settingsFileIn.readElementText().toInt();
+    else if (name == "target")
+        target = settingsFileIn.readElementText().toInt();
+    else if (name == "environmentChangeRate")
+        environmentChangeRate = settingsFileIn.readElementText().toInt();
+    else if (name == "environmentMode") {
+        int mode = settingsFileIn.readElementText().toInt();
+        if (mode != ENV_MODE_ONCE && mode != ENV_MODE_LOOP && mode != ENV_MODE_BOUNCE)
+            mode = ENV_MODE_STATIC;
+        environmentMode = static_cast<quint8>(mode);
+    }
+    //No Gui options for the remaining settings as yet.
+    else if (name == "speciesSamples")
+        speciesSamples = settingsFileIn.readElementText().toInt();
+    else if (name == "speciesSensitivity")
+        speciesSensitivity = settingsFileIn.readElementText().toInt();
+    else if (name == "timeSliceConnect")
+        timeSliceConnect = settingsFileIn.readElementText().toInt();
+    else if (name == "minSpeciesSize")
+        minSpeciesSize = static_cast<quint64>(settingsFileIn.readElementText().toInt());
+    else if (name == "speciesMode")
+        speciesMode = static_cast<quint8>(settingsFileIn.readElementText().toInt());
+
+    //Bools
+    else if (name == "recalculateFitness")
+        recalculateFitness = settingsFileIn.readElementText().toInt();
+    else if (name == "toroidal")
+        toroidal = settingsFileIn.readElementText().toInt();
+    else if (name == "nonspatial")
+        nonspatial = settingsFileIn.readElementText().toInt();
+    else if (name == "breedDifference")
+        breedDifference = settingsFileIn.readElementText().toInt();
+    else if (name == "breedSpecies")
+        breedSpecies = settingsFileIn.readElementText().toInt();
+    else if (name == "allowExcludeWithDescendants")
+        allowExcludeWithDescendants = settingsFileIn.readElementText().toInt();
+    else if (name == "sexual")
+        sexual = settingsFileIn.readElementText().toInt();
+    else if (name == "asexual")
+        asexual = settingsFileIn.readElementText().toInt();
+    else if (name == "logging")
+        logging = settingsFileIn.readElementText().toInt();
+    else if (name == "gui")
+        gui = settingsFileIn.readElementText().toInt();
+    else if (name == "environmentInterpolate")
+        environmentInterpolate = settingsFileIn.readElementText().toInt();
+    //No gui options for below
+    else if (name == "fitnessLoggingToFile")
+        fitnessLoggingToFile = settingsFileIn.readElementText().toInt();
+    else if (name == "hugePages")
+        hugePages = settingsFileIn.readElementText().toInt();
+    else if (name == "gridLayout")
+        gridLayout = settingsFileIn.readElementText().toInt();
+    else if (name == "randomSeed")
+        randomSeed = settingsFileIn.readElementText().toULongLong();
+    else if (name == "threadCount")
+        threadCount = settingsFileIn.readElementText().toInt();
+    else if (name == "pinThreads")
+        pinThreads = settingsFileIn.readElementText().toInt();
+    else if (name == "numaPlacement")
+        numaPlacement = settingsFileIn.readElementText().toInt();
+
+    return true;
+}
+
+/**
+ * @brief SimManager::isSettingElement
+ *
+ * The settings loadSettingsElement() reads - anything added there must be added here too
+ *
+ * @param name
+ * @return
+ */
+bool SimManager::isSettingElement(const QString &name)
+{
+    static const QStringList names = QStringList()
+                                     << "gridX" << "gridY" << "settleTolerance" << "slotsPerSquare" << "startAge"
+                                     << "dispersal" << "food" << "breedCost" << "mutate" << "maxDifference"
+                                     << "breedThreshold" << "target" << "environmentChangeRate" << "environmentMode"
+                                     << "speciesSamples" << "speciesSensitivity" << "timeSliceConnect"
+                                     << "minSpeciesSize" << "speciesMode" << "recalculateFitness" << "toroidal"
+                                     << "nonspatial" << "breedDifference" << "breedSpecies"
+                                     << "allowExcludeWithDescendants" << "sexual" << "asexual" << "logging" << "gui"
+                                     << "environmentInterpolate" << "fitnessLoggingToFile" << "hugePages"
+                                     << "gridLayout" << "randomSeed" << "threadCount" << "pinThreads"
+                                     << "numaPlacement";
+    return names.contains(name);
+}
+
+/**
+ * @brief SimManager::printSettings
+ * @return text
+ */
+QString SimManager::printSettings()
+{
+    QString settings;
+    QTextStream settingsOut(&settings);
+
+    settingsOut << "REvoSim settings:\n\n";
+
+    settingsOut << "- Integers:\n";
+    settingsOut << "-- Grid X: " << gridX << "\n";
+    settingsOut << "-- Grid Y: " << gridY << "\n";
+    settingsOut << "-- Settle tolerance: " << settleTolerance << "\n";
+    settingsOut << "-- Start age: " << startAge << "\n";
+    settingsOut << "-- Disperal: " << dispersal << "\n";
+    settingsOut << "-- Food: " << food << "\n";
+    settingsOut << "-- Breed cost: " << breedCost << "\n";
+    settingsOut << "-- Mutate: " << mutate << "\n";
+    settingsOut << "-- Max diff to breed: " << maxDifference << "\n";
+    settingsOut << "-- Breed threshold: " << breedThreshold << "\n";
+    settingsOut << "-- Slots per square: " << slotsPerSquare << "\n";
+    settingsOut << "-- Fitness target: " << target << "\n";
+    settingsOut << "-- Environmental change rate: " << environmentChangeRate << "\n";
+    settingsOut << "-- Minimum species size:" << minSpeciesSize << "\n";
+    settingsOut << "-- Environment mode:" << environmentMode << "\n";
+    settingsOut << "-- Random seed:" << runSeed << "\n";
+    settingsOut << "-- Speices mode:" << speciesMode << "\n";
+
+    settingsOut << "\n- Bools:\n";
+    settingsOut << "-- Recalculate fitness: " << recalculateFitness << "\n";
+    settingsOut << "-- Toroidal environment: " << toroidal << "\n";
+    settingsOut << "-- Interpolate environment: " << environmentInterpolate << "\n";
+    settingsOut << "-- Nonspatial setling: " << nonspatial << "\n";
+    settingsOut << "-- Enforce max diff to breed:" << breedDifference << "\n";
+    settingsOut << "-- Only breed within species:" << breedSpecies << "\n";
+    settingsOut << "-- Exclude species without descendants:" << allowExcludeWithDescendants << "\n";
+    settingsOut << "-- Huge pages:" << hugePages << "\n";
+    settingsOut << "-- Grid layout:" << cellLayout.mode << "\n";
+    settingsOut << "-- Threads:" << processorCount << "\n";
+    settingsOut << "-- Pin threads to CPUs:" << pinThreads << "\n";
+    settingsOut << "-- NUMA placement:" << numaPlacement << "\n";
+    settingsOut << "-- Breeding: ";
+    if (sexual)
+        settingsOut << "sexual" << "\n";
+    else if (asexual)
+        settingsOut << "asexual" << "\n";
+    else
+        settingsOut << "variable" << "\n";
+
+    return settings;
+}
+
+/**
+ * @brief SimManager::writeLog
+ *
+ * Writes main ongoing log - header on iteration 0, then one block per call
+ *
+ * @param logFileName
+ */
+void SimManager::writeLog(const QString &logFileName)
+{
+    QFile outputfile(logFileName);
+
+    if (iteration == 0) {
+        outputfile.open(QIODevice::WriteOnly | QIODevice::Text);
+        QTextStream out(&outputfile);
+        out << "New run ";
+        QDateTime t(QDateTime::currentDateTime());
+        out << t.toString(Qt::ISODate) << "\n\n";
+        out << "===================\n\n";
+        out << printSettings();
+        out << "\n\n";
+        out << "===================\n";
+        out << "\nFor each iteration, this log features:\n\n";
+        out << "- [I] Iteration Number\n";
+        out << "- [P] Population Grid Data:\n";
+        out << "-- Number of living digital organisms\n";
+        out << "-- Mean fitness of living digital organisms\n";
+        out << "-- Number of entries on the breed list\n";
+        out << "-- Number of failed breed attempts\n";
+        out << "-- Number of species\n";
+        out << "- [S] Species Data:\n";
+        out << "-- Species id\n";
+        out << "-- Species origin (iterations)\n";
+        out << "-- Species parent\n";
+        out << "-- Species current size (number of individuals)\n";
+        out << "-- Species current genome (for speed this is the genome of a randomly sampled individual, not the modal organism)\n\n";
+        out << "**Note that this excludes species with less individuals than Minimum species size, but is not able to exlude species without descendants, which can only be achieved with the end-run log.**\n\n";
+        out << "===================\n\n";
+        outputfile.close();
+    }
+
+    outputfile.open(QIODevice::Append | QIODevice::Text);
+    QTextStream out(&outputfile);
+
+    out << "[I] " << iteration << "\n";
+
+    //----RJG: Grid totals are kept up to date by iterate(), so no need to count them here
+    int gridNumberAlive = stats.alive;
+    quint64 gridTotalFitness = stats.totalFitness;
+    int gridBreedEntries = stats.breedEntries;
+    int gridBreedFails = stats.breedFails;
+    double meanFitness = double(gridTotalFitness) / double(gridNumberAlive);
+
+    out << "[P] " << gridNumberAlive << "," << meanFitness << "," << gridBreedEntries << "," <<
+        gridBreedFails << "," << oldSpeciesList.count() << "\n";
+
+    //----RJG: And species details for each iteration
+    for (int i = 0; i < oldSpeciesList.count(); i++) {
+        //----RJG: Unable to exclude species without descendants, for obvious reasons.
+        if (quint64(oldSpeciesList[i].size) > minSpeciesSize) {
+            out << "[S] ";
+            out << (oldSpeciesList[i].ID) << ",";
+            out << oldSpeciesList[i].originTime << ",";
+            out << oldSpeciesList[i].parent << ",";
+            out << oldSpeciesList[i].size << ",";
+            //---- RJG - output binary genome if needed
+            out << genomeBinary(oldSpeciesList[i].type);
+            out << "\n";
+        }
+    }
+    out << "\n";
+    outputfile.close();
+}
+
+/**
+ * @brief SimManager::writeRunData
+ *
+ * Writes the end of run log - settings, tree and species data
+ *
+ * @param logFileName
+ */
+void SimManager::writeRunData(const QString &logFileName)
+{
+    QFile outputfile(logFileName);
+    outputfile.open(QIODevice::WriteOnly | QIODevice::Text);
+    QTextStream out(&outputfile);
+
+    AnalysisTools a;
+
+    out << "End run log ";
+    QDateTime t(QDateTime::currentDateTime());
+    out << t.toString(Qt::ISODate) << "\n\n===================\n\n" << printSettings() <<
+        "\n\n===================\n";
+    out << "\nThis log features the tree from a finished run, in Newick format, and then data for all the species that have existed with more individuals than minimum species size. The exact data provided depends on the phylogeny tracking mode selected in the GUI.\n";
+    out << "\n\n===================\n\n";
+    out << "Tree:\n\n";
+    if (speciesMode >= SPECIES_MODE_PHYLOGENY)
+        out << a.makeNewick(rootSpecies, minSpeciesSize, allowExcludeWithDescendants);
+    else
+        out << "Species tracking is not enabled.";
+    out << "\n\nSpecies data:\n\n";
+    if (speciesMode == SPECIES_MODE_PHYLOGENY_AND_METRICS)
+        out << a.writeData(rootSpecies, minSpeciesSize, allowExcludeWithDescendants);
+    else
+        out << "Species tracking is not enabled, or is set to phylogeny only.";
+    outputfile.close();
+}
+
+/**
+ * @brief SimManager::showWarning
+ *
+ * Modal warning in the GUI, console warning in the command line build
+ *
+ * @param title
+ * @param text
+ */
+void SimManager::showWarning(const QString &title, const QString &text)
+{
+#ifndef REVOSIM_CLI
+    QMessageBox::warning(nullptr, title, text);
+#else
+    qWarning().noquote() << title + ":" << text;
+#endif
+}
+
+/**
+ * @brief SimManager::setStatusText
+ * @param text
+ */
+void SimManager::setStatusText(const QString &text)
+{
+#ifndef REVOSIM_CLI
+    mainWindow->setStatusBarText(text);
+#else
+    if (!text.isEmpty())
+        qInfo().noquote() << text;
+#endif
+}
+
 /**
  * @brief SimManager::testcode
  *
@@ -925,12 +2314,7 @@ void SimManager::testcode()
  *
  * @param genome
  */
-void SimManager::debugGenome(quint64 genome)
+void SimManager::debugGenome(const Genome &genome)
 {
-    QString newGenome;
-    for (int i = 0; i < 64; i++) {
-        if (tweakers64[63 - i] & genome) newGenome.append("1");
-        else newGenome.append("0");
-    }
-    qDebug() << newGenome;
+    qDebug() << genomeBinary(genome);
 }
@@ -22,24 +22,38 @@
 #define SIMMANAGER_H
 
 #include "analyser.h"
+#include "arena.h"
 #include "critter.h"
+#include "environmentcache.h"
+#include "fitnesskernel.h"
+#include "philox.h"
 #include "logspecies.h"
+#include "perfcounters.h"
+#include "workerpool.h"
 
-#include <QFuture>
-#include <QGraphicsPixmapItem>
 #include <QImage>
-#include <QMutex>
-#include <QPlainTextEdit>
+#include <QPoint>
 #include <QStringList>
-#include <QtConcurrentRun>
+#include <QtAlgorithms>
 #include <QTime>
+#include <QXmlStreamReader>
 
 #define RAND_SEED 10000
 #define PREROLLED_RANDS 60000
 #define MAX_GENOME_COUNT 100000 //hopefully big enough for all species
-#define GRID_X 256
-#define GRID_Y 256
+#define STRIP_CRITTER_WEIGHT 8 //a living critter is about this many times the work of an empty square when splitting strips
+#define NUMA_REPORT_SAMPLES 256 //pages looked up per worker when reporting NUMA placement
+#define ENVIRONMENT_COMPARE_SQUARES 64 //squares compared at once when a new environment image is loaded, so unchanged runs are skipped
+#define GRID_X 2048 //largest grid - GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE must fit in an int (see critterIndex)
+#define GRID_Y 2048
 #define SLOTS_PER_GRID_SQUARE 256
+#define GRID_LAYOUT_AUTO 0 //columns, or tiles for grids bigger than TILE_GRID_THRESHOLD either way
+#define GRID_LAYOUT_COLUMNS 1
+#define GRID_LAYOUT_TILES 2
+#define GRID_LAYOUT_MORTON 3
+#define TILE_GRID_THRESHOLD 256
+#define TILE_SHIFT 3 //8 x 8 squares, column by column
+#define MORTON_TILE_SHIFT 5 //32 x 32 squares, in Z-order
 #define SPECIES_MODE_NONE 0
 #define SPECIES_MODE_BASIC 1
 #define SPECIES_MODE_PHYLOGENY 2
@@ -48,6 +62,24 @@
 #define ENV_MODE_ONCE 1
 #define ENV_MODE_LOOP 2
 #define ENV_MODE_BOUNCE 3
+#define RANDOM_STREAM_BREED 0
+#define RANDOM_STREAM_SETTLE 1
+#define RANDOM_STREAM_CROSSOVER 2 //and 3 - the crossover bits for words after the first of a wide genome
+#define SEED_STREAM_SETUP 0 //qsrand for the xorMasks, founder and starting ages when a seed is set (see SimManager::seedValue)
+#define SEED_STREAM_RANDOMS 1 //offset into a randoms file
+
+//Settings each iterateParallel variant is compiled for - see SimManager::selectKernels()
+#define KERNEL_RECALCULATE_FITNESS 1
+#define KERNEL_ASEXUAL 2
+#define KERNEL_BREED_SPECIES 4
+#define KERNEL_BREED_DIFFERENCE 8
+#define KERNEL_LOG_BREEDING 16 //fitnessLoggingToFile or logging
+#define ITERATE_KERNEL_COUNT 32
+
+//Settings each settleDestinations variant is compiled for
+#define KERNEL_TOROIDAL 1
+#define KERNEL_NONSPATIAL 2
+#define SETTLE_KERNEL_COUNT 4
 
 // Settable ints
 extern int gridX;
@@ -62,7 +94,8 @@ extern int breedThreshold;
 extern int breedCost;
 extern int maxDifference;
 extern int mutate;
-extern quint64 reseedGenome;
+extern int gridLayout; //GRID_LAYOUT_ - how squares are ordered in memory, see CellLayout
+extern Genome reseedGenome;
 extern int nextEnvironmentChange;
 extern int environmentChangeCounter;
 extern quint8 environmentMode;
@@ -84,36 +117,171 @@ extern bool reseedDual;
 extern bool environmentChangeForward;
 extern bool environmentInterpolate;
 extern bool allowExcludeWithDescendants;
+extern bool hugePages;
+extern int threadCount; //0 = one per CPU
+extern bool pinThreads;
+extern bool numaPlacement; //pin threads, fix the strips, and put each strip's memory on its thread's node
+extern int firstCpu; //pinned threads start here - set for concurrent replicates
+extern quint64 randomSeed; //0 = pick one at the start of each run
+extern quint64 runSeed; //seed in use for this run
 
 extern quint32 tweakers[32]; // the 32 single bit XOR values (many uses!)
 extern quint64 tweakers64[64]; // 64-bit versions
 extern quint32 bitCounts[65536]; // the bytes representing bit count of each number 0-635535
-extern quint32 xorMasks[256][3]; //determine fitness - just 32 bit (lower bit of genome)
+extern quint32 xorMasks[256][GENOME_MASKS]; //determine fitness - just 32 bit (lower bit of each genome word)
 extern int dispersalX[256][256];
 extern int dispersalY[256][256];
-extern quint64 geneX[65536];
-extern int nextGeneX;
 extern quint8 probabilityBreed[65536][16];
 
 // Randoms
 extern quint8 randoms[65536];
 extern quint16 nextRandom;
 
+// Dimensions the arena arrays were allocated with
+extern int allocatedGridX;
+extern int allocatedGridY;
+extern int allocatedSlots;
+
+/**
+ * @brief The CellLayout struct
+ *
+ * Where each square goes in the per-square and critter arrays. Squares are grouped into tiles 2^shift squares a side,
+ * and the tiles stored a column of tiles at a time, so the squares in any run of whole tile columns are contiguous.
+ * Within a tile, squares go column by column (GRID_LAYOUT_TILES) or in Z-order (GRID_LAYOUT_MORTON - the bits of x
+ * and y interleaved), so that neighbours both ways are close in memory. A shift of 0 is plain columns of squares,
+ * as the fixed size arrays had. The grid is padded to whole tiles.
+ */
+struct CellLayout {
+    int mode = GRID_LAYOUT_COLUMNS;
+    int shift = 0;
+    int mask = 0;
+    int rows = 0; //tiles in each column of tiles
+    int tileCells = 1;
+    int offsetX[1 << MORTON_TILE_SHIFT] {}; //each square's place in its tile is offsetX[x & mask] + offsetY[y & mask]
+    int offsetY[1 << MORTON_TILE_SHIFT] {};
+    quint8 tileX[1 << (2 * MORTON_TILE_SHIFT)] {}; //and back again
+    quint8 tileY[1 << (2 * MORTON_TILE_SHIFT)] {};
+
+    static int resolve(int layout, int width, int height);
+    void set(int layout, int width, int height);
+    int cellCount(int width) const;
+
+    int index(int x, int y) const
+    {
+        return ((((x >> shift) * rows) + (y >> shift)) << (2 * shift)) + offsetX[x & mask] + offsetY[y & mask];
+    }
+
+    int xOf(int cell) const
+    {
+        return (((cell >> (2 * shift)) / rows) << shift) + tileX[cell & (tileCells - 1)];
+    }
+
+    int yOf(int cell) const
+    {
+        return (((cell >> (2 * shift)) % rows) << shift) + tileY[cell & (tileCells - 1)];
+    }
+};
+
+extern CellLayout cellLayout; //the layout the arena arrays were allocated with
+extern int allocatedCells; //squares in the per-square arrays, padding included
+
+/**
+ * @brief cellIndex
+ * @return position of square x,y in the per-square arrays - squares of a strip (see SimManager::partitionStrips) are
+ * contiguous
+ */
+inline int cellIndex(int x, int y)
+{
+    return cellLayout.index(x, y);
+}
+
+inline int cellX(int cell)
+{
+    return cellLayout.xOf(cell);
+}
+
+inline int cellY(int cell)
+{
+    return cellLayout.yOf(cell);
+}
+
+/**
+ * @brief squareNumber
+ * @return x * gridY + y - numbers the squares the same way whatever the cell layout
+ */
+inline int squareNumber(int x, int y)
+{
+    return x * allocatedGridY + y;
+}
+
+/**
+ * @brief The CellArray class
+ *
+ * One value per square, in cellIndex order, carved from the arena - array[x][y] works as it did for the fixed size
+ * [GRID_X][GRID_Y] arrays these replace. Loops that already have the cellIndex use array.data[cell].
+ */
+template <typename T> class CellArray
+{
+public:
+    class Column
+    {
+    public:
+        Column(T *data, int x) : data(data), x(x) {}
+        T &operator[](int y) const
+        {
+            return data[cellIndex(x, y)];
+        }
+    private:
+        T *data;
+        int x;
+    };
+
+    Column operator[](int x) const
+    {
+        return Column(data, x);
+    }
+
+    T *data = nullptr;
+};
+
+/**
+ * @brief The ColumnGrid class
+ *
+ * One value per square, a column of allocatedGridY squares at a time whatever the cell layout - grid[x] is the start
+ * of column x. The environment is kept like this, as images are copied in and blended whole columns at a time.
+ */
+template <typename T> class ColumnGrid
+{
+public:
+    T *operator[](int x) const
+    {
+        return data + x * allocatedGridY;
+    }
+
+    T *data = nullptr;
+};
+
 // Globabl data
-extern Critter critters[GRID_X][GRID_Y][SLOTS_PER_GRID_SQUARE]; //main array - static for speed
-extern quint8 environment[GRID_X][GRID_Y][3];  //0 = red, 1 = green, 2 = blue
-extern quint8 environmentLast[GRID_X][GRID_Y][3];  //Used for interpolation
-extern quint8 environmentNext[GRID_X][GRID_Y][3];  //Used for interpolation
-extern quint32 totalFitness[GRID_X][GRID_Y]; // Sum fitness critters in each square
+// Global data - these big arrays live in the simulation manager's arena, sized for the current grid (see SimManager::allocateArrays)
+// Critter data - one array per field, indexed by critterIndex()
+extern quint16 *critterAge; // 0 = dead slot
+extern quint8 *critterFitness;
+extern qint32 *critterEnergy; // breeding energy
+extern Genome *critterGenome;
+extern quint64 *critterSpeciesID;
+extern ColumnGrid<quint8[3]> environment;  //0 = red, 1 = green, 2 = blue
+extern ColumnGrid<quint8[3]> environmentLast;  //Used for interpolation
+extern ColumnGrid<quint8[3]> environmentNext;  //Used for interpolation
+extern CellArray<quint32[GENOME_MASKS]> environmentMasks; //xorMasks for each square's current colour
+extern quint64 *environmentDirty; //columnWords per column - bit set when a square's colour changes, cleared once fitness is recalculated
+extern quint64 *occupancy; //occupancyWords per square - bit set for each slot with a living critter
+extern int occupancyWords;
+extern quint64 *activeCells; //columnWords per column - bit set for each square with anything living in it
+extern int columnWords; //words per column in the bit per square arrays - one column is never split between threads
+extern QVector<QPoint> activeCellList; //the squares in activeCells, in grid order, as of the end of the last iteration
+extern CellArray<quint32> totalFitness; // Sum fitness critters in each square
 extern quint64 iteration;
 
-//These next to hold the babies... old style arrays for max speed
-extern quint64 newGenomes[GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2];
-extern quint32 newGenomeX[GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2];
-extern quint32 newGenomeY[GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2];
-extern int newGenomeDispersal[GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2];
-extern quint64 newGenomeSpecies[GRID_X * GRID_Y * SLOTS_PER_GRID_SQUARE * 2];
-extern int newGenomeCount;
 
 extern int environmentChangeRate;
 extern int speciesSamples; // no longer used - keep for backwards compat of files
@@ -131,11 +299,11 @@ extern quint64 lastSpeciesCalculated;
 extern quint64 lastReport;
 
 // Analysis
-extern int breedAttempts[GRID_X][GRID_Y]; // for analysis purposes
-extern int breedFails[GRID_X][GRID_Y]; // for analysis purposes
-extern int settles[GRID_X][GRID_Y]; // for analysis purposes
-extern int settleFails[GRID_X][GRID_Y]; // for analysis purposes
-extern int maxUsed[GRID_X][GRID_Y]; // number of slots used within each grid square
+extern CellArray<int> breedAttempts; // for analysis purposes
+extern CellArray<int> breedFails; // for analysis purposes
+extern CellArray<int> settles; // for analysis purposes
+extern CellArray<int> settleFails; // for analysis purposes
+extern CellArray<int> maxUsed; // number of slots used within each grid square
 extern int aliveCount;
 extern int totalRecombination;
 
@@ -150,7 +318,220 @@ extern quint8 speciesMode;
 extern quint64 minSpeciesSize;
 extern quint64 ids;
 
-extern QMutex *mutexes[GRID_X][GRID_Y];
+
+/**
+ * @brief runRandoms
+ *
+ * The 128 random bits belonging to one critter's slot for one purpose (a RANDOM_STREAM) this iteration. These depend
+ * only on the run seed, iteration, square (see squareNumber), slot and stream, so runs repeat exactly whatever the
+ * thread count or cell layout.
+ */
+inline void runRandoms(int square, int slot, int stream, quint32 *out)
+{
+    Philox::generate(runSeed, static_cast<quint32>(iteration), static_cast<quint32>(iteration >> 32),
+                     static_cast<quint32>(square), (static_cast<quint32>(slot) << 8) | static_cast<quint32>(stream), out);
+}
+
+inline quint64 *cellOccupancy(int x, int y)
+{
+    return occupancy + cellIndex(x, y) * occupancyWords;
+}
+
+inline void setOccupied(quint64 *bits, int slot)
+{
+    bits[slot / 64] |= static_cast<quint64>(1) << (slot % 64);
+}
+
+inline void clearOccupied(quint64 *bits, int slot)
+{
+    bits[slot / 64] &= ~(static_cast<quint64>(1) << (slot % 64));
+}
+
+/**
+ * @brief firstFreeSlot
+ * @return lowest empty slot, or slotsPerSquare or more if the square is full
+ */
+inline int firstFreeSlot(const quint64 *bits)
+{
+    for (int w = 0; w < occupancyWords; w++)
+        if (~bits[w])
+            return w * 64 + static_cast<int>(qCountTrailingZeroBits(~bits[w]));
+    return occupancyWords * 64;
+}
+
+/**
+ * @brief highestOccupied
+ * @return highest living slot (i.e. maxUsed), -1 if the square is empty
+ */
+inline int highestOccupied(const quint64 *bits)
+{
+    for (int w = occupancyWords - 1; w >= 0; w--)
+        if (bits[w])
+            return w * 64 + 63 - static_cast<int>(qCountLeadingZeroBits(bits[w]));
+    return -1;
+}
+
+/**
+ * @brief cellPopulation
+ * @return number of living critters in the square
+ */
+inline int cellPopulation(int x, int y)
+{
+    const quint64 *bits = cellOccupancy(x, y);
+    int count = 0;
+    for (int w = 0; w < occupancyWords; w++)
+        count += FitnessKernel::bitCount64(bits[w]);
+    return count;
+}
+
+/**
+ * @brief columnActiveCells
+ *
+ * Each column has its own words, so threads working on different strips never share one
+ */
+inline quint64 *columnActiveCells(int x)
+{
+    return activeCells + x * columnWords;
+}
+
+inline void setCellActive(int x, int y)
+{
+    columnActiveCells(x)[y / 64] |= static_cast<quint64>(1) << (y % 64);
+}
+
+inline void clearCellActive(int x, int y)
+{
+    columnActiveCells(x)[y / 64] &= ~(static_cast<quint64>(1) << (y % 64));
+}
+
+inline bool environmentIsDirty(int x, int y)
+{
+    return environmentDirty[x * columnWords + y / 64] & (static_cast<quint64>(1) << (y % 64));
+}
+
+/**
+ * @brief critterIndex
+ * @return position of slot z of square x,y in the critter arrays - slots of a square are contiguous
+ */
+inline int critterIndex(int x, int y, int z)
+{
+    return cellIndex(x, y) * allocatedSlots + z;
+}
+
+inline Critter::Critter(int x, int y, int z) :
+    xPosition(x), yPosition(y), zPosition(z),
+    age(critterAge[critterIndex(x, y, z)]),
+    fitness(critterFitness[critterIndex(x, y, z)]),
+    energy(critterEnergy[critterIndex(x, y, z)]),
+    genome(critterGenome[critterIndex(x, y, z)]),
+    speciesID(critterSpeciesID[critterIndex(x, y, z)])
+{
+}
+
+/**
+ * @brief The CritterGrid class
+ *
+ * Lets critters[x][y][z] return a view of that slot in the critter arrays
+ */
+class CritterGrid
+{
+public:
+    class Square
+    {
+    public:
+        Square(int x, int y) : x(x), y(y) {}
+        Critter operator[](int z) const
+        {
+            return Critter(x, y, z);
+        }
+    private:
+        int x, y;
+    };
+
+    class Column
+    {
+    public:
+        explicit Column(int x) : x(x) {}
+        Square operator[](int y) const
+        {
+            return Square(x, y);
+        }
+    private:
+        int x;
+    };
+
+    Column operator[](int x) const
+    {
+        return Column(x);
+    }
+};
+
+extern CritterGrid critters;
+
+/**
+ * @brief The SettleEntry struct
+ *
+ * A baby and the square it is going to settle in
+ */
+struct SettleEntry {
+    const Offspring *baby;
+    int cell;
+};
+
+/**
+ * @brief The SimulationStats struct
+ *
+ * Grid wide totals for report() and writeLog(). Each thread counts its own share while it works, and these are added
+ * up once at the end of the iteration, so nothing needs to rescan the grid.
+ */
+struct SimulationStats {
+    int alive = 0;
+    quint64 totalFitness = 0;
+    int breedEntries = 0; //critters that tried to breed, this iteration
+    int breedFails = 0; //since the counters were last reset
+    int settles = 0; //since the counters were last reset
+    int settleFails = 0; //since the counters were last reset
+};
+
+/**
+ * @brief The WorkerBuffers struct
+ *
+ * Scratch space for one worker thread, kept between iterations so it only ever grows
+ */
+struct WorkerBuffers {
+    QVector<Offspring> offspring; //babies bred in this thread's strip
+    QVector<int> destinations; //cellIndex each baby lands in, -1 if it falls off the grid
+    QVector<int> cellStarts; //counting sort of the babies settling in this thread's strip
+    QVector<const Offspring *> sorted;
+    SimulationStats counts; //this thread's share of the stats for the current iteration
+    PerfCounters settleCounters; //only open while profiling the settle stages
+};
+
+/**
+ * @brief The PlacedArray struct
+ *
+ * An arena array for placeArrays() to share out strip by strip - unitBytes is per square, in cell order, or per
+ * column of the grid
+ */
+struct PlacedArray {
+    void *data;
+    size_t unitBytes;
+    bool perColumn;
+};
+
+/**
+ * @brief The SettleProfile struct
+ *
+ * Time and hardware misses in the three settle stages, summed over the iterations since startSettleProfile()
+ */
+struct SettleProfile {
+    int iterations = 0;
+    qint64 nanoseconds = 0;
+    quint64 babies = 0; //babies that landed on the grid and tried to settle
+    bool counted = false; //false if the cache/TLB counters couldn't be opened on every thread
+    quint64 cacheMisses = 0;
+    quint64 tlbMisses = 0;
+};
 
 /**
  * @brief The SimManager class
@@ -159,27 +540,84 @@ class SimManager
 {
 public:
     SimManager();
+    ~SimManager();
 
     void setupRun();
+    void setupThreads();
+    void allocateArrays();
+    void invalidateEnvironment();
+    void rebuildOccupancy();
+    void buildActiveCellList();
     void testcode();
     void loadEnvironmentFromFile(int emode);
     bool iterate(int emode, bool interpolate);
     bool regenerateEnvironment(int emode, bool interpolate);
-    int iterateParallel(int firstX, int lastX, int newGenomesLocal, int *killCountLocal);
+    void interpolateEnvironment(int firstX, int lastX, int weight);
+    template <int Flags> int iterateParallel(int firstX, int lastX, QVector<Offspring> *offspring, int *killCountLocal,
+                                             SimulationStats *countsLocal);
     int portableRandom();
-    int settleParallel(int newGenomeCountsStart, int newGenomeCountsEnd, int *tryCountLocal, int *settleCountLocal, int *birthCountsLocal);
+    template <int Flags> int settleDestinations(int thread);
+    int settleScatter(int thread);
+    int settleParallel(int owner, int *tryCountLocal, int *settleCountLocal, int *birthCountsLocal);
+
+    bool loadSettingsElement(QXmlStreamReader &settingsFileIn);
+    static bool isSettingElement(const QString &name);
+    QString printSettings();
+    void calculateSpecies();
+    void writeLog(const QString &logFileName);
+    void writeRunData(const QString &logFileName);
+    void resetReportCounters();
+    void startSettleProfile();
+    SettleProfile stopSettleProfile();
+    QStringList numaReport();
+
+    void showWarning(const QString &title, const QString &text);
+    void setStatusText(const QString &text);
 
     int warningCount;
+    SimulationStats stats;
     quint8 random8();
     quint32 random32();
     quint64 random64();
+    Genome randomGenome();
+    static quint32 seedValue(quint64 seed, quint32 stream);
+
+    typedef int (SimManager::*IterateKernel)(int, int, QVector<Offspring> *, int *, SimulationStats *);
+    typedef int (SimManager::*SettleKernel)(int);
 
 private:
     void makeLookups();
-    void debugGenome(quint64 genome);
+    void makeMasks();
+    void selectKernels();
+    void debugGenome(const Genome &genome);
+    void setEnvironmentColour(int x, int y, quint8 red, quint8 green, quint8 blue);
+    void partitionStrips();
+    void placeArrays(const CellLayout &layout, const QVector<PlacedArray> &arrays);
+    bool stepEnvironmentFile(int emode, int *file, bool *forward) const;
+    void countColumns(int firstX, int lastX);
 
+    IterateKernel iterateKernel; //the variants for the current settings
+    SettleKernel settleKernel;
     int processorCount;
-    QList<QFuture<int>*> futuresList;
+    WorkerPool *workerPool;
+    QList<WorkerBuffers*> workerBuffers; //one per thread
+    QVector<int> ownerOfX; //which thread's strip each column is in
+    QVector<int> stripStarts; //first column of each thread's strip, then gridX
+    QVector<int> columnLive; //living critters in each column after the last iteration - used to balance the strips
+    QVector<int> settleOffsets; //processorCount x processorCount - babies from each thread for each strip, then where they go
+    QVector<int> ownerStarts; //where each strip's babies start in settleEntries
+    QVector<SettleEntry> settleEntries; //all the babies that land on the grid, grouped by strip
+    Analyser *analyser;
+    EnvironmentCache *environmentCache;
+    Arena *arena;
+    bool allocatedHugePages;
+    bool allocatedNumaPlacement;
+    int allocatedThreads; //with NUMA placement, the worker pool the arrays were placed for - see placeArrays()
+    int allocatedFirstCpu;
+    int maskedTarget; //fitness settings the dirty bits are relative to - a change means recalculating everywhere
+    int maskedSettleTolerance;
+    bool profiling; //time and count the settle stages in iterate()
+    SettleProfile settleProfile;
 
 };
 
@@ -23,7 +23,7 @@
  * @param f
  * @param c
  */
-SortableGenome::SortableGenome(quint64 iteration, int f, int c)
+SortableGenome::SortableGenome(const Genome &iteration, int f, int c)
 {
     fit = f;
     count = c;
@@ -18,6 +18,8 @@
 #ifndef SORTABLEGENOME_H
 #define SORTABLEGENOME_H
 
+#include "genome.h"
+
 #include "QtGlobal"
 
 /**
@@ -26,14 +28,14 @@
 class SortableGenome
 {
 public:
-    SortableGenome(quint64 genome, int f, int c);
+    SortableGenome(const Genome &genome, int f, int c);
 
     bool operator<(const SortableGenome &rhs) const;
     bool operator==(const SortableGenome &rhs) const;
     int fit;
     int group;
     int count;
-    quint64 genome;
+    Genome genome;
 };
 
 #endif // SORTABLEGENOME_H
@@ -0,0 +1,535 @@
+/**
+ * @file
+ * Sweep
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#include "sweep.h"
+#include "simmanager.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QPair>
+#include <QProcess>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_UNIX)
+#include <cerrno>
+#include <signal.h>
+#endif
+
+/*!
+ * \brief Sweep::Sweep
+ * \param sweepPath folder for the sweep - created if needed
+ */
+Sweep::Sweep(const QString &sweepPath)
+{
+    directory = QDir(sweepPath);
+    jobCount = 0;
+}
+
+/*!
+ * \brief Sweep::setUp
+ * \param baseSettingsFilename settings shared by every job - may be empty, for the defaults
+ * \param parameters one per swept setting, e.g. "mutate=5,10,20" or "food=1000:3000:500" (start:end:step)
+ * \return true if the jobs are ready to run
+ *
+ * Write a settings file for every combination of the parameter values. If the sweep folder already holds a sweep,
+ * this carries on with that one instead, and the parameters are ignored.
+ */
+bool Sweep::setUp(const QString &baseSettingsFilename, const QStringList &parameters)
+{
+    QFile jobsFile(directory.filePath("jobs.csv"));
+    if (jobsFile.exists())
+    {
+        if (!jobsFile.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            qCritical().noquote() << "Can't read" << jobsFile.fileName();
+            return false;
+        }
+        QTextStream in(&jobsFile);
+        while (!in.atEnd())
+        {
+            QString line = in.readLine();
+            if (!line.isEmpty())
+                jobLines.append(line);
+        }
+        jobCount = jobLines.count() - 1;
+
+        //anything still marked running was cut short when the sweep stopped - unless its process outlived the sweep
+        for (int job = 1; job <= jobCount; job++)
+        {
+            JobState jobState = readState(job);
+            if (jobState.state == "running" && processRunning(jobState.pid))
+            {
+                qCritical().noquote() << QString("%1 is still running as process %2, from when the sweep was stopped - wait for it to finish or stop it, then run the sweep again")
+                                      .arg(jobName(job)).arg(jobState.pid);
+                return false;
+            }
+        }
+
+        int requeued = 0;
+        for (int job = 1; job <= jobCount; job++)
+        {
+            JobState jobState = readState(job);
+            jobState.pid = 0;
+            if (jobState.state == "running" && moveState(job, "running", "pending", jobState))
+                requeued++;
+        }
+
+        if (!parameters.isEmpty())
+            qWarning().noquote() << "Carrying on the sweep in" << directory.path() << "- the parameters given are ignored";
+        qInfo().noquote() << "Carrying on the sweep in" << directory.path() << "-" << requeued << "interrupted jobs requeued";
+        return true;
+    }
+
+    QStringList names;
+    QList<QStringList> values;
+    for (const QString &parameter : parameters)
+    {
+        QString name;
+        QStringList parameterValues;
+        if (!parseParameter(parameter, &name, &parameterValues))
+        {
+            qCritical().noquote() << "Can't read sweep parameter" << parameter << "- expected e.g. mutate=5,10,20 or food=1000:3000:500";
+            return false;
+        }
+        //a misspelt name would be ignored by every job, giving a sweep of identical runs
+        if (!SimManager::isSettingElement(name) && name != "refreshRate")
+        {
+            qCritical().noquote() << "Can't sweep" << name << "- it isn't a setting (names are as in a saved settings file, e.g. mutate)";
+            return false;
+        }
+        names.append(name);
+        values.append(parameterValues);
+    }
+
+    if (names.isEmpty())
+    {
+        qCritical() << "No parameters to sweep";
+        return false;
+    }
+
+    if (!directory.mkpath("jobs") || !directory.mkpath("queue"))
+    {
+        qCritical().noquote() << "Can't create the sweep folder" << directory.path();
+        return false;
+    }
+
+    jobLines.append(QString("job,%1").arg(names.join(",")));
+
+    //every combination - the last parameter changes fastest
+    QVector<int> position(names.count(), 0);
+    int job = 0;
+    while (true)
+    {
+        QStringList jobValues;
+        for (int i = 0; i < names.count(); i++)
+            jobValues.append(values[i][position[i]]);
+
+        job++;
+        if (!writeJobSettings(baseSettingsFilename, names, jobValues, job))
+            return false;
+        if (!moveState(job, QString(), "pending", JobState()))
+        {
+            qCritical().noquote() << "Can't write to" << directory.filePath("queue");
+            return false;
+        }
+        jobLines.append(QString("%1,%2").arg(jobName(job), jobValues.join(",")));
+
+        int i = names.count() - 1;
+        while (i >= 0 && ++position[i] == values[i].count())
+            position[i--] = 0;
+        if (i < 0)
+            break;
+    }
+    jobCount = job;
+
+    //written last - until it exists, running the sweep again sets it up afresh
+    if (!jobsFile.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qCritical().noquote() << "Can't write" << jobsFile.fileName();
+        return false;
+    }
+    QTextStream out(&jobsFile);
+    for (const QString &line : jobLines)
+        out << line << "\n";
+
+    qInfo().noquote() << "Sweep of" << jobCount << "jobs set up in" << directory.path();
+    return true;
+}
+
+/*!
+ * \brief Sweep::run
+ * \param jobs how many to run at once
+ * \param arguments passed to every job, e.g. iterations and environment
+ * \return 0 if every job completed, otherwise 1
+ *
+ * Run jobs until none are left pending. Each job is a revosim-cli process, given its settings file, output folder and
+ * an equal share of the CPUs - from firstCpu on, if pinning. A sweep that would pin more CPUs than there are is
+ * refused.
+ */
+int Sweep::run(int jobs, const QStringList &arguments)
+{
+    int cpus = qMax(1, QThread::idealThreadCount());
+    jobs = qMax(1, jobs);
+    int threads = threadCount > 0 ? threadCount : qMax(1, cpus / jobs);
+
+    if ((pinThreads || numaPlacement) && firstCpu + jobs * threads > cpus)
+    {
+        qCritical().noquote() << QString("Pinning %1 jobs at a time with %2 threads each from CPU %3 needs %4 CPUs, but there are %5 - use fewer jobs or threads, or don't pin")
+                              .arg(jobs).arg(threads).arg(firstCpu).arg(firstCpu + jobs * threads).arg(cpus);
+        return 1;
+    }
+
+    QVector<QProcess *> running(jobs, nullptr); //by job slot, which picks the CPUs used if pinning
+    QVector<int> runningJob(jobs, 0);
+    QVector<QElapsedTimer> runningTimer(jobs);
+
+    int failed = 0;
+    while (true)
+    {
+        //start pending jobs in any free slots - retried jobs come round again in order
+        int candidate = 1;
+        for (int slot = 0; slot < jobs; slot++)
+        {
+            if (running[slot])
+                continue;
+
+            while (candidate <= jobCount && readState(candidate).state != "pending")
+                candidate++;
+            if (candidate > jobCount)
+                break;
+
+            int job = candidate++;
+            JobState jobState = readState(job);
+            jobState.attempts++;
+            if (!moveState(job, "pending", "running", jobState))
+                continue;
+
+            directory.mkpath(jobName(job));
+            QString output = directory.filePath(jobName(job));
+
+            QStringList jobArguments = arguments;
+            jobArguments << "--settings" << directory.filePath(QString("jobs/%1.xml").arg(jobName(job)))
+                         << "--output" << output << "--threads" << QString::number(threads)
+                         << "--first-cpu" << QString::number(firstCpu + slot * threads);
+
+            auto *process = new QProcess;
+            process->setProcessChannelMode(QProcess::MergedChannels);
+            process->setStandardOutputFile(QDir(output).filePath("console.txt"), QIODevice::Append);
+            process->start(QCoreApplication::applicationFilePath(), jobArguments);
+
+            //so a restart can tell if the job outlived this sweep
+            if (process->waitForStarted())
+            {
+                jobState.pid = process->processId();
+                moveState(job, "running", "running", jobState);
+            }
+
+            running[slot] = process;
+            runningJob[slot] = job;
+            runningTimer[slot].start();
+            qInfo().noquote() << jobLines.value(job) << "started";
+        }
+
+        bool busy = false;
+        for (QProcess *process : running)
+            if (process)
+                busy = true;
+        if (!busy)
+            break;
+
+        for (int slot = 0; slot < jobs; slot++)
+        {
+            if (!running[slot] || (running[slot]->state() != QProcess::NotRunning && !running[slot]->waitForFinished(100)))
+                continue;
+
+            int job = runningJob[slot];
+            bool crashed = running[slot]->error() == QProcess::FailedToStart || running[slot]->exitStatus() != QProcess::NormalExit;
+            JobState jobState = readState(job);
+            jobState.exitCode = crashed ? -1 : running[slot]->exitCode();
+            jobState.seconds = runningTimer[slot].elapsed() / 1000.0;
+            jobState.pid = 0;
+
+            delete running[slot];
+            running[slot] = nullptr;
+
+            //exit code 2 is a population dying out - a result, not a failure
+            if (crashed && jobState.attempts < SWEEP_MAX_ATTEMPTS)
+            {
+                qWarning().noquote() << jobLines.value(job) << "crashed - will try again";
+                moveState(job, "running", "pending", jobState);
+            }
+            else if (!crashed && (jobState.exitCode == 0 || jobState.exitCode == 2))
+            {
+                qInfo().noquote() << jobLines.value(job) << "finished in" << jobState.seconds << "s";
+                moveState(job, "running", "done", jobState);
+            }
+            else
+            {
+                qWarning().noquote() << jobLines.value(job) << "failed - see" << QDir(directory.filePath(jobName(job))).filePath("console.txt");
+                moveState(job, "running", "failed", jobState);
+                failed++;
+            }
+
+            writeSummary();
+        }
+    }
+
+    writeSummary();
+    qInfo().noquote() << "Sweep finished -" << failed << "jobs failed. Summary in" << directory.filePath("summary.csv");
+    return failed ? 1 : 0;
+}
+
+/*!
+ * \brief Sweep::parseParameter
+ * \param parameter name=values, values being a comma separated list of values or start:end:step ranges
+ * \param name
+ * \param values
+ * \return false if it can't be read
+ */
+bool Sweep::parseParameter(const QString &parameter, QString *name, QStringList *values)
+{
+    QStringList parts = parameter.split("=");
+    if (parts.count() != 2 || parts[0].isEmpty() || parts[1].isEmpty())
+        return false;
+
+    *name = parts[0].trimmed();
+    for (const QString &item : parts[1].split(","))
+    {
+        QStringList range = item.split(":");
+        if (range.count() == 1)
+        {
+            values->append(item.trimmed());
+            continue;
+        }
+
+        bool startOk, endOk, stepOk;
+        int start = range[0].toInt(&startOk);
+        int end = range.value(1).toInt(&endOk);
+        int step = range.count() == 3 ? range[2].toInt(&stepOk) : 1;
+        if (range.count() == 2)
+            stepOk = true;
+        if (!startOk || !endOk || !stepOk || step <= 0 || end < start)
+            return false;
+        for (int value = start; value <= end; value += step)
+            values->append(QString::number(value));
+    }
+
+    return !values->isEmpty();
+}
+
+/*!
+ * \brief Sweep::writeJobSettings
+ * \param baseSettingsFilename
+ * \param names
+ * \param values
+ * \param job
+ * \return false if the base settings can't be read, or the job's can't be written
+ *
+ * The job's settings file is the base one with the swept settings replaced (or added).
+ */
+bool Sweep::writeJobSettings(const QString &baseSettingsFilename, const QStringList &names, const QStringList &values, int job)
+{
+    QList<QPair<QString, QString> > settings;
+
+    if (!baseSettingsFilename.isEmpty())
+    {
+        QFile baseFile(baseSettingsFilename);
+        if (!baseFile.open(QIODevice::ReadOnly))
+        {
+            qCritical().noquote() << "Error opening settings file" << baseSettingsFilename;
+            return false;
+        }
+
+        QXmlStreamReader settingsFileIn(&baseFile);
+        while (!settingsFileIn.atEnd() && !settingsFileIn.hasError())
+        {
+            if (settingsFileIn.readNext() != QXmlStreamReader::StartElement || settingsFileIn.name() == "revosim")
+                continue;
+            QString name = settingsFileIn.name().toString();
+            QString text = settingsFileIn.readElementText();
+            if (!names.contains(name))
+                settings.append(qMakePair(name, text));
+        }
+
+        if (settingsFileIn.hasError())
+        {
+            qCritical().noquote() << "Error reading settings file" << baseSettingsFilename << "-" << settingsFileIn.errorString();
+            return false;
+        }
+    }
+
+    for (int i = 0; i < names.count(); i++)
+        settings.append(qMakePair(names[i], values[i]));
+
+    QFile settingsFile(directory.filePath(QString("jobs/%1.xml").arg(jobName(job))));
+    if (!settingsFile.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qCritical().noquote() << "Can't write" << settingsFile.fileName();
+        return false;
+    }
+
+    QXmlStreamWriter settingsFileOut(&settingsFile);
+    settingsFileOut.setAutoFormatting(true);
+    settingsFileOut.writeStartDocument();
+    settingsFileOut.writeStartElement("revosim");
+    for (const auto &setting : settings)
+        settingsFileOut.writeTextElement(setting.first, setting.second);
+    settingsFileOut.writeEndElement();
+    settingsFileOut.writeEndDocument();
+    return true;
+}
+
+/*!
+ * \brief Sweep::jobName
+ * \param job numbered from 1
+ * \return
+ */
+QString Sweep::jobName(int job) const
+{
+    return QString("job_%1").arg(job, 4, 10, QChar('0'));
+}
+
+/*!
+ * \brief Sweep::queueFilename
+ * \param job
+ * \param state
+ * \return the file that marks the job as being in this state
+ */
+QString Sweep::queueFilename(int job, const QString &state) const
+{
+    return directory.filePath(QString("queue/%1.%2").arg(jobName(job), state));
+}
+
+/*!
+ * \brief Sweep::readState
+ * \param job
+ * \return the job's state, from whichever queue file it has
+ */
+Sweep::JobState Sweep::readState(int job) const
+{
+    JobState jobState;
+    for (const QString &state : QStringList() << "pending" << "running" << "done" << "failed")
+    {
+        QFile stateFile(queueFilename(job, state));
+        if (!stateFile.open(QIODevice::ReadOnly | QIODevice::Text))
+            continue;
+
+        jobState.state = state;
+        QTextStream in(&stateFile);
+        while (!in.atEnd())
+        {
+            QStringList pair = in.readLine().split("=");
+            if (pair.count() != 2)
+                continue;
+            if (pair[0] == "attempts")
+                jobState.attempts = pair[1].toInt();
+            else if (pair[0] == "exitCode")
+                jobState.exitCode = pair[1].toInt();
+            else if (pair[0] == "seconds")
+                jobState.seconds = pair[1].toDouble();
+            else if (pair[0] == "pid")
+                jobState.pid = pair[1].toLongLong();
+        }
+        break;
+    }
+    return jobState;
+}
+
+/*!
+ * \brief Sweep::moveState
+ * \param job
+ * \param from current state - empty for a new job, or the same as to to rewrite the state file
+ * \param to
+ * \param jobState written to the new state's file
+ * \return false if the job was not in the from state
+ *
+ * Renaming is the move, so a job is only ever in one state, even if the sweep is killed part way through.
+ */
+bool Sweep::moveState(int job, const QString &from, const QString &to, const JobState &jobState)
+{
+    QString toFilename = queueFilename(job, to);
+    if (!from.isEmpty() && from != to && !QFile::rename(queueFilename(job, from), toFilename))
+        return false;
+
+    QFile stateFile(toFilename);
+    if (!stateFile.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    QTextStream out(&stateFile);
+    out << "attempts=" << jobState.attempts << "\n";
+    out << "exitCode=" << jobState.exitCode << "\n";
+    out << "seconds=" << jobState.seconds << "\n";
+    if (jobState.pid)
+        out << "pid=" << jobState.pid << "\n";
+    return true;
+}
+
+/*!
+ * \brief Sweep::processRunning
+ * \param pid
+ * \return true if there is a process with this ID - which after a reboot could be some other program
+ */
+bool Sweep::processRunning(qint64 pid)
+{
+    if (pid <= 0)
+        return false;
+
+#if defined(Q_OS_WIN)
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+    if (!process)
+        return false;
+    bool running = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return running;
+#elif defined(Q_OS_UNIX)
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#else
+    return false;
+#endif
+}
+
+/*!
+ * \brief Sweep::writeSummary
+ *
+ * summary.csv - the parameters of every job, with how it went
+ */
+void Sweep::writeSummary()
+{
+    QFile summaryFile(directory.filePath("summary.csv"));
+    if (!summaryFile.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qWarning().noquote() << "Can't write" << summaryFile.fileName();
+        return;
+    }
+
+    QTextStream out(&summaryFile);
+    out << jobLines.value(0) << ",state,exit code,attempts,seconds\n";
+    for (int job = 1; job <= jobCount; job++)
+    {
+        JobState jobState = readState(job);
+        out << jobLines.value(job) << "," << jobState.state << "," << jobState.exitCode << ","
+            << jobState.attempts << "," << jobState.seconds << "\n";
+    }
+}
@@ -0,0 +1,81 @@
+/**
+ * @file
+ * Header: Sweep
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <QDir>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#define SWEEP_MAX_ATTEMPTS 3 //runs of a job that crashes before it is marked failed
+
+/**
+ * @brief The Sweep class
+ *
+ * Runs a grid of parameter settings as separate revosim-cli jobs, several at once. Everything lives in the sweep
+ * folder, so a sweep can be stopped (or crash) and be restarted with the same command:
+ *
+ * - jobs.csv: job number and the parameter values for each job
+ * - jobs/job_NNNN.xml: the settings file for each job - the base settings with that job's values
+ * - queue/job_NNNN.pending, .running, .done, .failed: each job's state, moved between states by renaming; the file
+ *   holds the attempts so far, last exit code and run time
+ * - job_NNNN/: each job's output folder, including console.txt, everything the job printed
+ * - summary.csv: jobs.csv plus the state, exit code, attempts and time of every job, rewritten as each job finishes
+ *
+ * A job that crashes is run again, up to SWEEP_MAX_ATTEMPTS times. Jobs left running when a sweep stopped are run
+ * again from the start when it restarts - unless the job's process is still going, in which case the sweep won't
+ * restart until it has finished or been stopped, as both would write to the same folder.
+ */
+class Sweep
+{
+public:
+    explicit Sweep(const QString &sweepPath);
+
+    bool setUp(const QString &baseSettingsFilename, const QStringList &parameters);
+    int run(int jobs, const QStringList &arguments);
+
+private:
+    /*!
+     * \brief The JobState struct
+     */
+    struct JobState
+    {
+        QString state; //pending, running, done or failed
+        int attempts = 0;
+        int exitCode = 0;
+        double seconds = 0;
+        qint64 pid = 0; //process running the job, while it's running
+    };
+
+    static bool parseParameter(const QString &parameter, QString *name, QStringList *values);
+    static bool processRunning(qint64 pid);
+    bool writeJobSettings(const QString &baseSettingsFilename, const QStringList &names, const QStringList &values, int job);
+    QString jobName(int job) const;
+    QString queueFilename(int job, const QString &state) const;
+    JobState readState(int job) const;
+    bool moveState(int job, const QString &from, const QString &to, const JobState &jobState);
+    void writeSummary();
+
+    QDir directory;
+    QStringList jobLines; //jobs.csv, header first
+    int jobCount;
+};
+
+#endif // SWEEP_H
@@ -0,0 +1,322 @@
+/**
+ * @file
+ * Worker Pool
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#include "workerpool.h"
+
+#include <QMutexLocker>
+
+#include <cstring>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_PROCESSOR_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief cpuRelax
+ *
+ * Tell the CPU we're spinning - saves power and lets a hyperthread sibling get on
+ */
+static inline void cpuRelax()
+{
+#ifdef Q_PROCESSOR_X86
+    _mm_pause();
+#endif
+}
+
+/**
+ * @brief saveAffinity
+ * @return the CPUs the calling thread may run on, in the OS's own form
+ */
+static QByteArray saveAffinity()
+{
+#if defined(Q_OS_WIN)
+    //a thread starts with its process's CPUs, and Windows has no call to read a thread's own
+    DWORD_PTR processMask = 0;
+    DWORD_PTR systemMask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) return QByteArray();
+    return QByteArray(reinterpret_cast<const char *>(&processMask), sizeof(processMask));
+#elif defined(Q_OS_LINUX)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) return QByteArray();
+    return QByteArray(reinterpret_cast<const char *>(&cpus), sizeof(cpus));
+#else
+    return QByteArray();
+#endif
+}
+
+/**
+ * @brief restoreAffinity
+ *
+ * Put back CPUs saved by saveAffinity() for the calling thread
+ */
+static void restoreAffinity(const QByteArray &affinity)
+{
+#if defined(Q_OS_WIN)
+    DWORD_PTR mask;
+    if (affinity.size() != sizeof(mask)) return;
+    memcpy(&mask, affinity.constData(), sizeof(mask));
+    SetThreadAffinityMask(GetCurrentThread(), mask);
+#elif defined(Q_OS_LINUX)
+    cpu_set_t cpus;
+    if (affinity.size() != sizeof(cpus)) return;
+    memcpy(&cpus, affinity.constData(), sizeof(cpus));
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+    Q_UNUSED(affinity)
+#endif
+}
+
+/**
+ * @brief WorkerThread::WorkerThread
+ * @param workerPool
+ * @param workerIndex
+ */
+WorkerThread::WorkerThread(WorkerPool *workerPool, int workerIndex)
+{
+    pool = workerPool;
+    index = workerIndex;
+}
+
+/**
+ * @brief WorkerThread::run
+ */
+void WorkerThread::run()
+{
+    if (pool->pinToCpus)
+        WorkerPool::pinCurrentThread(pool->pinOffset + index);
+
+    pool->workerLoop(index);
+}
+
+/**
+ * @brief WorkerPool::WorkerPool
+ *
+ * The calling thread counts as worker 0, so workers - 1 threads are started. If pinning, worker n (including the
+ * caller) is tied to CPU firstCpu + n.
+ *
+ * @param workers
+ * @param pin
+ * @param firstCpu lets several pools (e.g. concurrent replicates) share a machine without sharing CPUs
+ */
+WorkerPool::WorkerPool(int workers, bool pin, int firstCpu)
+{
+    workerCount = qMax(1, workers);
+    pinToCpus = pin;
+    pinOffset = qMax(0, firstCpu);
+    stopping = false;
+    spinLimit = workerCount <= QThread::idealThreadCount() ? WORKER_POOL_SPIN_LIMIT : 0;
+
+    if (pinToCpus) {
+        callerAffinity = saveAffinity();
+        pinCurrentThread(pinOffset);
+    }
+
+    for (int i = 1; i < workerCount; i++) {
+        auto *thread = new WorkerThread(this, i);
+        threads.append(thread);
+        thread->start();
+    }
+}
+
+/**
+ * @brief WorkerPool::~WorkerPool
+ */
+WorkerPool::~WorkerPool()
+{
+    stopping = true;
+    generation.fetchAndAddOrdered(1);
+    {
+        QMutexLocker locker(&mutex);
+        startCondition.wakeAll();
+    }
+
+    for (WorkerThread *thread : threads) {
+        thread->wait();
+        delete thread;
+    }
+
+    //the caller - often the GUI thread - isn't ours to keep on one CPU
+    if (pinToCpus)
+        restoreAffinity(callerAffinity);
+}
+
+/**
+ * @brief WorkerPool::run
+ *
+ * Run job(n) for every worker n, and wait for them all
+ *
+ * @param newJob
+ */
+void WorkerPool::run(const std::function<void(int)> &newJob)
+{
+    if (workerCount == 1) {
+        newJob(0);
+        return;
+    }
+
+    job = newJob;
+    remaining.storeRelease(workerCount - 1);
+    generation.fetchAndAddOrdered(1);
+
+    //Only take the lock if someone has given up spinning
+    if (sleepingWorkers.loadAcquire() > 0) {
+        QMutexLocker locker(&mutex);
+        startCondition.wakeAll();
+    }
+
+    job(0);
+
+    int spins = 0;
+    while (remaining.loadAcquire() > 0 && spins++ < spinLimit)
+        cpuRelax();
+
+    if (remaining.loadAcquire() > 0) {
+        QMutexLocker locker(&mutex);
+        callerSleeping.fetchAndStoreOrdered(1);
+        while (remaining.loadAcquire() > 0)
+            doneCondition.wait(&mutex);
+        callerSleeping.fetchAndStoreOrdered(0);
+    }
+}
+
+/**
+ * @brief WorkerPool::workerLoop
+ * @param index
+ */
+void WorkerPool::workerLoop(int index)
+{
+    int seen = 0;
+
+    while (true) {
+        int spins = 0;
+        while (generation.loadAcquire() == seen && spins++ < spinLimit)
+            cpuRelax();
+
+        if (generation.loadAcquire() == seen) {
+            //Nothing for a while - sleep. The count is raised before checking again, so run() can't miss us.
+            QMutexLocker locker(&mutex);
+            sleepingWorkers.fetchAndAddOrdered(1);
+            while (generation.loadAcquire() == seen)
+                startCondition.wait(&mutex);
+            sleepingWorkers.fetchAndAddOrdered(-1);
+        }
+
+        seen = generation.loadAcquire();
+        if (stopping) return;
+
+        job(index);
+        finishJob();
+    }
+}
+
+/**
+ * @brief WorkerPool::finishJob
+ *
+ * The last worker to finish wakes the caller, if it has stopped spinning
+ */
+void WorkerPool::finishJob()
+{
+    if (remaining.fetchAndAddOrdered(-1) == 1 && callerSleeping.loadAcquire()) {
+        QMutexLocker locker(&mutex);
+        doneCondition.wakeAll();
+    }
+}
+
+/**
+ * @brief WorkerPool::count
+ * @return number of workers, including the calling thread
+ */
+int WorkerPool::count() const
+{
+    return workerCount;
+}
+
+/**
+ * @brief WorkerPool::pinned
+ * @return true if threads are tied to CPUs
+ */
+bool WorkerPool::pinned() const
+{
+    return pinToCpus;
+}
+
+/**
+ * @brief WorkerPool::firstCpu
+ * @return CPU worker 0 is pinned to, if pinning
+ */
+int WorkerPool::firstCpu() const
+{
+    return pinOffset;
+}
+
+/**
+ * @brief WorkerPool::pinCurrentThread
+ *
+ * Tie the calling thread to one CPU. Not available on macOS, where this does nothing.
+ *
+ * @param cpu wraps round if there are more workers than CPUs
+ */
+void WorkerPool::pinCurrentThread(int cpu)
+{
+    int cpuCount = qMax(1, QThread::idealThreadCount());
+    cpu %= cpuCount;
+
+#if defined(Q_OS_WIN)
+    if (cpu < static_cast<int>(sizeof(DWORD_PTR) * 8))
+        SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu);
+#elif defined(Q_OS_LINUX)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+    Q_UNUSED(cpu)
+#endif
+}
+
+/**
+ * @brief WorkerPool::currentCpu
+ *
+ * Where the calling thread is running right now - Linux only
+ *
+ * @param node set to the CPU's NUMA node, or -1
+ * @return the CPU, or -1
+ */
+int WorkerPool::currentCpu(int *node)
+{
+    *node = -1;
+
+#if defined(Q_OS_LINUX) && defined(SYS_getcpu)
+    unsigned cpu = 0;
+    unsigned cpuNode = 0;
+    if (syscall(SYS_getcpu, &cpu, &cpuNode, nullptr) == 0) {
+        *node = static_cast<int>(cpuNode);
+        return static_cast<int>(cpu);
+    }
+#endif
+    return -1;
+}
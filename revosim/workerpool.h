@@ -0,0 +1,100 @@
+/**
+ * @file
+ * Header: Worker Pool
+ *
+ * All REvoSim code is released under the GNU General Public License.
+ * See LICENSE.md files in the programme directory.
+ *
+ * All REvoSim code is Copyright 2008-2019 by Mark D. Sutton, Russell J. Garwood,
+ * and Alan R.T. Spencer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version. This program is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY.
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <functional>
+
+//How many times to poll before going to sleep - long enough to cover the gap between phases of one iteration
+#define WORKER_POOL_SPIN_LIMIT 20000
+
+class WorkerPool;
+
+/**
+ * @brief The WorkerThread class
+ */
+class WorkerThread : public QThread
+{
+public:
+    WorkerThread(WorkerPool *workerPool, int workerIndex);
+
+protected:
+    void run() override;
+
+private:
+    WorkerPool *pool;
+    int index;
+};
+
+/**
+ * @brief The WorkerPool class
+ *
+ * A fixed set of threads that live as long as the pool. run() hands every worker the same job, with its worker
+ * number, and returns once all of them have finished - the calling thread does worker 0's share itself. Between jobs
+ * the workers spin for a while and then sleep, so back to back phases don't pay for a wake up. If pinning, the calling
+ * thread is pinned too while the pool lives, and gets its own CPUs back when the pool goes - so the pool must be
+ * deleted by the thread that made it.
+ */
+class WorkerPool
+{
+public:
+    WorkerPool(int workers, bool pin, int firstCpu = 0);
+    ~WorkerPool();
+
+    void run(const std::function<void(int)> &job);
+    int count() const;
+    bool pinned() const;
+    int firstCpu() const;
+
+    static void pinCurrentThread(int cpu);
+    static int currentCpu(int *node);
+
+private:
+    Q_DISABLE_COPY(WorkerPool)
+    friend class WorkerThread;
+
+    void workerLoop(int index);
+    void finishJob();
+
+    QList<WorkerThread *> threads;
+    int workerCount;
+    bool pinToCpus;
+    int pinOffset; //worker n is pinned to CPU pinOffset + n
+    QByteArray callerAffinity; //the calling thread's CPUs before it was pinned - empty if not pinned
+    int spinLimit; //polls before sleeping - none if there are more workers than CPUs to spin on
+
+    std::function<void(int)> job;
+    bool stopping;
+
+    QAtomicInt generation; //bumped for each job
+    QAtomicInt remaining; //workers still busy with the current job
+    QAtomicInt sleepingWorkers;
+    QAtomicInt callerSleeping;
+    QMutex mutex;
+    QWaitCondition startCondition;
+    QWaitCondition doneCondition;
+};
+
+#endif // WORKERPOOL_H